@@ -127,8 +127,7 @@ def main(args):
     dvbt2_freqinterleaver = dvbt2.freqinterleaver_cc(carrier_mode, fft_size, pilot_pattern, guard_interval, data_symbols, papr_mode, version, mode)
     dvbt2_pilotgenerator = dvbt2.pilotgenerator_cc(carrier_mode, fft_size, pilot_pattern, guard_interval, data_symbols, papr_mode, version, mode, dvbt2.MISO_TX1, dvbt2.EQUALIZATION_ON, equalization_bandwidth, fftsize)
     dvbt2_paprtr = dvbt2.paprtr_cc(carrier_mode, fft_size, pilot_pattern, guard_interval, data_symbols, papr_mode, version, papr_vclip, papr_iterations, fftsize)
-    digital_ofdm_cyclic_prefixer = digital.ofdm_cyclic_prefixer(fftsize, fftsize+(gi), 0, "")
-    dvbt2_p1insertion = dvbt2.p1insertion_cc(carrier_mode, fft_size, guard_interval, data_symbols, mode, dvbt2.SHOWLEVELS_OFF, 3.31)
+    dvbt2_p1insertion = dvbt2.p1insertion_cc(carrier_mode, fft_size, guard_interval, data_symbols, mode, dvbt2.SHOWLEVELS_OFF, 3.31, dvbt2.CYCLICPREFIX_INTERNAL)
     blocks_multiply_const = blocks.multiply_const_vcc((0.2, ))
 
     out = osmosdr.sink(args="bladerf=0,buffers=128,buflen=32768")
@@ -150,8 +149,7 @@ def main(args):
     tb.connect(dvbt2_framemapper, dvbt2_freqinterleaver)
     tb.connect(dvbt2_freqinterleaver, dvbt2_pilotgenerator)
     tb.connect(dvbt2_pilotgenerator, dvbt2_paprtr)
-    tb.connect(dvbt2_paprtr, digital_ofdm_cyclic_prefixer)
-    tb.connect(digital_ofdm_cyclic_prefixer, dvbt2_p1insertion)
+    tb.connect(dvbt2_paprtr, dvbt2_p1insertion)
     tb.connect(dvbt2_p1insertion, blocks_multiply_const)
     tb.connect(blocks_multiply_const, out)
 
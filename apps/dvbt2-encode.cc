@@ -0,0 +1,292 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * dvbt2-encode: offline TS file to IQ file encoder.
+ *
+ * Runs the complete transmitter chain without a flowgraph GUI or SDR
+ * sink.  Every block runs in its own scheduler thread, so the chain is
+ * pipelined across all available cores.  At the end the encoder reports
+ * how many times faster than real time the IQ was produced.
+ *
+ * The chain is built from the gnuradio-dvbt2 blocks with the GNU Radio
+ * C++ API; the blocks rely on the scheduler for buffering and for the
+ * modcod and frame boundary tags, so there is no separate core library.
+ */
+
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/file_source.h>
+#include <gnuradio/blocks/file_sink.h>
+#include <gnuradio/blocks/multiply_const_cc.h>
+#include <gnuradio/blocks/complex_to_interleaved_short.h>
+#include <dvbt2/bbheader_bb.h>
+#include <dvbt2/bbscrambler_bb.h>
+#include <dvbt2/bch_bb.h>
+#include <dvbt2/ldpc_bb.h>
+#include <dvbt2/interleaver_bb.h>
+#include <dvbt2/modulator_bc.h>
+#include <dvbt2/cellinterleaver_cc.h>
+#include <dvbt2/framemapper_cc.h>
+#include <dvbt2/freqinterleaver_cc.h>
+#include <dvbt2/pilotgenerator_cc.h>
+#include <dvbt2/paprtr_cc.h>
+#include <dvbt2/p1insertion_cc.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+using namespace gr::dvbt2;
+
+struct option_name {
+  const char *name;
+  int value;
+};
+
+const static option_name code_rate_names[] = {
+  {"1/2", C1_2}, {"3/5", C3_5}, {"2/3", C2_3}, {"3/4", C3_4},
+  {"4/5", C4_5}, {"5/6", C5_6}, {"1/3", C1_3}, {"2/5", C2_5},
+  {NULL, 0}
+};
+
+const static option_name constellation_names[] = {
+  {"qpsk", MOD_QPSK}, {"16qam", MOD_16QAM}, {"64qam", MOD_64QAM}, {"256qam", MOD_256QAM},
+  {NULL, 0}
+};
+
+const static option_name fftsize_names[] = {
+  {"1k", FFTSIZE_1K}, {"2k", FFTSIZE_2K}, {"4k", FFTSIZE_4K},
+  {"8k", FFTSIZE_8K}, {"8ke", FFTSIZE_8K_T2GI},
+  {"16k", FFTSIZE_16K}, {"16ke", FFTSIZE_16K_T2GI},
+  {"32k", FFTSIZE_32K}, {"32ke", FFTSIZE_32K_T2GI},
+  {NULL, 0}
+};
+
+const static option_name guardinterval_names[] = {
+  {"1/32", GI_1_32}, {"1/16", GI_1_16}, {"1/8", GI_1_8}, {"1/4", GI_1_4},
+  {"1/128", GI_1_128}, {"19/128", GI_19_128}, {"19/256", GI_19_256},
+  {NULL, 0}
+};
+
+const static option_name pilotpattern_names[] = {
+  {"pp1", PILOT_PP1}, {"pp2", PILOT_PP2}, {"pp3", PILOT_PP3}, {"pp4", PILOT_PP4},
+  {"pp5", PILOT_PP5}, {"pp6", PILOT_PP6}, {"pp7", PILOT_PP7}, {"pp8", PILOT_PP8},
+  {NULL, 0}
+};
+
+const static option_name bandwidth_names[] = {
+  {"1.7", BANDWIDTH_1_7_MHZ}, {"5", BANDWIDTH_5_0_MHZ}, {"6", BANDWIDTH_6_0_MHZ},
+  {"7", BANDWIDTH_7_0_MHZ}, {"8", BANDWIDTH_8_0_MHZ}, {"10", BANDWIDTH_10_0_MHZ},
+  {NULL, 0}
+};
+
+/* elementary period T in microseconds, as {numerator, denominator} */
+const static int elementary_period[6][2] = {
+  {71, 131}, {7, 40}, {7, 48}, {1, 8}, {7, 64}, {7, 80}
+};
+
+static int
+lookup(const option_name *table, const char *name, const char *what)
+{
+  for (int i = 0; table[i].name != NULL; i++) {
+    if (strcmp(table[i].name, name) == 0) {
+      return table[i].value;
+    }
+  }
+  fprintf(stderr, "dvbt2-encode: invalid %s '%s', valid values:", what, name);
+  for (int i = 0; table[i].name != NULL; i++) {
+    fprintf(stderr, " %s", table[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+    "usage: dvbt2-encode [options] input.ts output.iq\n"
+    "  -f format         output sample format, cf32 or cs16 (default cf32)\n"
+    "  -w bandwidth      channel bandwidth in MHz: 1.7 5 6 7 8 10 (default 8)\n"
+    "  -F fftsize        1k 2k 4k 8k 8ke 16k 16ke 32k 32ke (default 4k)\n"
+    "  -g guard          1/128 1/32 1/16 19/256 1/8 19/128 1/4 (default 1/32)\n"
+    "  -p pilots         pp1 ... pp8 (default pp7)\n"
+    "  -r rate           1/2 3/5 2/3 3/4 4/5 5/6 (default 2/3)\n"
+    "  -m modulation     qpsk 16qam 64qam 256qam (default 64qam)\n"
+    "  -s symbols        data symbols per T2 frame (default 100)\n"
+    "  -b blocks         FEC blocks per T2 frame (default 31)\n"
+    "  -t blocks         TI blocks per interleaving frame (default 3)\n"
+    "  -a amplitude      output scale factor (default 0.2)\n");
+  exit(1);
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1e6);
+}
+
+int
+main(int argc, char **argv)
+{
+  dvbt2_framesize_t frame_size = FECFRAME_NORMAL;
+  dvbt2_code_rate_t code_rate = C2_3;
+  dvbt2_constellation_t constellation = MOD_64QAM;
+  dvbt2_fftsize_t fft_size = FFTSIZE_4K;
+  dvbt2_guardinterval_t guard_interval = GI_1_32;
+  dvbt2_pilotpattern_t pilot_pattern = PILOT_PP7;
+  dvbt2_bandwidth_t bandwidth = BANDWIDTH_8_0_MHZ;
+  int data_symbols = 100;
+  int fec_blocks = 31;
+  int ti_blocks = 3;
+  float amplitude = 0.2;
+  bool cs16 = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:w:F:g:p:r:m:s:b:t:a:")) != -1) {
+    switch (opt) {
+      case 'f':
+        if (strcmp(optarg, "cs16") == 0) {
+          cs16 = true;
+        }
+        else if (strcmp(optarg, "cf32") != 0) {
+          usage();
+        }
+        break;
+      case 'w':
+        bandwidth = (dvbt2_bandwidth_t)lookup(bandwidth_names, optarg, "bandwidth");
+        break;
+      case 'F':
+        fft_size = (dvbt2_fftsize_t)lookup(fftsize_names, optarg, "FFT size");
+        break;
+      case 'g':
+        guard_interval = (dvbt2_guardinterval_t)lookup(guardinterval_names, optarg, "guard interval");
+        break;
+      case 'p':
+        pilot_pattern = (dvbt2_pilotpattern_t)lookup(pilotpattern_names, optarg, "pilot pattern");
+        break;
+      case 'r':
+        code_rate = (dvbt2_code_rate_t)lookup(code_rate_names, optarg, "code rate");
+        break;
+      case 'm':
+        constellation = (dvbt2_constellation_t)lookup(constellation_names, optarg, "modulation");
+        break;
+      case 's':
+        data_symbols = atoi(optarg);
+        break;
+      case 'b':
+        fec_blocks = atoi(optarg);
+        break;
+      case 't':
+        ti_blocks = atoi(optarg);
+        break;
+      case 'a':
+        amplitude = atof(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+  }
+
+  int fftsize;
+  switch (fft_size) {
+    case FFTSIZE_1K:
+      fftsize = 1024;
+      break;
+    case FFTSIZE_2K:
+      fftsize = 2048;
+      break;
+    case FFTSIZE_4K:
+      fftsize = 4096;
+      break;
+    case FFTSIZE_8K:
+    case FFTSIZE_8K_T2GI:
+      fftsize = 8192;
+      break;
+    case FFTSIZE_16K:
+    case FFTSIZE_16K_T2GI:
+      fftsize = 16384;
+      break;
+    default:
+      fftsize = 32768;
+      break;
+  }
+  double samp_rate = 1e6 * elementary_period[bandwidth][1] / elementary_period[bandwidth][0];
+
+  gr::top_block_sptr tb = gr::make_top_block("dvbt2-encode");
+
+  gr::blocks::file_source::sptr src = gr::blocks::file_source::make(sizeof(unsigned char), argv[optind], false);
+  bbheader_bb::sptr bbheader = bbheader_bb::make(frame_size, code_rate, INPUTMODE_NORMAL, INBAND_OFF, fec_blocks, 4000000);
+  bbscrambler_bb::sptr bbscrambler = bbscrambler_bb::make(frame_size, code_rate);
+  bch_bb::sptr bch = bch_bb::make(frame_size, code_rate);
+  ldpc_bb::sptr ldpc = ldpc_bb::make(frame_size, code_rate);
+  interleaver_bb::sptr interleaver = interleaver_bb::make(frame_size, code_rate, constellation);
+  modulator_bc::sptr modulator = modulator_bc::make(frame_size, constellation, ROTATION_ON);
+  cellinterleaver_cc::sptr cellinterleaver = cellinterleaver_cc::make(frame_size, constellation, fec_blocks, ti_blocks);
+  framemapper_cc::sptr framemapper = framemapper_cc::make(frame_size, code_rate, constellation, ROTATION_ON, fec_blocks, ti_blocks, CARRIERS_NORMAL, fft_size, guard_interval, L1_MOD_16QAM, pilot_pattern, 2, data_symbols, PAPR_OFF, VERSION_111, PREAMBLE_T2_SISO, INPUTMODE_NORMAL, RESERVED_OFF, L1_SCRAMBLED_OFF, INBAND_OFF);
+  freqinterleaver_cc::sptr freqinterleaver = freqinterleaver_cc::make(CARRIERS_NORMAL, fft_size, pilot_pattern, guard_interval, data_symbols, PAPR_OFF, VERSION_111, PREAMBLE_T2_SISO);
+  pilotgenerator_cc::sptr pilotgenerator = pilotgenerator_cc::make(CARRIERS_NORMAL, fft_size, pilot_pattern, guard_interval, data_symbols, PAPR_OFF, VERSION_111, PREAMBLE_T2_SISO, MISO_TX1, EQUALIZATION_ON, bandwidth, fftsize);
+  paprtr_cc::sptr paprtr = paprtr_cc::make(CARRIERS_NORMAL, fft_size, pilot_pattern, guard_interval, data_symbols, PAPR_OFF, VERSION_111, 3.3, 3, fftsize);
+  p1insertion_cc::sptr p1insertion = p1insertion_cc::make(CARRIERS_NORMAL, fft_size, guard_interval, data_symbols, PREAMBLE_T2_SISO, SHOWLEVELS_OFF, 3.31, CYCLICPREFIX_INTERNAL);
+
+  tb->connect(src, 0, bbheader, 0);
+  tb->connect(bbheader, 0, bbscrambler, 0);
+  tb->connect(bbscrambler, 0, bch, 0);
+  tb->connect(bch, 0, ldpc, 0);
+  tb->connect(ldpc, 0, interleaver, 0);
+  tb->connect(interleaver, 0, modulator, 0);
+  tb->connect(modulator, 0, cellinterleaver, 0);
+  tb->connect(cellinterleaver, 0, framemapper, 0);
+  tb->connect(framemapper, 0, freqinterleaver, 0);
+  tb->connect(freqinterleaver, 0, pilotgenerator, 0);
+  tb->connect(pilotgenerator, 0, paprtr, 0);
+  tb->connect(paprtr, 0, p1insertion, 0);
+
+  if (cs16) {
+    gr::blocks::multiply_const_cc::sptr scale = gr::blocks::multiply_const_cc::make(gr_complex(amplitude * 32767.0, 0.0));
+    gr::blocks::complex_to_interleaved_short::sptr convert = gr::blocks::complex_to_interleaved_short::make();
+    gr::blocks::file_sink::sptr dst = gr::blocks::file_sink::make(sizeof(short), argv[optind + 1]);
+    tb->connect(p1insertion, 0, scale, 0);
+    tb->connect(scale, 0, convert, 0);
+    tb->connect(convert, 0, dst, 0);
+  }
+  else {
+    gr::blocks::multiply_const_cc::sptr scale = gr::blocks::multiply_const_cc::make(gr_complex(amplitude, 0.0));
+    gr::blocks::file_sink::sptr dst = gr::blocks::file_sink::make(sizeof(gr_complex), argv[optind + 1]);
+    tb->connect(p1insertion, 0, scale, 0);
+    tb->connect(scale, 0, dst, 0);
+  }
+
+  double start = now();
+  tb->run();
+  double elapsed = now() - start;
+
+  double samples = (double)p1insertion->nitems_written(0);
+  double duration = samples / samp_rate;
+  fprintf(stderr, "dvbt2-encode: %.0f samples, %.3f s of signal at %.6f Msps\n", samples, duration, samp_rate / 1e6);
+  fprintf(stderr, "dvbt2-encode: encoded in %.3f s, %.1f Msps, %.2fx real time\n", elapsed, samples / elapsed / 1e6, elapsed > 0.0 ? duration / elapsed : 0.0);
+  return 0;
+}
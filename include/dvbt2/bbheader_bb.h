@@ -46,8 +46,43 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::bbheader_bb::make is the public interface for
        * creating new instances.
+       *
+       * The first bit of each BBFRAME carries a "fecframe_start" tag
+       * holding a running FEC frame count.
+       *
+       * The input is framed on the TS sync byte.  After sync is lost
+       * the block searches for it again, and sends null packets until
+       * five consecutive sync bytes are found.
+       *
+       * With npd set to NPD_ON, null packets (PID 0x1FFF) are removed
+       * from the stream and the number deleted before each user packet
+       * is sent in a DNP byte appended to it.
+       *
+       * With issy set to ISSY_SHORT or ISSY_LONG, an ISSY field is sent
+       * after each packet in normal mode, or in the BBHEADER in high
+       * efficiency mode.  The ISCR is timed from tsrate and the sample
+       * clock of the given bandwidth, so tsrate must be set.
+       *
+       * With payloadtype set to PAYLOAD_GCS the input bytes fill each
+       * data field as a generic continuous stream.  With PAYLOAD_GSE
+       * the input is a stream of GSE packets, which are packed whole
+       * into BBFRAMEs.  NPD and ISSY apply to transport streams only.
+       *
+       * A dict with "rate" and/or "constellation" sent to the "modcod"
+       * message port changes the PLP.  The change is announced at the
+       * next superframe with a "modcod_announce" tag, so framemapper_cc
+       * can signal it in L1, and takes effect one superframe later with
+       * a "modcod" tag.  Both tags sit on the first bit of the first
+       * BBFRAME of a superframe, counted from the start of the stream.
+       * t2frames must match framemapper_cc for this, modcod changes are
+       * refused while it is 0.
+       *
+       * datacells is the number of PLP data cells in a T2 frame, as
+       * given by framemapper_cc::data_cells().  When it is set, a
+       * constellation change is refused if fecblocks FEC blocks of the
+       * new constellation need more cells than that.
        */
-      static sptr make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate);
+      static sptr make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate, dvbt2_npd_t npd = NPD_OFF, dvbt2_issy_t issy = ISSY_OFF, dvbt2_bandwidth_t bandwidth = BANDWIDTH_8_0_MHZ, dvbt2_payloadtype_t payloadtype = PAYLOAD_TS, int t2frames = 0, int datacells = 0);
     };
 
   } // namespace dvbt2
@@ -32,6 +32,7 @@
 #define TS_GS_GENERIC_PACKETIZED 0
 #define TS_GS_GENERIC_CONTINUOUS 1
 #define TS_GS_RESERVED 2
+#define TS_GS_GENERIC_ENCAPSULATED 2
 
 #define SIS_MIS_SINGLE 1
 #define SIS_MIS_MULTIPLE 0
@@ -48,6 +49,12 @@
 #define FRAME_SIZE_NORMAL 64800
 #define FRAME_SIZE_SHORT  16200
 
+// Largest BCH block sizes, for runtime code rate changes
+#define KBCH_MAX_NORMAL 53840
+#define KBCH_MAX_SHORT  13152
+#define NBCH_MAX_NORMAL 54000
+#define NBCH_MAX_SHORT  13320
+
 // BCH Code
 #define BCH_CODE_N8  0
 #define BCH_CODE_N10 1
@@ -92,6 +99,12 @@ namespace gr {
       STREAMTYPE_BOTH,
     };
 
+    enum dvbt2_payloadtype_t {
+      PAYLOAD_GCS = 1,
+      PAYLOAD_GSE,
+      PAYLOAD_TS,
+    };
+
     enum dvbt2_inputmode_t {
       INPUTMODE_NORMAL = 0,
       INPUTMODE_HIEFF,
@@ -176,6 +189,7 @@ namespace gr {
     enum dvbt2_misogroup_t {
       MISO_TX1 = 0,
       MISO_TX2,
+      MISO_TX1_TX2,
     };
 
     enum dvbt2_showlevels_t {
@@ -183,11 +197,38 @@ namespace gr {
       SHOWLEVELS_ON,
     };
 
+    enum dvbt2_processing_t {
+      PROCESSING_FRAME = 0,
+      PROCESSING_SYMBOL,
+    };
+
+    enum dvbt2_cyclicprefix_t {
+      CYCLICPREFIX_EXTERNAL = 0,
+      CYCLICPREFIX_INTERNAL,
+    };
+
+    enum dvbt2_txtime_t {
+      TXTIME_OFF = 0,
+      TXTIME_FIRST,
+      TXTIME_ALL,
+    };
+
     enum dvbt2_inband_t {
       INBAND_OFF = 0,
       INBAND_ON,
     };
 
+    enum dvbt2_npd_t {
+      NPD_OFF = 0,
+      NPD_ON,
+    };
+
+    enum dvbt2_issy_t {
+      ISSY_OFF = 0,
+      ISSY_SHORT,
+      ISSY_LONG,
+    };
+
     enum dvbt2_equalization_t {
       EQUALIZATION_OFF = 0,
       EQUALIZATION_ON,
@@ -210,6 +251,7 @@ typedef gr::dvbt2::dvbt2_constellation_t dvbt2_constellation_t;
 typedef gr::dvbt2::dvbt2_rotation_t dvbt2_rotation_t;
 typedef gr::dvbt2::dvbt2_framesize_t dvbt2_framesize_t;
 typedef gr::dvbt2::dvbt2_streamtype_t dvbt2_streamtype_t;
+typedef gr::dvbt2::dvbt2_payloadtype_t dvbt2_payloadtype_t;
 typedef gr::dvbt2::dvbt2_inputmode_t dvbt2_inputmode_t;
 typedef gr::dvbt2::dvbt2_extended_carrier_t dvbt2_extended_carrier_t;
 typedef gr::dvbt2::dvbt2_preamble_t dvbt2_preamble_t;
@@ -223,7 +265,12 @@ typedef gr::dvbt2::dvbt2_reservedbiasbits_t dvbt2_reservedbiasbits_t;
 typedef gr::dvbt2::dvbt2_l1scrambled_t dvbt2_l1scrambled_t;
 typedef gr::dvbt2::dvbt2_misogroup_t dvbt2_misogroup_t;
 typedef gr::dvbt2::dvbt2_showlevels_t dvbt2_showlevels_t;
+typedef gr::dvbt2::dvbt2_processing_t dvbt2_processing_t;
+typedef gr::dvbt2::dvbt2_cyclicprefix_t dvbt2_cyclicprefix_t;
+typedef gr::dvbt2::dvbt2_txtime_t dvbt2_txtime_t;
 typedef gr::dvbt2::dvbt2_inband_t dvbt2_inband_t;
+typedef gr::dvbt2::dvbt2_npd_t dvbt2_npd_t;
+typedef gr::dvbt2::dvbt2_issy_t dvbt2_issy_t;
 typedef gr::dvbt2::dvbt2_equalization_t dvbt2_equalization_t;
 typedef gr::dvbt2::dvbt2_bandwidth_t dvbt2_bandwidth_t;
 
@@ -46,8 +46,40 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::framemapper_cc::make is the public interface for
        * creating new instances.
+       *
+       * The first cell of each T2 frame carries a "t2_frame_idx" tag,
+       * plus a "superframe_idx" tag at the start of a superframe. The
+       * first cell of each OFDM symbol carries a "symbol_idx" tag.
+       *
+       * L1 fields received as a PMT dictionary on the "l1" message
+       * port (e.g. from t2mi_parser_bb) replace the configured values
+       * from the next T2 frame on. Fields that would change the frame
+       * structure are only checked against the configuration.
+       *
+       * The "l1update" message port takes the same dictionary for a
+       * local reconfiguration (cell_id, network_id, t2_system_id, ...).
+       * L1_CHANGE_COUNTER announces the new values for the rest of the
+       * current superframe (2) and all of the next one (1), and they
+       * go on air in the superframe after that.
+       *
+       * A "modcod_announce" tag from bbheader_bb sets L1_CHANGE_COUNTER
+       * to 1 for the superframe, and PLP_COD and PLP_MOD change with the
+       * "modcod" tag that starts the next one.  A modcod tag anywhere
+       * but the first cell of a superframe stops the flowgraph, and so
+       * does an announced constellation whose fecblocks FEC blocks
+       * don't fit in data_cells(); pass data_cells() to bbheader_bb
+       * to have such a change refused there instead.
+       *
+       * payloadtype sets the stream TYPE and PLP_PAYLOAD_TYPE signalled
+       * in L1, and must match the bbheader_bb setting.
+       */
+      static sptr make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype = PAYLOAD_TS);
+
+      /*!
+       * \brief Number of PLP data cells in a T2 frame, the cells left
+       * after L1-pre, L1-post and the frame closing symbol.
        */
-      static sptr make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband);
+      virtual int data_cells() const = 0;
     };
 
   } // namespace dvbt2
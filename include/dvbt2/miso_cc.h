@@ -46,8 +46,12 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::miso_cc::make is the public interface for
        * creating new instances.
+       *
+       * With \p processing set to PROCESSING_SYMBOL the block works on
+       * single OFDM symbols instead of whole T2 frames, keeping each
+       * symbol's index within the frame in a "symbol_idx" stream tag.
        */
-      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode);
+      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_processing_t processing = PROCESSING_FRAME);
     };
 
   } // namespace dvbt2
@@ -46,8 +46,23 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::p1insertion_cc::make is the public interface for
        * creating new instances.
+       *
+       * With \p cyclicprefix set to CYCLICPREFIX_INTERNAL the block
+       * takes OFDM symbols of FFT size length directly from the PAPR
+       * block and inserts the guard intervals itself, so each T2 frame
+       * sample is written exactly once instead of being copied by an
+       * external cyclic prefixer first.
+       *
+       * With \p txtime set, the start of the P1 symbol carries a UHD
+       * style "tx_time" tag: \p epoch (seconds) plus the frame's
+       * position in the stream, taken from the framemapper_cc
+       * "superframe_idx" and "t2_frame_idx" tags and \p t2frames. The
+       * time is exact in elementary periods of \p bandwidth, so every
+       * transmitter given the same epoch emits a frame at the same
+       * instant. TXTIME_FIRST tags only the first frame, for sinks that
+       * keep a continuous stream; TXTIME_ALL tags every frame.
        */
-      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip);
+      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip, dvbt2_cyclicprefix_t cyclicprefix = CYCLICPREFIX_EXTERNAL, dvbt2_txtime_t txtime = TXTIME_OFF, dvbt2_bandwidth_t bandwidth = BANDWIDTH_8_0_MHZ, int t2frames = 2, double epoch = 0.0);
     };
 
   } // namespace dvbt2
@@ -46,8 +46,16 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::paprtr_cc::make is the public interface for
        * creating new instances.
+       *
+       * With \p processing set to PROCESSING_SYMBOL the block works on
+       * single OFDM symbols instead of whole T2 frames, keeping each
+       * symbol's index within the frame in a "symbol_idx" stream tag.
+       *
+       * Connecting two inputs and two outputs (the TX1 and TX2 streams
+       * of a MISO pilot generator) reserves tones on both streams while
+       * computing the reference kernel only once per symbol.
        */
-      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength);
+      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength, dvbt2_processing_t processing = PROCESSING_FRAME);
     };
 
   } // namespace dvbt2
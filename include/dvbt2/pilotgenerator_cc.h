@@ -46,8 +46,16 @@ namespace gr {
        * constructor is in a private implementation
        * class. dvbt2::pilotgenerator_cc::make is the public interface for
        * creating new instances.
+       *
+       * With \p processing set to PROCESSING_SYMBOL the block works on
+       * single OFDM symbols instead of whole T2 frames, keeping each
+       * symbol's index within the frame in a "symbol_idx" stream tag.
+       *
+       * With \p misogroup set to MISO_TX1_TX2 the block has two inputs
+       * and two outputs (the TX1 and TX2 streams from miso_cc) and
+       * generates both MISO groups from a single carrier map walk.
        */
-      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength);
+      static sptr make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength, dvbt2_processing_t processing = PROCESSING_FRAME);
     };
 
   } // namespace dvbt2
@@ -0,0 +1,68 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_DVBT2_T2MI_PARSER_BB_H
+#define INCLUDED_DVBT2_T2MI_PARSER_BB_H
+
+#include <dvbt2/api.h>
+#include <dvbt2/dvbt2_config.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*!
+     * \brief Extracts BBFRAMEs and L1 signalling from a T2-MI stream.
+     * \ingroup dvbt2
+     *
+     * Input is a packed T2-MI byte stream, as sent by t2mi_gateway_bb.
+     * Output is the unpacked BBFRAME bit stream for bbscrambler_bb.
+     * Packets with a bad CRC-32 are skipped a byte at a time until the
+     * stream is back in sync.  BB frame packets lost that way are
+     * replaced with empty BBFRAMEs when the next T2 frame starts, so
+     * each T2 frame keeps the number of BBFRAMEs of the first one
+     * received intact.
+     *
+     * The fields of each new L1-current packet are published as a PMT
+     * dictionary on the "l1" message port. Connect it to the "l1" port
+     * of framemapper_cc to follow the gateway's L1 signalling.
+     */
+    class DVBT2_API t2mi_parser_bb : virtual public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<t2mi_parser_bb> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of dvbt2::t2mi_parser_bb.
+       *
+       * To avoid accidental use of raw pointers, dvbt2::t2mi_parser_bb's
+       * constructor is in a private implementation
+       * class. dvbt2::t2mi_parser_bb::make is the public interface for
+       * creating new instances.
+       */
+      static sptr make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_T2MI_PARSER_BB_H */
+
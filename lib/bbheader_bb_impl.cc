@@ -25,21 +25,22 @@
 #include <gnuradio/io_signature.h>
 #include "bbheader_bb_impl.h"
 #include <stdio.h>
+#include <string.h>
 
 namespace gr {
   namespace dvbt2 {
 
     bbheader_bb::sptr
-    bbheader_bb::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate)
+    bbheader_bb::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate, dvbt2_npd_t npd, dvbt2_issy_t issy, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype, int t2frames, int datacells)
     {
       return gnuradio::get_initial_sptr
-        (new bbheader_bb_impl(framesize, rate, mode, inband, fecblocks, tsrate));
+        (new bbheader_bb_impl(framesize, rate, mode, inband, fecblocks, tsrate, npd, issy, bandwidth, payloadtype, t2frames, datacells));
     }
 
     /*
      * The private constructor
      */
-    bbheader_bb_impl::bbheader_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate)
+    bbheader_bb_impl::bbheader_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate, dvbt2_npd_t npd, dvbt2_issy_t issy, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype, int t2frames, int datacells)
       : gr::block("bbheader_bb",
               gr::io_signature::make(1, 1, sizeof(unsigned char)),
               gr::io_signature::make(1, 1, sizeof(unsigned char)))
@@ -47,71 +48,54 @@ namespace gr {
         count = 0;
         crc = 0x0;
         BBHeader *f = &m_format[0].bb_header;
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        set_rate(rate);
+
+        if (payloadtype == gr::dvbt2::PAYLOAD_TS)
         {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                case gr::dvbt2::C2_5:
-                case gr::dvbt2::C1_2:
-                    kbch = 32208;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 38688;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 43040;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 48408;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 51648;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 53840;
-                    break;
-            }
+            f->ts_gs   = TS_GS_TRANSPORT;
         }
         else
         {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                    kbch = 5232;
-                    break;
-                case gr::dvbt2::C2_5:
-                    kbch = 6312;
-                    break;
-                case gr::dvbt2::C1_2:
-                    kbch = 7032;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 9552;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 10632;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 11712;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 12432;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 13152;
-                    break;
-            }
+            /* NPD and ISSY are only provided for transport streams */
+            f->ts_gs   = payloadtype == gr::dvbt2::PAYLOAD_GCS ? TS_GS_GENERIC_CONTINUOUS : TS_GS_GENERIC_ENCAPSULATED;
+            npd = gr::dvbt2::NPD_OFF;
+            issy = gr::dvbt2::ISSY_OFF;
         }
-
-        f->ts_gs   = TS_GS_TRANSPORT;
         f->sis_mis = SIS_MIS_SINGLE;
         f->ccm_acm = CCM;
-        f->issyi   = ISSYI_NOT_ACTIVE;
-        f->npd     = NPD_NOT_ACTIVE;
-        if (mode == gr::dvbt2::INPUTMODE_NORMAL)
+        if (issy != gr::dvbt2::ISSY_OFF && tsrate <= 0)
+        {
+            printf("ISSY needs the Transport Stream rate, ISSY disabled.\n");
+            issy = gr::dvbt2::ISSY_OFF;
+        }
+        packet_length = TS_PACKET_LENGTH;
+        if (issy == gr::dvbt2::ISSY_OFF)
         {
-            f->upl     = 188 * 8;
+            f->issyi   = ISSYI_NOT_ACTIVE;
+            issy_length = 0;
+        }
+        else
+        {
+            f->issyi   = ISSYI_ACTIVE;
+            issy_length = issy == gr::dvbt2::ISSY_SHORT ? 2 : 3;
+            if (mode == gr::dvbt2::INPUTMODE_NORMAL)
+            {
+                packet_length += issy_length;
+            }
+        }
+        if (npd == gr::dvbt2::NPD_ON)
+        {
+            f->npd     = NPD_ACTIVE;
+            packet_length += 1;
+        }
+        else
+        {
+            f->npd     = NPD_NOT_ACTIVE;
+        }
+        if (mode == gr::dvbt2::INPUTMODE_NORMAL && payloadtype == gr::dvbt2::PAYLOAD_TS)
+        {
+            f->upl     = packet_length * 8;
             f->dfl     = kbch - 80;
             f->sync    = 0x47;
         }
@@ -125,12 +109,88 @@ namespace gr {
 
         build_crc8_table();
         input_mode = mode;
+        payload_type = payloadtype;
         inband_type_b = inband;
-        fec_blocks = fecblocks;
+        fec_blocks = fecblocks > 0 ? fecblocks : 1;
         fec_block = 0;
+        superframe_blocks = t2frames > 0 ? fec_blocks * t2frames : 0;
+        superframe_block = 0;
         ts_rate = tsrate;
-        extra = (((kbch - 80) / 8) / 187) + 1;
-        set_output_multiple(kbch);
+        npd_mode = npd;
+        deleted_nulls = 0;
+        delete_budget = 0;
+        memset(packet_trailer, 0, sizeof(packet_trailer));
+        memset(frame_issy, 0, sizeof(frame_issy));
+        frame_first = FALSE;
+        first_iscr = 0;
+        /* receiver buffer for one frame of user packets */
+        bufs_bits = fec_blocks * (kbch - 80);
+        if (bufs_bits > ISSY_BUFS_MAX || bufs_bits <= 0)
+        {
+            bufs_bits = ISSY_BUFS_MAX;
+        }
+        /* ISCR counts elementary periods T, clock_num / clock_den Hz */
+        uint64_t clock_num, clock_den;
+        switch (bandwidth)
+        {
+            case gr::dvbt2::BANDWIDTH_1_7_MHZ:
+                clock_num = 131000000;
+                clock_den = 71;
+                break;
+            case gr::dvbt2::BANDWIDTH_5_0_MHZ:
+                clock_num = 40000000;
+                clock_den = 7;
+                break;
+            case gr::dvbt2::BANDWIDTH_6_0_MHZ:
+                clock_num = 48000000;
+                clock_den = 7;
+                break;
+            case gr::dvbt2::BANDWIDTH_7_0_MHZ:
+                clock_num = 8000000;
+                clock_den = 1;
+                break;
+            case gr::dvbt2::BANDWIDTH_10_0_MHZ:
+                clock_num = 80000000;
+                clock_den = 7;
+                break;
+            case gr::dvbt2::BANDWIDTH_8_0_MHZ:
+            default:
+                clock_num = 64000000;
+                clock_den = 7;
+                break;
+        }
+        iscr_step = 8 * clock_num;
+        iscr_divisor = (tsrate > 0 ? tsrate : 1) * clock_den;
+        iscr_acc = 0;
+        sync_state = TS_SYNC_SEARCH;
+        sync_misses = 0;
+        report_time = 0;
+        reports_suppressed = 0;
+        memset(null_packet, 0xff, TS_PACKET_LENGTH);
+        null_packet[0] = TS_SYNC_BYTE;
+        null_packet[1] = 0x1f;
+        null_packet[2] = 0xff;
+        null_packet[3] = 0x10;
+        fecframe_count = 0;
+        fecframe_key = pmt::string_to_symbol("fecframe_start");
+        set_tag_propagation_policy(TPP_DONT);
+        modcod_pending = pmt::PMT_NIL;
+        modcod_announced = pmt::PMT_NIL;
+        modcod_tag = pmt::PMT_NIL;
+        announce_tag = pmt::PMT_NIL;
+        data_cells = datacells;
+        modcod_key = pmt::string_to_symbol("modcod");
+        modcod_announce_key = pmt::string_to_symbol("modcod_announce");
+        message_port_register_in(pmt::mp("modcod"));
+        set_msg_handler(pmt::mp("modcod"), boost::bind(&bbheader_bb_impl::handle_modcod, this, _1));
+        /* sizes the buffers for a BBFRAME of any code rate, see start() */
+        set_output_multiple(frame_size == FRAME_SIZE_NORMAL ? KBCH_MAX_NORMAL : KBCH_MAX_SHORT);
+        stats.attach(this, kbch, 1);
+        sync_error_counter = stats.add_counter("sync_errors");
+        sync_loss_counter = stats.add_counter("sync_losses");
+        null_packet_counter = stats.add_counter("null_packets");
+        deleted_null_counter = stats.add_counter("deleted_nulls");
+        dropped_packet_counter = stats.add_counter("dropped_packets");
     }
 
     /*
@@ -140,39 +200,279 @@ namespace gr {
     {
     }
 
+    /*
+     * The runtime allocates the buffers from the output multiple set in
+     * the constructor, which fits a BBFRAME of any code rate.  Running
+     * with that multiple would hold back the last frames until a
+     * larger amount of output is free, so from here on it follows the
+     * current code rate.
+     */
+    bool
+    bbheader_bb_impl::start()
+    {
+        set_output_multiple(kbch);
+        return true;
+    }
+
     void
     bbheader_bb_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-        if (input_mode == gr::dvbt2::INPUTMODE_NORMAL)
+        if (payload_type != gr::dvbt2::PAYLOAD_TS)
         {
-            ninput_items_required[0] = ((noutput_items - 80) / 8);
+            /* a full data field, plus the longest GSE packet */
+            ninput_items_required[0] = (noutput_items / kbch) * ((kbch - 80) / 8);
+            if (payload_type == gr::dvbt2::PAYLOAD_GSE)
+            {
+                ninput_items_required[0] += GSE_PACKET_MAX;
+            }
+            return;
         }
-        else
+        /* whole packets, plus lookahead to verify sync while searching */
+        ninput_items_required[0] = ((noutput_items / kbch) * frame_packets * TS_PACKET_LENGTH) + (TS_SYNC_LOCK * TS_PACKET_LENGTH);
+        if (npd_mode == gr::dvbt2::NPD_ON)
+        {
+            /* room to delete as many null packets as are sent */
+            ninput_items_required[0] += (noutput_items / kbch) * frame_packets * TS_PACKET_LENGTH;
+        }
+    }
+
+void bbheader_bb_impl::set_rate(int rate)
+{
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (rate)
         {
-            ninput_items_required[0] = ((noutput_items - 80) / 8) + extra;
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                kbch = 32208;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 38688;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 43040;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 48408;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 51648;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 53840;
+                break;
         }
     }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                kbch = 5232;
+                break;
+            case gr::dvbt2::C2_5:
+                kbch = 6312;
+                break;
+            case gr::dvbt2::C1_2:
+                kbch = 7032;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 9552;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 10632;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 11712;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 12432;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 13152;
+                break;
+        }
+    }
+    m_format[0].bb_header.dfl = kbch - 80;
+    /* packets started in one BBFRAME, at least 187 payload bytes each */
+    frame_packets = (((kbch - 80) / 8) / (TS_PACKET_LENGTH - 1)) + 2;
+}
+
+/*
+ * A modcod change arrives as a dictionary with "rate" and/or
+ * "constellation" (dvbt2_code_rate_t and dvbt2_constellation_t
+ * values).  It is announced at the next superframe and takes effect
+ * at the one after, see superframe_start().
+ */
+void bbheader_bb_impl::handle_modcod(pmt::pmt_t msg)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+    pmt::pmt_t modcod = pmt::make_dict();
+    int valid = FALSE;
+    long value;
+
+    if (!pmt::is_dict(msg))
+    {
+        return;
+    }
+    if (superframe_blocks == 0)
+    {
+        printf("Number of T2 frames not set, modcod change ignored.\n");
+        return;
+    }
+    if (pmt::dict_has_key(msg, rate_key))
+    {
+        value = pmt::to_long(pmt::dict_ref(msg, rate_key, pmt::PMT_NIL));
+        if (value < gr::dvbt2::C1_2 || value > gr::dvbt2::C2_5 ||
+            (frame_size == FRAME_SIZE_NORMAL && (value == gr::dvbt2::C1_3 || value == gr::dvbt2::C2_5)))
+        {
+            printf("Code rate not available, modcod change ignored.\n");
+            return;
+        }
+        modcod = pmt::dict_add(modcod, rate_key, pmt::from_long(value));
+        valid = TRUE;
+    }
+    if (pmt::dict_has_key(msg, constellation_key))
+    {
+        value = pmt::to_long(pmt::dict_ref(msg, constellation_key, pmt::PMT_NIL));
+        if (value < gr::dvbt2::MOD_QPSK || value > gr::dvbt2::MOD_256QAM)
+        {
+            printf("Constellation not available, modcod change ignored.\n");
+            return;
+        }
+        /* QPSK to 256QAM carry 2 to 8 bits per cell */
+        if (data_cells != 0 && fec_blocks * (int)(frame_size / (2 * (value + 1))) > data_cells)
+        {
+            printf("Too many FEC blocks in T2 frame, modcod change ignored.\n");
+            return;
+        }
+        modcod = pmt::dict_add(modcod, constellation_key, pmt::from_long(value));
+        valid = TRUE;
+    }
+    if (valid == TRUE)
+    {
+        modcod_pending = modcod;
+    }
+}
+
+/*
+ * Runs after the last BBFRAME of a superframe.  The announced change
+ * switches the code rate from the next BBFRAME on, and a pending one
+ * is announced there, so framemapper_cc can signal it in L1 for the
+ * whole superframe before it is used.
+ */
+void bbheader_bb_impl::superframe_start(void)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+
+    if (pmt::is_dict(modcod_announced))
+    {
+        if (pmt::dict_has_key(modcod_announced, rate_key))
+        {
+            set_rate(pmt::to_long(pmt::dict_ref(modcod_announced, rate_key, pmt::PMT_NIL)));
+            set_output_multiple(kbch);
+            stats.set_frame_items(kbch);
+        }
+        modcod_tag = modcod_announced;
+        modcod_announced = pmt::PMT_NIL;
+    }
+    if (pmt::is_dict(modcod_pending))
+    {
+        announce_tag = modcod_pending;
+        modcod_announced = modcod_pending;
+        modcod_pending = pmt::PMT_NIL;
+    }
+}
 
 #define CRC_POLY 0xAB
 // Reversed
 #define CRC_POLYR 0xD5
 
-void bbheader_bb_impl::build_crc8_table(void)
+/*
+ * The CRC-8 and bit unpacking tables are constant, so every header
+ * block shares one copy, built by the first constructor.
+ */
+struct crc8_tables
 {
-    int r,crc;
+    unsigned char crc[8][256];
+    unsigned char unpack[256][8];
 
-    for (int i = 0; i < 256; i++)
+    crc8_tables()
     {
-        r = i;
-        crc = 0;
-        for (int j = 7; j >= 0; j--)
+        int r, c;
+
+        for (int i = 0; i < 256; i++)
         {
-            if ((r & (1 << j) ? 1 : 0) ^ ((crc & 0x80) ? 1 : 0))
-                crc = (crc << 1) ^ CRC_POLYR;
-            else
-                crc <<= 1;
+            r = i;
+            c = 0;
+            for (int j = 7; j >= 0; j--)
+            {
+                if ((r & (1 << j) ? 1 : 0) ^ ((c & 0x80) ? 1 : 0))
+                    c = (c << 1) ^ CRC_POLYR;
+                else
+                    c <<= 1;
+            }
+            crc[0][i] = c;
+        }
+        // crc[k] is a byte followed by k zero bytes, for slicing by 8
+        for (int k = 1; k < 8; k++)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                crc[k][i] = crc[0][crc[k - 1][i]];
+            }
         }
-        crc_tab[i] = crc;
+        for (int i = 0; i < 256; i++)
+        {
+            for (int n = 0; n < 8; n++)
+            {
+                unpack[i][n] = (i >> (7 - n)) & 1;
+            }
+        }
+    }
+};
+
+void bbheader_bb_impl::build_crc8_table(void)
+{
+    static const crc8_tables tables;
+    crc_tab = tables.crc;
+    unpack_tab = tables.unpack;
+}
+
+/*
+ * CRC-8 of a block, eight bytes per step, continuing from crc.  The
+ * register is a single byte, so only the first byte of each step is
+ * combined with it.
+ */
+unsigned char bbheader_bb_impl::crc8_block(const unsigned char *in, int length, unsigned char crc)
+{
+    int n;
+
+    for (n = 0; n + 8 <= length; n += 8)
+    {
+        crc = crc_tab[7][in[n] ^ crc] ^ crc_tab[6][in[n + 1]] ^
+              crc_tab[5][in[n + 2]] ^ crc_tab[4][in[n + 3]] ^
+              crc_tab[3][in[n + 4]] ^ crc_tab[2][in[n + 5]] ^
+              crc_tab[1][in[n + 6]] ^ crc_tab[0][in[n + 7]];
+    }
+    for (; n < length; n++)
+    {
+        crc = crc_tab[0][in[n] ^ crc];
+    }
+    return crc;
+}
+
+/*
+ * Expand bytes to one bit per byte, MSB first, eight output bytes
+ * per table lookup.
+ */
+void bbheader_bb_impl::unpack_bits(unsigned char *out, const unsigned char *in, int length)
+{
+    for (int n = 0; n < length; n++)
+    {
+        memcpy(&out[n * 8], unpack_tab[in[n]], 8);
     }
 }
 
@@ -236,7 +536,11 @@ void bbheader_bb_impl::add_bbheader(unsigned char *out, int count, int padding)
             m_frame[m_frame_offset_bits++] = 0;
         }
     }
-    temp = h->upl;
+    // In high efficiency mode the ISSY field takes the UPL and SYNC fields
+    if (issy_length != 0 && input_mode == gr::dvbt2::INPUTMODE_HIEFF)
+        temp = (frame_issy[0] << 8) | frame_issy[1];
+    else
+        temp = h->upl;
     for (int n = 15; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
@@ -246,7 +550,10 @@ void bbheader_bb_impl::add_bbheader(unsigned char *out, int count, int padding)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    temp = h->sync;
+    if (issy_length != 0 && input_mode == gr::dvbt2::INPUTMODE_HIEFF)
+        temp = frame_issy[2];
+    else
+        temp = h->sync;
     for (int n = 7; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
@@ -256,7 +563,7 @@ void bbheader_bb_impl::add_bbheader(unsigned char *out, int count, int padding)
     if (temp == 0)
         temp = count;
     else
-        temp = (188 - count) * 8;
+        temp = (packet_length - count) * 8;
     for (int n = 15; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
@@ -279,17 +586,17 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    temp = 0;
+    temp = issy_length != 0 ? first_iscr : 0;
     for (int n = 21; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    temp = 0;
+    temp = issy_length != 0 ? buffer_field(bufs_bits) >> 10 : 0;
     for (int n = 1; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    temp = 0;
+    temp = issy_length != 0 ? buffer_field(bufs_bits) & 0x3ff : 0;
     for (int n = 9; n >= 0; n--)
     {
         m_frame[m_frame_offset_bits++] = temp & (1 << n) ? 1 : 0;
@@ -306,6 +613,284 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
     }
 }
 
+/*
+ * BUFS_UNIT and BUFS (or BUFSTAT) as one 12 bit field.  The smallest
+ * unit that fits the size in 10 bits is used, rounding up.
+ */
+int bbheader_bb_impl::buffer_field(int bits)
+{
+    const static int unit_code[4] = {0, 1, 3, 2};
+    const static int unit_bits[4] = {1, 1024, 8 * 1024, 1024 * 1024};
+    int u, value;
+
+    for (u = 0; u < 3; u++)
+    {
+        if ((bits + unit_bits[u] - 1) / unit_bits[u] <= 1023)
+        {
+            break;
+        }
+    }
+    value = (bits + unit_bits[u] - 1) / unit_bits[u];
+    if (value > 1023)
+    {
+        value = 1023;
+    }
+    return (unit_code[u] << 10) | value;
+}
+
+/*
+ * Build a 2 or 3 byte ISSY field (EN 302 755 Annex C).  ISCR is sent
+ * short (15 bits) or long (22 bits).  BUFS and BUFSTAT take the first
+ * two bytes of a long field.
+ */
+void bbheader_bb_impl::encode_issy(unsigned char *field, int type, unsigned int iscr)
+{
+    unsigned int value;
+    int fill;
+
+    if (type == ISSY_FIELD_ISCR)
+    {
+        if (issy_length == 2)
+            value = iscr & 0x7fff;
+        else
+            value = 0x800000 | (iscr & 0x3fffff);
+    }
+    else
+    {
+        if (type == ISSY_FIELD_BUFS)
+        {
+            value = 0xc000 | buffer_field(bufs_bits);
+        }
+        else
+        {
+            /* the previous frame drains while this one arrives */
+            fill = bufs_bits - (fec_block * (kbch - 80));
+            value = 0xe000 | buffer_field(fill > 0 ? fill : 0);
+        }
+        if (issy_length == 3)
+            value <<= 8;
+    }
+    for (int n = 0; n < issy_length; n++)
+    {
+        field[n] = (value >> ((issy_length - 1 - n) * 8)) & 0xff;
+    }
+}
+
+/*
+ * The ISCR clock runs at the TS rate, so it advances by the elementary
+ * periods that pass while bytes arrive.  The remainder is kept modulo
+ * 2^22 periods, the span of a long ISCR.
+ */
+void bbheader_bb_impl::advance_iscr(int bytes)
+{
+    iscr_acc = (iscr_acc + (bytes * iscr_step)) % (iscr_divisor << 22);
+}
+
+/*
+ * Fetch the next transport stream packet into ts_packet and return the
+ * number of input bytes used.  While locked, packets are passed on and
+ * a single corrupted sync byte is tolerated.  TS_SYNC_LOSS consecutive
+ * bad sync bytes drop the lock.  While searching, a sync byte is only
+ * accepted when TS_SYNC_LOCK sync bytes follow at packet spacing in the
+ * input.  Until then a null packet is sent in place of each packet of
+ * input, so the output rate holds.
+ */
+int bbheader_bb_impl::next_packet(const unsigned char *in, int available)
+{
+    int span = (TS_SYNC_LOCK - 1) * TS_PACKET_LENGTH;
+    int k;
+
+    if (sync_state == TS_SYNC_LOCKED)
+    {
+        if (in[0] == TS_SYNC_BYTE)
+        {
+            sync_misses = 0;
+        }
+        else
+        {
+            stats.count(sync_error_counter, 1);
+            if (++sync_misses >= TS_SYNC_LOSS)
+            {
+                sync_state = TS_SYNC_SEARCH;
+                stats.count(sync_loss_counter, 1);
+                report_sync("Transport Stream sync lost!");
+            }
+        }
+        if (sync_state == TS_SYNC_LOCKED)
+        {
+            memcpy(ts_packet, in, TS_PACKET_LENGTH);
+            return TS_PACKET_LENGTH;
+        }
+    }
+    for (int p = 0; p < TS_PACKET_LENGTH && p + span < available; p++)
+    {
+        for (k = 0; k < TS_SYNC_LOCK; k++)
+        {
+            if (in[p + (k * TS_PACKET_LENGTH)] != TS_SYNC_BYTE)
+            {
+                break;
+            }
+        }
+        if (k == TS_SYNC_LOCK)
+        {
+            sync_state = TS_SYNC_LOCKED;
+            sync_misses = 0;
+            report_sync("Transport Stream sync acquired.");
+            memcpy(ts_packet, &in[p], TS_PACKET_LENGTH);
+            return p + TS_PACKET_LENGTH;
+        }
+    }
+    memcpy(ts_packet, null_packet, TS_PACKET_LENGTH);
+    stats.count(null_packet_counter, 1);
+    return available < TS_PACKET_LENGTH ? available : TS_PACKET_LENGTH;
+}
+
+/*
+ * At most one message per second, so a flapping input cannot flood
+ * the console.
+ */
+void bbheader_bb_impl::report_sync(const char *message)
+{
+    time_t now = time(NULL);
+
+    if (now == report_time)
+    {
+        reports_suppressed++;
+        return;
+    }
+    if (reports_suppressed)
+    {
+        printf("%s (%d sync messages suppressed)\n", message, reports_suppressed);
+    }
+    else
+    {
+        printf("%s\n", message);
+    }
+    report_time = now;
+    reports_suppressed = 0;
+}
+
+/*
+ * Null Packet Deletion.  Null packets (PID 0x1FFF) ahead of a user
+ * packet are dropped and counted; the count is sent in the DNP byte
+ * after that user packet.  A null packet is kept when the counter is
+ * full, or when the input beyond this frame's needs (delete_budget)
+ * is used up, so deletion can never stall the output.
+ *
+ * With ISSY, the field for the packet is built from the ISCR at its
+ * arrival.  The first packet started in the first two BBFRAMEs of each
+ * frame carries BUFS and BUFSTAT instead.  In normal mode the field
+ * follows the packet, in high efficiency mode the field of the first
+ * packet goes into the BBHEADER.
+ */
+int bbheader_bb_impl::next_user_packet(const unsigned char *in, int available)
+{
+    unsigned char field[3] = {0, 0, 0};
+    int type = ISSY_FIELD_ISCR;
+    unsigned int iscr;
+    int start = 0;
+    int used = next_packet(in, available);
+
+    if (npd_mode == gr::dvbt2::NPD_ON)
+    {
+        while (deleted_nulls < DNP_MAX && delete_budget > 0 &&
+               (((ts_packet[1] & 0x1f) << 8) | ts_packet[2]) == TS_NULL_PID)
+        {
+            deleted_nulls++;
+            delete_budget--;
+            stats.count(deleted_null_counter, 1);
+            start = used;
+            used += next_packet(&in[used], available - used);
+        }
+        packet_trailer[packet_length - TS_PACKET_LENGTH - 1] = deleted_nulls;
+        deleted_nulls = 0;
+    }
+    if (issy_length != 0)
+    {
+        advance_iscr(start);
+        iscr = (unsigned int)(iscr_acc / iscr_divisor);
+        advance_iscr(used - start);
+        if (frame_first == TRUE)
+        {
+            if (fec_block == 0)
+            {
+                type = ISSY_FIELD_BUFS;
+                first_iscr = iscr;
+            }
+            else if (fec_block == 1)
+            {
+                type = ISSY_FIELD_BUFSTAT;
+            }
+        }
+        encode_issy(field, type, iscr);
+        if (input_mode == gr::dvbt2::INPUTMODE_NORMAL)
+        {
+            memcpy(packet_trailer, field, issy_length);
+        }
+        else if (frame_first == TRUE)
+        {
+            memcpy(frame_issy, field, sizeof(frame_issy));
+        }
+        frame_first = FALSE;
+    }
+    return used;
+}
+
+/*
+ * Generic stream input.  A continuous stream fills the data field byte
+ * for byte.  GSE packets are packed whole, and the data field ends
+ * before the first packet that does not fit; the rest of the BBFRAME
+ * is padding.  Idle bytes (a zero GSE start nibble) between packets
+ * are skipped, and packets too long for any BBFRAME are dropped.
+ * Returns the input bytes used, and the data field bytes in *length.
+ */
+int bbheader_bb_impl::add_generic(unsigned char *out, const unsigned char *in, int available, int space, int *length)
+{
+    int used = 0;
+    int total = 0;
+    int largest = (kbch - 80) / 8;
+    int packet;
+
+    /* with a single FEC block every BBFRAME carries the in-band signalling */
+    if (fec_blocks == 1 && inband_type_b == TRUE)
+    {
+        largest = (kbch - 80 - 104) / 8;
+    }
+    if (payload_type == gr::dvbt2::PAYLOAD_GCS)
+    {
+        unpack_bits(out, in, space);
+        used = total = space;
+    }
+    else
+    {
+        /* the caller holds space + GSE_PACKET_MAX bytes of input */
+        while (used < space && used + 2 <= available)
+        {
+            if ((in[used] & 0xf0) == 0)
+            {
+                used++;
+                continue;
+            }
+            packet = (((in[used] & 0x0f) << 8) | in[used + 1]) + 2;
+            if (packet > largest)
+            {
+                stats.count(dropped_packet_counter, 1);
+                used += packet;
+                continue;
+            }
+            if (total + packet > space)
+            {
+                break;
+            }
+            unpack_bits(&out[total * 8], &in[used], packet);
+            total += packet;
+            used += packet;
+        }
+    }
+    *length = total;
+    return used;
+}
+
     int
     bbheader_bb_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
@@ -317,10 +902,35 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
         int consumed = 0;
         int offset = 0;
         int padding;
-        unsigned char b;
+        int header, header_count;
+        int length, unused;
+        int remaining, run;
+        const unsigned char *src;
+        stats.begin();
 
-        for (int i = 0; i < noutput_items; i += kbch)
+        int produced = 0;
+        int frame_input;
+
+        for (;;)
         {
+            if (produced + (int)kbch > noutput_items)
+            {
+                break;
+            }
+            frame_input = (frame_packets + TS_SYNC_LOCK) * TS_PACKET_LENGTH;
+            if (payload_type == gr::dvbt2::PAYLOAD_GCS)
+            {
+                frame_input = (kbch - 80) / 8;
+            }
+            else if (payload_type == gr::dvbt2::PAYLOAD_GSE)
+            {
+                frame_input = ((kbch - 80) / 8) + GSE_PACKET_MAX;
+            }
+            if (ninput_items[0] - consumed < frame_input)
+            {
+                break;
+            }
+            delete_budget = ((ninput_items[0] - consumed - frame_input) / TS_PACKET_LENGTH) - TS_SYNC_LOCK;
             if (fec_block == 0 && inband_type_b == TRUE)
             {
                 padding = 104;
@@ -329,64 +939,75 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
             {
                 padding = 0;
             }
-            add_bbheader(&out[offset], count, padding);
+            add_item_tag(0, nitems_written(0) + produced, fecframe_key, pmt::from_uint64(fecframe_count++));
+            if (pmt::is_dict(modcod_tag))
+            {
+                add_item_tag(0, nitems_written(0) + produced, modcod_key, modcod_tag);
+                modcod_tag = pmt::PMT_NIL;
+            }
+            if (pmt::is_dict(announce_tag))
+            {
+                add_item_tag(0, nitems_written(0) + produced, modcod_announce_key, announce_tag);
+                announce_tag = pmt::PMT_NIL;
+            }
+            /* the header is filled in last, once the ISSY field is known */
+            header = offset;
+            header_count = count;
+            frame_first = TRUE;
             offset = offset + 80;
 
-            if (input_mode == gr::dvbt2::INPUTMODE_HIEFF)
+            if (payload_type != gr::dvbt2::PAYLOAD_TS)
             {
-                for (int j = 0; j < (int)((kbch - 80 - padding) / 8); j++)
-                {
-                    if (count == 0)
-                    {
-                        if (*in != 0x47)
-                        {
-                            printf("Transport Stream sync error!\n");
-                        }
-                        j--;
-                        in++;
-                    }
-                    else
-                    {
-                        b = *in++;
-                        for (int n = 7; n >= 0; n--)
-                        {
-                            out[offset++] = b & (1 << n) ? 1 : 0;
-                        }
-                    }
-                    count = (count + 1) % 188;
-                    consumed++;
-                }
+                consumed += add_generic(&out[offset], &in[consumed], ninput_items[0] - consumed, (kbch - 80 - padding) / 8, &length);
+                offset = offset + (length * 8);
+                unused = kbch - 80 - padding - (length * 8);
                 if (fec_block == 0 && inband_type_b == TRUE)
                 {
                     add_inband_type_b(&out[offset], ts_rate);
                     offset = offset + 104;
                 }
+                memset(&out[offset], 0, unused);
+                offset = offset + unused;
+                padding += unused;
             }
             else
             {
-                for (int j = 0; j < (int)((kbch - 80 - padding) / 8); j++)
+                /* whole runs of packet bytes at a time */
+                remaining = (kbch - 80 - padding) / 8;
+                while (remaining > 0)
                 {
                     if (count == 0)
                     {
-                        if (*in != 0x47)
+                        consumed += next_user_packet(&in[consumed], ninput_items[0] - consumed);
+                        if (input_mode == gr::dvbt2::INPUTMODE_HIEFF)
                         {
-                            printf("Transport Stream sync error!\n");
+                            count = 1;
+                            continue;
                         }
-                        in++;
-                        b = crc;
-                        crc = 0;
+                        // CRC-8 of the previous packet replaces the sync byte,
+                        // it covers the ISSY and DNP fields as well
+                        ts_packet[0] = crc;
+                        crc = crc8_block(&ts_packet[1], TS_PACKET_LENGTH - 1, 0);
+                        crc = crc8_block(packet_trailer, packet_length - TS_PACKET_LENGTH, crc);
+                    }
+                    if (count < TS_PACKET_LENGTH)
+                    {
+                        run = TS_PACKET_LENGTH - count;
+                        src = &ts_packet[count];
                     }
                     else
                     {
-                        b = *in++;
-                        crc = crc_tab[b ^ crc];
+                        run = packet_length - count;
+                        src = &packet_trailer[count - TS_PACKET_LENGTH];
                     }
-                    count = (count + 1) % 188;
-                    consumed++;
-                    for (int n = 7; n >= 0; n--)
+                    if (run > remaining)
                     {
-                        out[offset++] = b & (1 << n) ? 1 : 0;
+                        run = remaining;
                     }
+                    unpack_bits(&out[offset], src, run);
+                    offset = offset + (run * 8);
+                    remaining -= run;
+                    count = (count + run) % packet_length;
                 }
                 if (fec_block == 0 && inband_type_b == TRUE)
                 {
@@ -394,9 +1015,16 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
                     offset = offset + 104;
                 }
             }
-            if (inband_type_b == TRUE)
+            add_bbheader(&out[header], header_count, padding);
+            fec_block = (fec_block + 1) % fec_blocks;
+            produced += kbch;
+            if (superframe_blocks != 0)
             {
-                fec_block = (fec_block + 1) % fec_blocks;
+                superframe_block = (superframe_block + 1) % superframe_blocks;
+                if (superframe_block == 0)
+                {
+                    superframe_start();
+                }
             }
         }
 
@@ -404,8 +1032,10 @@ void bbheader_bb_impl::add_inband_type_b(unsigned char *out, int ts_rate)
         // each input stream.
         consume_each (consumed);
 
+        stats.end(produced);
+
         // Tell runtime system how many output items we produced.
-        return noutput_items;
+        return produced;
     }
 
   } /* namespace dvbt2 */
@@ -22,6 +22,26 @@
 #define INCLUDED_DVBT2_BBHEADER_BB_IMPL_H
 
 #include <dvbt2/bbheader_bb.h>
+#include "block_stats.h"
+#include <time.h>
+
+#define TS_PACKET_LENGTH 188
+#define TS_SYNC_BYTE 0x47
+#define TS_SYNC_LOCK 5
+#define TS_SYNC_LOSS 2
+
+#define TS_NULL_PID 0x1fff
+#define DNP_MAX 255
+
+#define GSE_PACKET_MAX (4095 + 2)
+
+#define ISSY_FIELD_ISCR 0
+#define ISSY_FIELD_BUFS 1
+#define ISSY_FIELD_BUFSTAT 2
+#define ISSY_BUFS_MAX (2 * 1024 * 1024)
+
+#define TS_SYNC_SEARCH 0
+#define TS_SYNC_LOCKED 1
 
 typedef struct{
     int ts_gs;
@@ -47,25 +67,77 @@ namespace gr {
     class bbheader_bb_impl : public bbheader_bb
     {
      private:
+      unsigned int frame_size;
       unsigned int kbch;
       unsigned int count;
       unsigned char crc;
       unsigned int input_mode;
-      unsigned int extra;
+      int payload_type;
+      unsigned int frame_packets;
+      unsigned int packet_length;
+      int npd_mode;
+      int deleted_nulls;
+      int delete_budget;
+      unsigned char packet_trailer[4];
+      int issy_length;
+      int frame_first;
+      unsigned char frame_issy[3];
+      unsigned int first_iscr;
+      int bufs_bits;
+      uint64_t iscr_acc;
+      uint64_t iscr_step;
+      uint64_t iscr_divisor;
+      int sync_state;
+      int sync_misses;
+      time_t report_time;
+      int reports_suppressed;
+      unsigned char ts_packet[TS_PACKET_LENGTH];
+      unsigned char null_packet[TS_PACKET_LENGTH];
       int inband_type_b;
       int fec_blocks;
       int fec_block;
+      int superframe_blocks;
+      int superframe_block;
+      int data_cells;
       int ts_rate;
+      uint64_t fecframe_count;
+      pmt::pmt_t fecframe_key;
+      pmt::pmt_t modcod_key;
+      pmt::pmt_t modcod_announce_key;
+      pmt::pmt_t modcod_pending;
+      pmt::pmt_t modcod_announced;
+      pmt::pmt_t modcod_tag;
+      pmt::pmt_t announce_tag;
       FrameFormat m_format[1];
-      unsigned char crc_tab[256];
+      const unsigned char (*crc_tab)[256];
+      const unsigned char (*unpack_tab)[8];
+      void set_rate(int);
+      void handle_modcod(pmt::pmt_t);
+      void superframe_start(void);
       void add_bbheader(unsigned char *, int, int);
       void build_crc8_table(void);
       int add_crc8_bits(unsigned char *, int);
+      unsigned char crc8_block(const unsigned char *, int, unsigned char);
+      void unpack_bits(unsigned char *, const unsigned char *, int);
       void add_inband_type_b(unsigned char *, int);
+      int buffer_field(int);
+      void encode_issy(unsigned char *, int, unsigned int);
+      void advance_iscr(int);
+      int next_packet(const unsigned char *, int);
+      int next_user_packet(const unsigned char *, int);
+      int add_generic(unsigned char *, const unsigned char *, int, int, int *);
+      void report_sync(const char *);
 
+      block_stats stats;
+      int sync_error_counter;
+      int sync_loss_counter;
+      int null_packet_counter;
+      int deleted_null_counter;
+      int dropped_packet_counter;
      public:
-      bbheader_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate);
+      bbheader_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_inputmode_t mode, dvbt2_inband_t inband, int fecblocks, int tsrate, dvbt2_npd_t npd, dvbt2_issy_t issy, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype, int t2frames, int datacells);
       ~bbheader_bb_impl();
+      bool start();
 
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
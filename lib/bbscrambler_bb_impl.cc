@@ -43,64 +43,13 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(unsigned char)),
               gr::io_signature::make(1, 1, sizeof(unsigned char)))
     {
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                case gr::dvbt2::C2_5:
-                case gr::dvbt2::C1_2:
-                    kbch = 32208;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 38688;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 43040;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 48408;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 51648;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 53840;
-                    break;
-            }
-        }
-        else
-        {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                    kbch = 5232;
-                    break;
-                case gr::dvbt2::C2_5:
-                    kbch = 6312;
-                    break;
-                case gr::dvbt2::C1_2:
-                    kbch = 7032;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 9552;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 10632;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 11712;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 12432;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 13152;
-                    break;
-            }
-        }
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        set_rate(rate);
         init_bb_randomiser();
-        set_output_multiple(kbch);
+        modcod_key = pmt::string_to_symbol("modcod");
+        /* sizes the buffers for a BBFRAME of any code rate, see start() */
+        set_output_multiple(frame_size == FRAME_SIZE_NORMAL ? KBCH_MAX_NORMAL : KBCH_MAX_SHORT);
+        stats.attach(this, kbch, 1);
     }
 
     /*
@@ -110,16 +59,139 @@ namespace gr {
     {
     }
 
-void bbscrambler_bb_impl::init_bb_randomiser(void)
+    /* buffers are allocated by now, run with the current BBFRAME size */
+    bool
+    bbscrambler_bb_impl::start()
+    {
+        set_output_multiple(kbch);
+        return true;
+    }
+
+void bbscrambler_bb_impl::set_rate(int rate)
 {
-    int sr = 0x4A80;
-    for (int i = 0; i < FRAME_SIZE_NORMAL; i++)
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                kbch = 32208;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 38688;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 43040;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 48408;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 51648;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 53840;
+                break;
+        }
+    }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                kbch = 5232;
+                break;
+            case gr::dvbt2::C2_5:
+                kbch = 6312;
+                break;
+            case gr::dvbt2::C1_2:
+                kbch = 7032;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 9552;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 10632;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 11712;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 12432;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 13152;
+                break;
+        }
+    }
+}
+
+void bbscrambler_bb_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+
+    if (pmt::dict_has_key(modcod, rate_key))
     {
-        int b = ((sr) ^ (sr >> 1)) & 1;
-        bb_randomise[i] = b;
-        sr >>= 1;
-        if(b) sr |= 0x4000;
+        set_rate(pmt::to_long(pmt::dict_ref(modcod, rate_key, pmt::PMT_NIL)));
     }
+    set_output_multiple(kbch);
+    stats.set_frame_items(kbch);
+}
+
+/*
+ * Runtime modcod change.  A "modcod" tag on the first item of a BBFRAME
+ * switches the block from there on.  A change at the start of the
+ * input is applied, and the number of items before the next change is
+ * returned, so each call runs a single modcod.
+ */
+int bbscrambler_bb_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
+}
+
+/*
+ * The randomiser sequence does not depend on the configuration, so a
+ * single copy is built the first time a scrambler is made and every
+ * instance points at it.
+ */
+struct bb_randomiser_table
+{
+    unsigned char sequence[FRAME_SIZE_NORMAL];
+
+    bb_randomiser_table()
+    {
+        int sr = 0x4A80;
+        for (int i = 0; i < FRAME_SIZE_NORMAL; i++)
+        {
+            int b = ((sr) ^ (sr >> 1)) & 1;
+            sequence[i] = b;
+            sr >>= 1;
+            if(b) sr |= 0x4000;
+        }
+    }
+};
+
+void bbscrambler_bb_impl::init_bb_randomiser(void)
+{
+    static const bb_randomiser_table table;
+    bb_randomise = table.sequence;
 }
 
     int
@@ -129,6 +201,10 @@ void bbscrambler_bb_impl::init_bb_randomiser(void)
     {
         const unsigned char *in = (const unsigned char *) input_items[0];
         unsigned char *out = (unsigned char *) output_items[0];
+        stats.begin();
+
+        noutput_items = modcod_run(noutput_items);
+        noutput_items = (noutput_items / kbch) * kbch;
 
         for (int i = 0; i < noutput_items; i += kbch)
         {
@@ -138,6 +214,8 @@ void bbscrambler_bb_impl::init_bb_randomiser(void)
             }
         }
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
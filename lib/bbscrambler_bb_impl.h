@@ -22,6 +22,7 @@
 #define INCLUDED_DVBT2_BBSCRAMBLER_BB_IMPL_H
 
 #include <dvbt2/bbscrambler_bb.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
@@ -29,13 +30,20 @@ namespace gr {
     class bbscrambler_bb_impl : public bbscrambler_bb
     {
      private:
+      unsigned int frame_size;
       unsigned int kbch;
-      unsigned char bb_randomise[FRAME_SIZE_NORMAL];
+      const unsigned char *bb_randomise;
+      pmt::pmt_t modcod_key;
+      void set_rate(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
       void init_bb_randomiser(void);
 
+      block_stats stats;
      public:
       bbscrambler_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate);
       ~bbscrambler_bb_impl();
+      bool start();
 
       // Where all the action really happens
       int work(int noutput_items,
@@ -43,92 +43,14 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(unsigned char)),
               gr::io_signature::make(1, 1, sizeof(unsigned char)))
     {
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                case gr::dvbt2::C2_5:
-                case gr::dvbt2::C1_2:
-                    kbch = 32208;
-                    nbch = 32400;
-                    bch_code = BCH_CODE_N12;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 38688;
-                    nbch = 38880;
-                    bch_code = BCH_CODE_N12;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 43040;
-                    nbch = 43200;
-                    bch_code = BCH_CODE_N10;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 48408;
-                    nbch = 48600;
-                    bch_code = BCH_CODE_N12;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 51648;
-                    nbch = 51840;
-                    bch_code = BCH_CODE_N12;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 53840;
-                    nbch = 54000;
-                    bch_code = BCH_CODE_N10;
-                    break;
-            }
-        }
-        else
-        {
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                    kbch = 5232;
-                    nbch = 5400;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C2_5:
-                    kbch = 6312;
-                    nbch = 6480;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C1_2:
-                    kbch = 7032;
-                    nbch = 7200;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C3_5:
-                    kbch = 9552;
-                    nbch = 9720;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C2_3:
-                    kbch = 10632;
-                    nbch = 10800;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C3_4:
-                    kbch = 11712;
-                    nbch = 11880;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C4_5:
-                    kbch = 12432;
-                    nbch = 12600;
-                    bch_code = BCH_CODE_S12;
-                    break;
-                case gr::dvbt2::C5_6:
-                    kbch = 13152;
-                    nbch = 13320;
-                    bch_code = BCH_CODE_S12;
-                    break;
-            }
-        }
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        set_rate(rate);
         bch_poly_build_tables();
-        set_output_multiple(nbch);
+        set_tag_propagation_policy(TPP_DONT);
+        modcod_key = pmt::string_to_symbol("modcod");
+        /* sizes the buffers for a codeword of any code rate, see start() */
+        set_output_multiple(frame_size == FRAME_SIZE_NORMAL ? NBCH_MAX_NORMAL : NBCH_MAX_SHORT);
+        stats.attach(this, nbch, 1);
     }
 
     /*
@@ -138,6 +60,14 @@ namespace gr {
     {
     }
 
+    /* buffers are allocated by now, run with the current codeword size */
+    bool
+    bch_bb_impl::start()
+    {
+        set_output_multiple(nbch);
+        return true;
+    }
+
     void
     bch_bb_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
@@ -204,38 +134,79 @@ void bch_bb_impl::poly_reverse(int *pin, int *pout, int len)
     }
 }
 //
-// Shift a 128 bit register
+// Shift a register of WORDS 32 bit words
 //
-inline void bch_bb_impl::reg_4_shift(unsigned int *sr)
+template <int WORDS>
+static inline void
+reg_shift(unsigned int *sr)
 {
-    sr[3] = (sr[3] >> 1) | (sr[2] << 31);
-    sr[2] = (sr[2] >> 1) | (sr[1] << 31);
-    sr[1] = (sr[1] >> 1) | (sr[0] << 31);
+    for (int w = WORDS - 1; w > 0; w--)
+    {
+        sr[w] = (sr[w] >> 1) | (sr[w - 1] << 31);
+    }
     sr[0] = (sr[0] >> 1);
 }
+
 //
-// Shift 160 bits
+// Encode one BBFRAME.  KBCH, the register length and the number of
+// parity bits are template arguments, so every loop has a fixed trip
+// count.  TOP is the register bit fed back, the short frame code is
+// 168 bits and sits 24 bits into the last word.
 //
-inline void bch_bb_impl::reg_5_shift(unsigned int *sr)
+template <int KBCH, int WORDS, int PARITY, unsigned int TOP>
+static void
+bch_encode(const unsigned char *in, unsigned char *out, const unsigned int *poly)
 {
-    sr[4] = (sr[4] >> 1) | (sr[3] << 31);
-    sr[3] = (sr[3] >> 1) | (sr[2] << 31);
-    sr[2] = (sr[2] >> 1) | (sr[1] << 31);
-    sr[1] = (sr[1] >> 1) | (sr[0] << 31);
-    sr[0] = (sr[0] >> 1);
+    unsigned int shift[WORDS];
+    unsigned int mask;
+
+    for (int w = 0; w < WORDS; w++)
+    {
+        shift[w] = 0;
+    }
+    // MSB of the codeword first
+    for (int j = 0; j < KBCH; j++)
+    {
+        out[j] = in[j];
+        mask = -(unsigned int)(in[j] ^ ((shift[WORDS - 1] & TOP) ? 1 : 0));
+        reg_shift<WORDS>(shift);
+        for (int w = 0; w < WORDS; w++)
+        {
+            shift[w] ^= poly[w] & mask;
+        }
+    }
+    // Now add the parity bits to the output
+    for (int n = 0; n < PARITY; n++)
+    {
+        out[KBCH + n] = (shift[WORDS - 1] & TOP) ? 1 : 0;
+        reg_shift<WORDS>(shift);
+    }
 }
-//
-// Shift 192 bits
-//
-inline void bch_bb_impl::reg_6_shift(unsigned int *sr)
+
+// Indexed by code rate, C1_3 and C2_5 don't exist for normal frames.
+static const bch_bb_impl::bch_kernel_t bch_kernels_normal[8] =
 {
-    sr[5] = (sr[5] >> 1) | (sr[4] << 31);
-    sr[4] = (sr[4] >> 1) | (sr[3] << 31);
-    sr[3] = (sr[3] >> 1) | (sr[2] << 31);
-    sr[2] = (sr[2] >> 1) | (sr[1] << 31);
-    sr[1] = (sr[1] >> 1) | (sr[0] << 31);
-    sr[0] = (sr[0] >> 1);
-}
+    bch_encode<32208, 6, 192, 1>,
+    bch_encode<38688, 6, 192, 1>,
+    bch_encode<43040, 5, 160, 1>,
+    bch_encode<48408, 6, 192, 1>,
+    bch_encode<51648, 6, 192, 1>,
+    bch_encode<53840, 5, 160, 1>,
+    bch_encode<32208, 6, 192, 1>,
+    bch_encode<32208, 6, 192, 1>
+};
+
+static const bch_bb_impl::bch_kernel_t bch_kernels_short[8] =
+{
+    bch_encode<7032, 6, 168, 0x01000000>,
+    bch_encode<9552, 6, 168, 0x01000000>,
+    bch_encode<10632, 6, 168, 0x01000000>,
+    bch_encode<11712, 6, 168, 0x01000000>,
+    bch_encode<12432, 6, 168, 0x01000000>,
+    bch_encode<13152, 6, 168, 0x01000000>,
+    bch_encode<5232, 6, 168, 0x01000000>,
+    bch_encode<6312, 6, 168, 0x01000000>
+};
 
 void bch_bb_impl::bch_poly_build_tables(void)
 {
@@ -301,6 +272,152 @@ void bch_bb_impl::bch_poly_build_tables(void)
     poly_pack(polyout[0], m_poly_s_12, 168);
 }
 
+void bch_bb_impl::set_rate(int rate)
+{
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                kbch = 32208;
+                nbch = 32400;
+                bch_code = BCH_CODE_N12;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 38688;
+                nbch = 38880;
+                bch_code = BCH_CODE_N12;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 43040;
+                nbch = 43200;
+                bch_code = BCH_CODE_N10;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 48408;
+                nbch = 48600;
+                bch_code = BCH_CODE_N12;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 51648;
+                nbch = 51840;
+                bch_code = BCH_CODE_N12;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 53840;
+                nbch = 54000;
+                bch_code = BCH_CODE_N10;
+                break;
+        }
+    }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                kbch = 5232;
+                nbch = 5400;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C2_5:
+                kbch = 6312;
+                nbch = 6480;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C1_2:
+                kbch = 7032;
+                nbch = 7200;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 9552;
+                nbch = 9720;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 10632;
+                nbch = 10800;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 11712;
+                nbch = 11880;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 12432;
+                nbch = 12600;
+                bch_code = BCH_CODE_S12;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 13152;
+                nbch = 13320;
+                bch_code = BCH_CODE_S12;
+                break;
+        }
+    }
+    switch (bch_code)
+    {
+        case BCH_CODE_N12:
+            bch_poly = m_poly_n_12;
+            break;
+        case BCH_CODE_N10:
+            bch_poly = m_poly_n_10;
+            break;
+        case BCH_CODE_S12:
+            bch_poly = m_poly_s_12;
+            break;
+    }
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        bch_kernel = bch_kernels_normal[rate];
+    }
+    else
+    {
+        bch_kernel = bch_kernels_short[rate];
+    }
+}
+
+void bch_bb_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+
+    if (pmt::dict_has_key(modcod, rate_key))
+    {
+        set_rate(pmt::to_long(pmt::dict_ref(modcod, rate_key, pmt::PMT_NIL)));
+    }
+    set_output_multiple(nbch);
+    stats.set_frame_items(nbch);
+}
+
+/*
+ * Code rate changes follow "modcod" tags on the first bit of a BBFRAME.
+ * A change at the start of the input is applied here; the items before
+ * the next change are returned, so one call never mixes code rates.
+ */
+int bch_bb_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
+}
+
     int
     bch_bb_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
@@ -309,139 +426,44 @@ void bch_bb_impl::bch_poly_build_tables(void)
     {
         const unsigned char *in = (const unsigned char *) input_items[0];
         unsigned char *out = (unsigned char *) output_items[0];
-        unsigned char b, temp;
-        unsigned int shift[6];
         int consumed = 0;
+        stats.begin();
 
-        switch (bch_code)
+        int available = modcod_run(ninput_items[0]);
+        int frames = noutput_items / nbch;
+        if (frames > (int)(available / kbch))
         {
-            case BCH_CODE_N12:
-                for (int i = 0; i < noutput_items; i += nbch)
-                {
-                    //Zero the shift register
-                    memset(shift, 0, sizeof(unsigned int) * 6);
-                    // MSB of the codeword first
-                    for (int j = 0; j < (int)kbch; j++)
-                    {
-                        temp = *in++;
-                        *out++ = temp;
-                        consumed++;
-                        b = (temp ^ (shift[5] & 1));
-                        reg_6_shift(shift);
-                        if (b)
-                        {
-                            shift[0] ^= m_poly_n_12[0];
-                            shift[1] ^= m_poly_n_12[1];
-                            shift[2] ^= m_poly_n_12[2];
-                            shift[3] ^= m_poly_n_12[3];
-                            shift[4] ^= m_poly_n_12[4];
-                            shift[5] ^= m_poly_n_12[5];
-                        }
-                    }
-                    // Now add the parity bits to the output
-                    for (int n = 0; n < 192; n++)
-                    {
-                        *out++ = (shift[5] & 1);
-                        reg_6_shift(shift);
-                    }
-                }
-                break;
-            case BCH_CODE_N10:
-                for (int i = 0; i < noutput_items; i += nbch)
-                {
-                    //Zero the shift register
-                    memset(shift, 0, sizeof(unsigned int) * 5);
-                    // MSB of the codeword first
-                    for (int j = 0; j < (int)kbch; j++)
-                    {
-                        temp = *in++;
-                        *out++ = temp;
-                        consumed++;
-                        b = (temp ^ (shift[4] & 1));
-                        reg_5_shift(shift);
-                        if (b)
-                        {
-                            shift[0] ^= m_poly_n_10[0];
-                            shift[1] ^= m_poly_n_10[1];
-                            shift[2] ^= m_poly_n_10[2];
-                            shift[3] ^= m_poly_n_10[3];
-                            shift[4] ^= m_poly_n_10[4];
-                        }
-                    }
-                    // Now add the parity bits to the output
-                    for( int n = 0; n < 160; n++ )
-                    {
-                        *out++ = (shift[4] & 1);
-                        reg_5_shift(shift);
-                    }
-                }
-                break;
-            case BCH_CODE_N8:
-                for (int i = 0; i < noutput_items; i += nbch)
-                {
-                    //Zero the shift register
-                    memset(shift, 0, sizeof(unsigned int) * 4);
-                    // MSB of the codeword first
-                    for (int j = 0; j < (int)kbch; j++)
-                    {
-                        temp = *in++;
-                        *out++ = temp;
-                        consumed++;
-                        b = temp ^ (shift[3] & 1);
-                        reg_4_shift(shift);
-                        if (b)
-                        {
-                            shift[0] ^= m_poly_n_8[0];
-                            shift[1] ^= m_poly_n_8[1];
-                            shift[2] ^= m_poly_n_8[2];
-                            shift[3] ^= m_poly_n_8[3];
-                        }
-                    }
-                    // Now add the parity bits to the output
-                    for (int n = 0; n < 128; n++)
-                    {
-                        *out++ = shift[3] & 1;
-                        reg_4_shift(shift);
-                    }
-                }
-                break;
-            case BCH_CODE_S12:
-                for (int i = 0; i < noutput_items; i += nbch)
-                {
-                    //Zero the shift register
-                    memset(shift, 0, sizeof(unsigned int) * 6);
-                    // MSB of the codeword first
-                    for (int j = 0; j < (int)kbch; j++)
-                    {
-                        temp = *in++;
-                        *out++ = temp;
-                        consumed++;
-                        b = (temp ^ ((shift[5] & 0x01000000) ? 1 : 0));
-                        reg_6_shift(shift);
-                        if (b)
-                        {
-                            shift[0] ^= m_poly_s_12[0];
-                            shift[1] ^= m_poly_s_12[1];
-                            shift[2] ^= m_poly_s_12[2];
-                            shift[3] ^= m_poly_s_12[3];
-                            shift[4] ^= m_poly_s_12[4];
-                            shift[5] ^= m_poly_s_12[5];
-                        }
-                    }
-                    // Now add the parity bits to the output
-                    for (int n = 0; n < 168; n++)
-                    {
-                        *out++ = (shift[5] & 0x01000000) ? 1 : 0;
-                        reg_6_shift(shift);
-                    }
-                }
-                break;
+            frames = available / kbch;
+        }
+        noutput_items = frames * nbch;
+
+        for (int i = 0; i < noutput_items; i += nbch)
+        {
+            bch_kernel(in, out, bch_poly);
+            in += kbch;
+            out += nbch;
+            consumed += kbch;
+        }
+
+        std::vector<tag_t> tags;
+        const uint64_t nread = nitems_read(0);
+        const uint64_t nwritten = nitems_written(0);
+        uint64_t rel;
+
+        // Map FEC frame tags onto the output frame with the same index.
+        get_tags_in_range(tags, 0, nread, nread + consumed);
+        for (unsigned int t = 0; t < tags.size(); t++)
+        {
+            rel = tags[t].offset - nread;
+            add_item_tag(0, nwritten + ((rel / kbch) * nbch) + (rel % kbch), tags[t].key, tags[t].value, tags[t].srcid);
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
         consume_each (consumed);
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
@@ -22,13 +22,18 @@
 #define INCLUDED_DVBT2_BCH_BB_IMPL_H
 
 #include <dvbt2/bch_bb.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
 
     class bch_bb_impl : public bch_bb
     {
+     public:
+      typedef void (*bch_kernel_t)(const unsigned char *, unsigned char *, const unsigned int *);
+
      private:
+      unsigned int frame_size;
       unsigned int kbch;
       unsigned int nbch;
       unsigned int bch_code;
@@ -39,14 +44,19 @@ namespace gr {
       int poly_mult(const int*, int, const int*, int, int*);
       void poly_pack(const int*, unsigned int*, int);
       void poly_reverse(int*, int*, int);
-      inline void reg_4_shift(unsigned int*);
-      inline void reg_5_shift(unsigned int*);
-      inline void reg_6_shift(unsigned int*);
       void bch_poly_build_tables(void);
+      const unsigned int *bch_poly;
+      bch_kernel_t bch_kernel;
+      pmt::pmt_t modcod_key;
+      void set_rate(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
 
+      block_stats stats;
      public:
       bch_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate);
       ~bch_bb_impl();
+      bool start();
 
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
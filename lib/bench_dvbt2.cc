@@ -0,0 +1,293 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * bench_dvbt2: per block and end to end benchmarks for the reference
+ * configurations in apps/vv*.
+ *
+ * For every configuration the chain is first run once with a vector
+ * sink on each stage output, so every block is later timed in isolation
+ * on genuine input (including stream tags) from a vector source into a
+ * null sink.  Times are normalized per TS bit, per cell or per sample.
+ * The complete chain is then timed from the TS source to the IQ output.
+ * Results are written as JSON.
+ *
+ * With -b the best chain rate of each configuration is checked against
+ * a baseline file of "config msps" lines, and bench_dvbt2 exits with 2
+ * when one is more than the -t tolerance slower or has no baseline.
+ * The file is only written when -w is given as well.  Without -w a
+ * missing file exits with 77, which the bench_dvbt2 test reports as
+ * skipped until the machine has a baseline.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vv_chain.h"
+#include <gnuradio/blocks/vector_source_b.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace gr::dvbt2;
+
+/* time one block from a vector source into a null sink, best of repeat */
+static void
+bench_stage(FILE *out, const vv_config &c, int stage, const capture &in, int repeat, bool last)
+{
+  const stage_info &info = stage_infos[stage];
+  int vlen_in = stage_vlen_in(c, stage);
+  int vlen_out = stage_vlen_out(c, stage);
+  double best = 0.0;
+  double units = 0.0;
+
+  for (int r = 0; r < repeat; r++) {
+    gr::top_block_sptr tb = gr::make_top_block("bench_dvbt2_stage");
+    gr::basic_block_sptr src = make_source(in, info.complex_in, vlen_in);
+    gr::basic_block_sptr block = make_stage(c, stage);
+    size_t itemsize = (info.complex_out ? sizeof(gr_complex) : sizeof(unsigned char)) * vlen_out;
+    tb->connect(src, 0, block, 0);
+    tb->connect(block, 0, gr::blocks::null_sink::make(itemsize), 0);
+
+    double start = now();
+    tb->run();
+    double elapsed = now() - start;
+    if (r == 0 || elapsed < best) {
+      best = elapsed;
+    }
+
+    gr::block_sptr b = boost::dynamic_pointer_cast<gr::block>(block);
+    if (info.per_output) {
+      units = (double)b->nitems_written(0) * vlen_out;
+    }
+    else {
+      units = (double)b->nitems_read(0) * vlen_in;
+    }
+  }
+  if (stage == STAGE_BBHEADER) {
+    units *= 8;
+  }
+
+  fprintf(out, "        {\"block\": \"%s\", \"unit\": \"%s\", \"units\": %.0f, \"seconds\": %.6f, \"ns_per_unit\": %.3f}%s\n",
+    info.name, info.unit, units, best, units > 0.0 ? best * 1e9 / units : 0.0, last ? "" : ",");
+}
+
+typedef std::map<std::string, double> baseline_map;
+
+static baseline_map
+read_baseline(const char *path)
+{
+  baseline_map baseline;
+  FILE *fp = fopen(path, "r");
+  char line[256];
+  char name[128];
+  double msps;
+
+  if (fp == NULL) {
+    return baseline;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] != '#' && sscanf(line, "%127s %lf", name, &msps) == 2) {
+      baseline[name] = msps;
+    }
+  }
+  fclose(fp);
+  return baseline;
+}
+
+static int
+write_baseline(const char *path, const baseline_map &baseline)
+{
+  FILE *fp = fopen(path, "w");
+
+  if (fp == NULL) {
+    perror(path);
+    return 1;
+  }
+  fprintf(fp, "# config msps, chain throughput baseline written by bench_dvbt2 -w\n");
+  for (baseline_map::const_iterator it = baseline.begin(); it != baseline.end(); ++it) {
+    fprintf(fp, "%s %.3f\n", it->first.c_str(), it->second);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/* time the complete chain from TS bytes to baseband samples, return Msps */
+static double
+bench_chain(FILE *out, const vv_config &c, const std::vector<int> &stages, const std::vector<unsigned char> &ts, int repeat)
+{
+  double best = 0.0;
+  double samples = 0.0;
+
+  for (int r = 0; r < repeat; r++) {
+    gr::top_block_sptr tb = gr::make_top_block("bench_dvbt2_chain");
+    gr::basic_block_sptr prev = gr::blocks::vector_source_b::make(ts, false, 1);
+    gr::basic_block_sptr block;
+    for (unsigned int i = 0; i < stages.size(); i++) {
+      block = make_stage(c, stages[i]);
+      tb->connect(prev, 0, block, 0);
+      prev = block;
+    }
+    tb->connect(block, 0, gr::blocks::null_sink::make(sizeof(gr_complex)), 0);
+
+    double start = now();
+    tb->run();
+    double elapsed = now() - start;
+    if (r == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    samples = (double)boost::dynamic_pointer_cast<gr::block>(block)->nitems_written(0);
+  }
+
+  double duration = samples / c.samp_rate;
+  double msps = best > 0.0 ? samples / best / 1e6 : 0.0;
+  fprintf(out, "      \"chain\": {\"ts_bytes\": %lu, \"samples\": %.0f, \"seconds\": %.6f, \"msps\": %.3f, \"realtime\": %.3f}\n",
+    (unsigned long)ts.size(), samples, best, msps, best > 0.0 ? duration / best : 0.0);
+  return msps;
+}
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+    "usage: bench_dvbt2 [options]\n"
+    "  -o file      write JSON results to file (default stdout)\n"
+    "  -c name      only run configurations whose name contains name\n"
+    "  -f frames    T2 frames of input per configuration (default 4)\n"
+    "  -r repeat    runs per measurement, the fastest is reported (default 3)\n"
+    "  -b file      check the chain rates against a baseline file\n"
+    "  -t percent   slowdown allowed against the baseline (default 10)\n"
+    "  -w           write the measured chain rates to the -b file\n");
+  exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  FILE *out = stdout;
+  const char *filter = NULL;
+  int frames = 4;
+  int repeat = 3;
+  const char *baseline_path = NULL;
+  double tolerance = 10.0;
+  bool write = false;
+  int regressions = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:c:f:r:b:t:w")) != -1) {
+    switch (opt) {
+      case 'o':
+        out = fopen(optarg, "w");
+        if (out == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 'c':
+        filter = optarg;
+        break;
+      case 'f':
+        frames = atoi(optarg);
+        break;
+      case 'r':
+        repeat = atoi(optarg);
+        break;
+      case 'b':
+        baseline_path = optarg;
+        break;
+      case 't':
+        tolerance = atof(optarg);
+        break;
+      case 'w':
+        write = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (frames < 1 || repeat < 1 || (write && baseline_path == NULL)) {
+    usage();
+  }
+  baseline_map baseline;
+  if (baseline_path != NULL && !write && access(baseline_path, R_OK) != 0) {
+    fprintf(stderr, "bench_dvbt2: no baseline in %s, record one with -w\n", baseline_path);
+    return 77;
+  }
+  if (baseline_path != NULL) {
+    baseline = read_baseline(baseline_path);
+  }
+
+  std::vector<unsigned int> selected;
+  for (int n = 0; n < num_vv_configs; n++) {
+    if (filter == NULL || strstr(vv_configs[n].name, filter) != NULL) {
+      selected.push_back(n);
+    }
+  }
+
+  fprintf(out, "{\n  \"frames\": %d,\n  \"repeat\": %d,\n  \"configurations\": [\n", frames, repeat);
+  for (unsigned int n = 0; n < selected.size(); n++) {
+    const vv_config &c = vv_configs[selected[n]];
+    std::vector<int> stages = chain_stages(c);
+    std::vector<unsigned char> ts = make_transport_stream(c, frames);
+    std::vector<capture> outputs;
+    capture ts_input;
+
+    fprintf(stderr, "bench_dvbt2: %s\n", c.name);
+    capture_stages(c, stages, ts, outputs);
+    ts_input.bytes = ts;
+
+    fprintf(out, "    {\n      \"name\": \"%s\",\n      \"blocks\": [\n", c.name);
+    for (unsigned int i = 0; i < stages.size(); i++) {
+      bench_stage(out, c, stages[i], i == 0 ? ts_input : outputs[i - 1], repeat, i == stages.size() - 1);
+    }
+    fprintf(out, "      ],\n");
+    double msps = bench_chain(out, c, stages, ts, repeat);
+    if (write) {
+      baseline[c.name] = msps;
+    }
+    else if (baseline_path != NULL) {
+      baseline_map::const_iterator ref = baseline.find(c.name);
+      if (ref == baseline.end()) {
+        fprintf(stderr, "bench_dvbt2: %s not in %s\n", c.name, baseline_path);
+        regressions++;
+      }
+      else if (msps < ref->second * (1.0 - tolerance / 100.0)) {
+        fprintf(stderr, "bench_dvbt2: %s %.3f Msps, baseline %.3f Msps\n", c.name, msps, ref->second);
+        regressions++;
+      }
+    }
+    fprintf(out, "    }%s\n", n == selected.size() - 1 ? "" : ",");
+  }
+  fprintf(out, "  ]\n}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  if (write) {
+    return write_baseline(baseline_path, baseline);
+  }
+  return regressions ? 2 : 0;
+}
@@ -0,0 +1,112 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "block_arena.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+namespace gr {
+  namespace dvbt2 {
+
+static size_t
+round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+    block_arena::block_arena()
+      : base(NULL)
+    {
+    }
+
+    block_arena::~block_arena()
+    {
+        free(base);
+    }
+
+    void
+    block_arena::reserve(void *pointer, assign_t assign, size_t size)
+    {
+        region r;
+        r.pointer = pointer;
+        r.assign = assign;
+        r.size = size;
+        regions.push_back(r);
+    }
+
+    /*
+     * Place every buffer declared so far and set its pointer.  Returns
+     * false when out of memory or already allocated, the pointers are
+     * then left untouched.
+     */
+    bool
+    block_arena::allocate(void)
+    {
+        size_t total = 0;
+        size_t alignment = ARENA_ALIGNMENT;
+        unsigned char *next;
+
+        if (base != NULL)
+        {
+            return false;
+        }
+        for (unsigned int i = 0; i < regions.size(); i++)
+        {
+            total += round_up(regions[i].size, ARENA_ALIGNMENT);
+        }
+        if (total >= ARENA_HUGE_PAGE)
+        {
+            alignment = ARENA_HUGE_PAGE;
+            total = round_up(total, ARENA_HUGE_PAGE);
+        }
+        if (total == 0)
+        {
+            return true;
+        }
+        if (posix_memalign(&base, alignment, total) != 0)
+        {
+            base = NULL;
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        if (alignment == ARENA_HUGE_PAGE)
+        {
+            madvise(base, total, MADV_HUGEPAGE);
+        }
+#endif
+        next = (unsigned char *)base;
+        for (unsigned int i = 0; i < regions.size(); i++)
+        {
+            regions[i].assign(regions[i].pointer, next);
+            next += round_up(regions[i].size, ARENA_ALIGNMENT);
+        }
+        regions.clear();
+        return true;
+    }
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
@@ -0,0 +1,79 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_BLOCK_ARENA_H
+#define INCLUDED_DVBT2_BLOCK_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*
+     * One allocation for all the scratch buffers of a block.
+     *
+     * Buffers are declared with add() and placed by allocate() in a
+     * single block, each one starting on a 64 byte boundary so every
+     * volk kernel can take its aligned path.  An arena of 2 MB or more
+     * is aligned to 2 MB and advised for transparent huge pages, which
+     * keeps the TLB footprint of the 32K buffers small.
+     *
+     * allocate() does not touch the memory, so with the default first
+     * touch policy a page lands on the NUMA node of the thread that
+     * first writes it.  That is the work thread only for buffers the
+     * constructor leaves alone; tables filled in the constructor, like
+     * dummy_randomize or inverse_sinc, stay on the constructing
+     * thread's node.  An arena is allocated once, a second allocate()
+     * fails and keeps the first one.
+     */
+    class block_arena
+    {
+     private:
+      typedef void (*assign_t)(void *, unsigned char *);
+      struct region
+      {
+        void *pointer;
+        assign_t assign;
+        size_t size;
+      };
+      std::vector<region> regions;
+      void *base;
+      void reserve(void *pointer, assign_t assign, size_t size);
+
+      // Stores through the pointer's own type, so no T ** is aliased as void **.
+      template <typename T>
+      static void assign_pointer(void *pointer, unsigned char *address)
+      {
+        *static_cast<T **>(pointer) = reinterpret_cast<T *>(address);
+      }
+
+     public:
+      block_arena();
+      ~block_arena();
+      template <typename T>
+      void add(T **pointer, size_t count) { reserve(pointer, &block_arena::assign_pointer<T>, sizeof(T) * count); }
+      bool allocate(void);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_BLOCK_ARENA_H */
@@ -0,0 +1,123 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "block_stats.h"
+#include <time.h>
+
+#define STATS_INTERVAL_NS 1000000000ULL
+
+namespace gr {
+  namespace dvbt2 {
+
+static uint64_t
+monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+    block_stats::block_stats()
+      : owner(NULL), frame_items(1), vlen(1), calls(0), items(0),
+        frames(0), frame_partial(0), work_ns(0), start_ns(0), publish_ns(0)
+    {
+    }
+
+    /*
+     * itemsperframe is the number of output items in one frame,
+     * vectorlength the number of cells or samples in one item.
+     */
+    void
+    block_stats::attach(gr::basic_block *block, int itemsperframe, int vectorlength)
+    {
+        owner = block;
+        port = pmt::mp("stats");
+        frame_items = itemsperframe;
+        vlen = vectorlength;
+        owner->message_port_register_out(port);
+    }
+
+    /*
+     * A modcod change takes effect on a frame boundary, so the items
+     * of a partly counted frame carry over to the new length.
+     */
+    void
+    block_stats::set_frame_items(int itemsperframe)
+    {
+        frame_items = itemsperframe;
+    }
+
+    int
+    block_stats::add_counter(const char *name)
+    {
+        names.push_back(pmt::mp(name));
+        counters.push_back(0);
+        return counters.size() - 1;
+    }
+
+    void
+    block_stats::begin(void)
+    {
+        start_ns = monotonic_ns();
+    }
+
+    void
+    block_stats::end(int produced)
+    {
+        uint64_t now = monotonic_ns();
+
+        calls++;
+        items += produced;
+        frame_partial += produced;
+        if (frame_partial >= frame_items)
+        {
+            frames += frame_partial / frame_items;
+            frame_partial %= frame_items;
+        }
+        work_ns += now - start_ns;
+        if (now - publish_ns >= STATS_INTERVAL_NS)
+        {
+            publish_ns = now;
+            publish();
+        }
+    }
+
+void
+block_stats::publish(void)
+{
+    pmt::pmt_t dict = pmt::make_dict();
+
+    dict = pmt::dict_add(dict, pmt::mp("calls"), pmt::from_uint64(calls));
+    dict = pmt::dict_add(dict, pmt::mp("frames"), pmt::from_uint64(frames));
+    dict = pmt::dict_add(dict, pmt::mp("items"), pmt::from_uint64(items * vlen));
+    dict = pmt::dict_add(dict, pmt::mp("work_ns"), pmt::from_uint64(work_ns));
+    for (unsigned int i = 0; i < counters.size(); i++)
+    {
+        dict = pmt::dict_add(dict, names[i], pmt::from_uint64(counters[i]));
+    }
+    owner->message_port_pub(port, dict);
+}
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
@@ -0,0 +1,75 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_BLOCK_STATS_H
+#define INCLUDED_DVBT2_BLOCK_STATS_H
+
+#include <gnuradio/block.h>
+#include <stdint.h>
+#include <vector>
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*
+     * Hot path counters published on a "stats" message port.
+     *
+     * The counters are only touched from the block's work thread, so
+     * they need no locking.  A dict with the running totals (calls,
+     * frames, items, work_ns and any extra counters) is published at
+     * most once per second, so the monitoring cost does not scale
+     * with the work call rate.
+     *
+     * Frames are counted as the items come out, so a block whose frame
+     * length changes with the modcod calls set_frame_items() when it
+     * switches and the frames already counted keep their old length.
+     */
+    class block_stats
+    {
+     private:
+      gr::basic_block *owner;
+      pmt::pmt_t port;
+      uint64_t frame_items;
+      uint64_t vlen;
+      uint64_t calls;
+      uint64_t items;
+      uint64_t frames;
+      uint64_t frame_partial;
+      uint64_t work_ns;
+      uint64_t start_ns;
+      uint64_t publish_ns;
+      std::vector<pmt::pmt_t> names;
+      std::vector<uint64_t> counters;
+      void publish(void);
+
+     public:
+      block_stats();
+      void attach(gr::basic_block *block, int itemsperframe, int vectorlength);
+      void set_frame_items(int itemsperframe);
+      int add_counter(const char *name);
+      void count(int counter, uint64_t n) { counters[counter] += n; }
+      void begin(void);
+      void end(int produced);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_BLOCK_STATS_H */
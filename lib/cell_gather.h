@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_CELL_GATHER_H
+#define INCLUDED_DVBT2_CELL_GATHER_H
+
+#include <gnuradio/gr_complex.h>
+
+/* cells ahead of the one being copied whose source is prefetched */
+#define GATHER_PREFETCH_DISTANCE 16
+
+#ifdef __GNUC__
+#define GATHER_PREFETCH(p) __builtin_prefetch((p))
+#else
+#define GATHER_PREFETCH(p)
+#endif
+
+namespace gr {
+  namespace dvbt2 {
+
+/*
+ * Cell permutation kernels shared by the interleavers and the frame
+ * mapper.
+ *
+ * A permuted read of a 32K symbol misses the cache on almost every
+ * cell, so the loop is bound by load latency rather than by the copy.
+ * The source of the cell GATHER_PREFETCH_DISTANCE ahead is prefetched,
+ * which keeps several misses in flight at once.  Hardware gathers do
+ * not help here, each lane still misses on its own.
+ */
+
+/* out[j] = in[index[j]] for n cells */
+template <typename T>
+inline void
+gather_cells(gr_complex *out, const gr_complex *in, const T *index, int n)
+{
+    int j = 0;
+
+    for (; j < n - GATHER_PREFETCH_DISTANCE; j++)
+    {
+        GATHER_PREFETCH(&in[index[j + GATHER_PREFETCH_DISTANCE]]);
+        out[j] = in[index[j]];
+    }
+    for (; j < n; j++)
+    {
+        out[j] = in[index[j]];
+    }
+}
+
+/* out[j] = in[j * stride] for n cells */
+inline void
+gather_cells_strided(gr_complex *out, const gr_complex *in, int stride, int n)
+{
+    int j = 0;
+
+    for (; j < n - GATHER_PREFETCH_DISTANCE; j++)
+    {
+        GATHER_PREFETCH(&in[(j + GATHER_PREFETCH_DISTANCE) * stride]);
+        out[j] = in[j * stride];
+    }
+    for (; j < n; j++)
+    {
+        out[j] = in[j * stride];
+    }
+}
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_CELL_GATHER_H */
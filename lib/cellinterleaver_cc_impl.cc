@@ -24,6 +24,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "cellinterleaver_cc_impl.h"
+#include "cell_gather.h"
 #include <stdio.h>
 
 namespace gr {
@@ -44,133 +45,14 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(1, 1, sizeof(gr_complex)))
     {
-        int max_states, xor_size, pn_mask, result, q = 0;
-        int lfsr = 0;
-        int logic11[2] = {0, 3};
-        int logic12[2] = {0, 2};
-        int logic13[4] = {0, 1, 4, 6};
-        int logic14[6] = {0, 1, 4, 5, 9, 11};
-        int logic15[4] = {0, 1, 2, 12};
-        int *logic;
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 32400;
-                    pn_degree = 15;
-                    pn_mask = 0x3fff;
-                    max_states = 32768;
-                    logic = &logic15[0];
-                    xor_size = 4;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 16200;
-                    pn_degree = 14;
-                    pn_mask = 0x1fff;
-                    max_states = 16384;
-                    logic = &logic14[0];
-                    xor_size = 6;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 10800;
-                    pn_degree = 14;
-                    pn_mask = 0x1fff;
-                    max_states = 16384;
-                    logic = &logic14[0];
-                    xor_size = 6;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 8100;
-                    pn_degree = 13;
-                    pn_mask = 0xfff;
-                    max_states = 8192;
-                    logic = &logic13[0];
-                    xor_size = 4;
-                    break;
-                default:
-                    cell_size = 32400;
-                    pn_degree = 15;
-                    pn_mask = 0x3fff;
-                    max_states = 32768;
-                    logic = &logic15[0];
-                    xor_size = 4;
-                    break;
-            }
-        }
-        else
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        fec_blocks = fecblocks;
+        for (int i = 0; i < 4; i++)
         {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 8100;
-                    pn_degree = 13;
-                    pn_mask = 0xfff;
-                    max_states = 8192;
-                    logic = &logic13[0];
-                    xor_size = 4;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 4050;
-                    pn_degree = 12;
-                    pn_mask = 0x7ff;
-                    max_states = 4096;
-                    logic = &logic12[0];
-                    xor_size = 2;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 2700;
-                    pn_degree = 12;
-                    pn_mask = 0x7ff;
-                    max_states = 4096;
-                    logic = &logic12[0];
-                    xor_size = 2;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 2025;
-                    pn_degree = 11;
-                    pn_mask = 0x3ff;
-                    max_states = 2048;
-                    logic = &logic11[0];
-                    xor_size = 2;
-                    break;
-                default:
-                    cell_size = 8100;
-                    pn_degree = 13;
-                    pn_mask = 0xfff;
-                    max_states = 8192;
-                    logic = &logic13[0];
-                    xor_size = 4;
-                    break;
-            }
-        }
-        for (int i = 0; i < max_states; i++)
-        {
-            if (i == 0 || i == 1)
-            {
-                lfsr = 0;
-            }
-            else if (i == 2)
-            {
-                lfsr = 1;
-            }
-            else
-            {
-                result = 0;
-                for (int k = 0; k < xor_size; k++)
-                {
-                    result ^= (lfsr >> logic[k]) & 1;
-                }
-                lfsr &= pn_mask;
-                lfsr >>= 1;
-                lfsr |= result << (pn_degree - 2);
-            }
-            lfsr |= (i % 2) << (pn_degree - 1);
-            if (lfsr < cell_size)
-            {
-                permutations[q++] = lfsr;
-            }
+            perm_cache[i] = NULL;
         }
+        set_constellation(constellation);
+        modcod_key = pmt::string_to_symbol("modcod");
         if (tiblocks == 0)
         {
             FECBlocksPerSmallTIBlock = 1;
@@ -185,21 +67,17 @@ namespace gr {
             numBigTIBlocks = fecblocks % tiblocks;
             numSmallTIBlocks = tiblocks - numBigTIBlocks;
         }
-        time_interleave = (gr_complex *) malloc(sizeof(gr_complex) * cell_size * fecblocks);
-        if (time_interleave == NULL) {
-            fprintf(stderr, "Cell interleaver 1st malloc, Out of memory.\n");
-            exit(1);
-        }
-        cols = (gr_complex **) malloc(sizeof(gr_complex *) * FECBlocksPerBigTIBlock * 5);
-        if (cols == NULL) {
-            free(time_interleave);
-            fprintf(stderr, "Cell interleaver 2nd malloc, Out of memory.\n");
+        // sized for QPSK, the constellation with the most cells
+        arena.add(&time_interleave, (frame_size / 2) * fecblocks);
+        if (!arena.allocate())
+        {
+            fprintf(stderr, "Cell interleaver arena, Out of memory.\n");
             exit(1);
         }
         ti_blocks = tiblocks;
-        fec_blocks = fecblocks;
-        set_output_multiple(cell_size * fecblocks);
-        interleaved_items = cell_size * fecblocks;
+        // sizes the buffers for QPSK as well, see start()
+        set_output_multiple((frame_size / 2) * fecblocks);
+        stats.attach(this, interleaved_items, 1);
     }
 
     /*
@@ -207,18 +85,217 @@ namespace gr {
      */
     cellinterleaver_cc_impl::~cellinterleaver_cc_impl()
     {
-        free(cols);
-        free(time_interleave);
+        for (int i = 0; i < 4; i++)
+        {
+            free(perm_cache[i]);
+        }
+    }
+
+    /* buffers are allocated by now, run with the current constellation */
+    bool
+    cellinterleaver_cc_impl::start()
+    {
+        set_output_multiple(interleaved_items);
+        return true;
     }
 
+void cellinterleaver_cc_impl::set_constellation(int constellation)
+{
+    int max_states, xor_size, pn_mask, result, q = 0;
+    int lfsr = 0;
+    int logic11[2] = {0, 3};
+    int logic12[2] = {0, 2};
+    int logic13[4] = {0, 1, 4, 6};
+    int logic14[6] = {0, 1, 4, 5, 9, 11};
+    int logic15[4] = {0, 1, 2, 12};
+    int *logic;
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (constellation)
+        {
+            case gr::dvbt2::MOD_QPSK:
+                cell_size = 32400;
+                pn_degree = 15;
+                pn_mask = 0x3fff;
+                max_states = 32768;
+                logic = &logic15[0];
+                xor_size = 4;
+                break;
+            case gr::dvbt2::MOD_16QAM:
+                cell_size = 16200;
+                pn_degree = 14;
+                pn_mask = 0x1fff;
+                max_states = 16384;
+                logic = &logic14[0];
+                xor_size = 6;
+                break;
+            case gr::dvbt2::MOD_64QAM:
+                cell_size = 10800;
+                pn_degree = 14;
+                pn_mask = 0x1fff;
+                max_states = 16384;
+                logic = &logic14[0];
+                xor_size = 6;
+                break;
+            case gr::dvbt2::MOD_256QAM:
+                cell_size = 8100;
+                pn_degree = 13;
+                pn_mask = 0xfff;
+                max_states = 8192;
+                logic = &logic13[0];
+                xor_size = 4;
+                break;
+            default:
+                cell_size = 32400;
+                pn_degree = 15;
+                pn_mask = 0x3fff;
+                max_states = 32768;
+                logic = &logic15[0];
+                xor_size = 4;
+                break;
+        }
+    }
+    else
+    {
+        switch (constellation)
+        {
+            case gr::dvbt2::MOD_QPSK:
+                cell_size = 8100;
+                pn_degree = 13;
+                pn_mask = 0xfff;
+                max_states = 8192;
+                logic = &logic13[0];
+                xor_size = 4;
+                break;
+            case gr::dvbt2::MOD_16QAM:
+                cell_size = 4050;
+                pn_degree = 12;
+                pn_mask = 0x7ff;
+                max_states = 4096;
+                logic = &logic12[0];
+                xor_size = 2;
+                break;
+            case gr::dvbt2::MOD_64QAM:
+                cell_size = 2700;
+                pn_degree = 12;
+                pn_mask = 0x7ff;
+                max_states = 4096;
+                logic = &logic12[0];
+                xor_size = 2;
+                break;
+            case gr::dvbt2::MOD_256QAM:
+                cell_size = 2025;
+                pn_degree = 11;
+                pn_mask = 0x3ff;
+                max_states = 2048;
+                logic = &logic11[0];
+                xor_size = 2;
+                break;
+            default:
+                cell_size = 8100;
+                pn_degree = 13;
+                pn_mask = 0xfff;
+                max_states = 8192;
+                logic = &logic13[0];
+                xor_size = 4;
+                break;
+        }
+    }
+    signal_constellation = constellation;
+    interleaved_items = cell_size * fec_blocks;
+    /* the permutation of each constellation is generated on first use */
+    permutations = perm_cache[constellation];
+    if (permutations != NULL)
+    {
+        return;
+    }
+    permutations = (int *) malloc(sizeof(int) * cell_size);
+    if (permutations == NULL)
+    {
+        fprintf(stderr, "Cell interleaver permutation malloc, Out of memory.\n");
+        exit(1);
+    }
+    perm_cache[constellation] = permutations;
+    for (int i = 0; i < max_states; i++)
+    {
+        if (i == 0 || i == 1)
+        {
+            lfsr = 0;
+        }
+        else if (i == 2)
+        {
+            lfsr = 1;
+        }
+        else
+        {
+            result = 0;
+            for (int k = 0; k < xor_size; k++)
+            {
+                result ^= (lfsr >> logic[k]) & 1;
+            }
+            lfsr &= pn_mask;
+            lfsr >>= 1;
+            lfsr |= result << (pn_degree - 2);
+        }
+        lfsr |= (i % 2) << (pn_degree - 1);
+        // stored inverted, the input cell for each output position
+        if (lfsr < cell_size)
+        {
+            permutations[lfsr] = q++;
+        }
+    }
+}
+
+void cellinterleaver_cc_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+
+    if (pmt::dict_has_key(modcod, constellation_key))
+    {
+        set_constellation(pmt::to_long(pmt::dict_ref(modcod, constellation_key, pmt::PMT_NIL)));
+    }
+    set_output_multiple(interleaved_items);
+    stats.set_frame_items(interleaved_items);
+}
+
+/*
+ * A constellation change arrives as a "modcod" tag on the first cell of
+ * an interleaving frame.  Apply one found at the start of the input and
+ * return the number of cells that still use it.
+ */
+int cellinterleaver_cc_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
+}
+
     int
     cellinterleaver_cc_impl::work(int noutput_items,
 			  gr_vector_const_void_star &input_items,
 			  gr_vector_void_star &output_items)
     {
+        noutput_items = modcod_run(noutput_items);
+        noutput_items -= noutput_items % interleaved_items;
+
         const gr_complex *in = (const gr_complex *) input_items[0];
         gr_complex *out = (gr_complex *) output_items[0];
         int FECBlocksPerTIBlock, n, shift, temp, index, rows, numCols, ti_index;
+        stats.begin();
 
         for (int i = 0; i < noutput_items; i += interleaved_items)
         {
@@ -249,10 +326,10 @@ namespace gr {
                         }
                         n++;
                     }
-                    for (int w = 0; w < cell_size; w++)
-                    {
-                        time_interleave[((permutations[w] + shift) % cell_size) + index] = *in++;
-                    }
+                    // the cyclic shift splits the block into two gathers
+                    gather_cells(&time_interleave[index + shift], in, permutations, cell_size - shift);
+                    gather_cells(&time_interleave[index], in, permutations + cell_size - shift, shift);
+                    in += cell_size;
                     index += cell_size;
                 }
             }
@@ -271,18 +348,10 @@ namespace gr {
                     }
                     numCols = 5 * FECBlocksPerTIBlock;
                     rows = cell_size / 5;
-                    for (int j = 0; j < numCols; j++)
-                    {
-                        cols[j] = &time_interleave[(rows * j) + ti_index];
-                    }
-                    index = 0;
                     for (int k = 0; k < rows; k++)
                     {
-                        for (int w = 0; w < numCols; w++)
-                        {
-                            *out++ = *(cols[w] + index);
-                        }
-                        index++;
+                        gather_cells_strided(out, &time_interleave[ti_index + k], rows, numCols);
+                        out += numCols;
                     }
                     ti_index += rows * numCols;
                 }
@@ -297,6 +366,8 @@ namespace gr {
             }
         }
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
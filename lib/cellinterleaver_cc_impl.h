@@ -22,6 +22,8 @@
 #define INCLUDED_DVBT2_CELLINTERLEAVER_CC_IMPL_H
 
 #include <dvbt2/cellinterleaver_cc.h>
+#include "block_stats.h"
+#include "block_arena.h"
 
 namespace gr {
   namespace dvbt2 {
@@ -33,18 +35,27 @@ namespace gr {
       int pn_degree;
       int ti_blocks;
       int fec_blocks;
-      int permutations[32768];
+      int frame_size;
+      int signal_constellation;
+      int *permutations;
+      int *perm_cache[4];
       int FECBlocksPerSmallTIBlock;
       int FECBlocksPerBigTIBlock;
       int numBigTIBlocks;
       int numSmallTIBlocks;
       int interleaved_items;
       gr_complex *time_interleave;
-      gr_complex **cols;
+      block_arena arena;
+      pmt::pmt_t modcod_key;
+      void set_constellation(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
 
+      block_stats stats;
      public:
       cellinterleaver_cc_impl(dvbt2_framesize_t framesize, dvbt2_constellation_t constellation, int fecblocks, int tiblocks);
       ~cellinterleaver_cc_impl();
+      bool start();
 
       // Where all the action really happens
       int work(int noutput_items,
@@ -24,216 +24,34 @@
 
 #include <gnuradio/io_signature.h>
 #include "framemapper_cc_impl.h"
+#include "cell_gather.h"
+#include <boost/bind.hpp>
 #include <stdio.h>
 
 namespace gr {
   namespace dvbt2 {
 
     framemapper_cc::sptr
-    framemapper_cc::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband)
+    framemapper_cc::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype)
     {
       return gnuradio::get_initial_sptr
-        (new framemapper_cc_impl(framesize, rate, constellation, rotation, fecblocks, tiblocks, carriermode, fftsize, guardinterval, l1constellation, pilotpattern, t2frames, numdatasyms, paprmode, version, preamble, inputmode, reservedbiasbits, l1scrambled, inband));
+        (new framemapper_cc_impl(framesize, rate, constellation, rotation, fecblocks, tiblocks, carriermode, fftsize, guardinterval, l1constellation, pilotpattern, t2frames, numdatasyms, paprmode, version, preamble, inputmode, reservedbiasbits, l1scrambled, inband, payloadtype));
     }
 
     /*
      * The private constructor
      */
-    framemapper_cc_impl::framemapper_cc_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband)
+    framemapper_cc_impl::framemapper_cc_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype)
       : gr::block("framemapper_cc",
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(1, 1, sizeof(gr_complex)))
     {
-        L1Pre *l1preinit = &L1_Signalling[0].l1pre_data;
-        L1Post *l1postinit = &L1_Signalling[0].l1post_data;
         double normalization;
-        int N_punc_temp, N_post_temp;
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 32400;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 16200;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 10800;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 8100;
-                    break;
-            }
-        }
-        else
-        {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 8100;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 4050;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 2700;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 2025;
-                    break;
-            }
-        }
-        fef_present = FALSE;    /* for testing only */
-        fef_length = 134144;    /*  "     "     "   */
-        fef_interval = 1;       /*  "     "     "   */
-        l1preinit->type = gr::dvbt2::STREAMTYPE_TS;
-        l1preinit->bwt_ext = carriermode;
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        fec_blocks = fecblocks;
+        set_constellation(constellation);
+        signalling.init(framesize, rate, constellation, rotation, fecblocks, tiblocks, carriermode, fftsize, guardinterval, l1constellation, pilotpattern, t2frames, numdatasyms, paprmode, version, preamble, inputmode, reservedbiasbits, l1scrambled, inband, payloadtype);
         fft_size = fftsize;
-        l1preinit->s1 = preamble;
-        l1preinit->s2 = fft_size & 0x7;
-        l1preinit->l1_repetition_flag = FALSE;
-        l1preinit->guard_interval = guardinterval;
-        l1preinit->papr = paprmode;
-        l1preinit->l1_mod = l1constellation;
-        l1preinit->l1_cod = 0;
-        l1preinit->l1_fec_type = 0;
-        if (fef_present == FALSE)
-        {
-            l1preinit->l1_post_info_size = KSIG_POST - 32;
-        }
-        else
-        {
-            l1preinit->l1_post_info_size = KSIG_POST + 34 - 32;
-        }
-        l1preinit->pilot_pattern = pilotpattern;
-        l1preinit->tx_id_availability = 0;
-        l1preinit->cell_id = 0;
-        l1preinit->network_id = 0x3085;
-        l1preinit->t2_system_id = 0x8001;
-        l1preinit->num_t2_frames = t2frames;
-        l1preinit->num_data_symbols = numdatasyms;
-        l1preinit->regen_flag = FALSE;
-        l1preinit->l1_post_extension = FALSE;
-        l1preinit->num_rf = 1;
-        l1preinit->current_rf_index = 0;
-        l1preinit->t2_version = version;
-        if (version == gr::dvbt2::VERSION_131)
-        {
-            l1preinit->l1_post_scrambled = l1scrambled;
-        }
-        else
-        {
-            l1preinit->l1_post_scrambled = FALSE;
-        }
-        l1preinit->t2_base_lite = FALSE;
-        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1preinit->reserved = 0xf;
-        }
-        else
-        {
-            l1preinit->reserved = 0x0;
-        }
-
-        l1postinit->sub_slices_per_frame = 1;
-        l1postinit->num_plp = 1;
-        l1postinit->num_aux = 0;
-        l1postinit->aux_config_rfu = 0;
-        l1postinit->rf_idx = 0;
-        l1postinit->frequency = 729833333;
-        l1postinit->plp_id = 0;
-        l1postinit->plp_type = 1;
-        l1postinit->plp_payload_type = 3;
-        l1postinit->ff_flag = 0;
-        l1postinit->first_rf_idx = 0;
-        l1postinit->first_frame_idx = 0;
-        if (fef_present == FALSE)
-        {
-            l1postinit->plp_group_id = 1;
-        }
-        else
-        {
-            l1postinit->plp_group_id = 0;
-        }
-        l1postinit->plp_cod = rate;
-        l1postinit->plp_mod = constellation;
-        l1postinit->plp_rotation = rotation;
-        l1postinit->plp_fec_type = framesize;
-        l1postinit->plp_num_blocks_max = fecblocks;
-        l1postinit->frame_interval = 1;
-        l1postinit->time_il_length = tiblocks;
-        l1postinit->time_il_type = 0;
-        l1postinit->in_band_a_flag = 0;
-        if (inband == gr::dvbt2::INBAND_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1postinit->in_band_b_flag = 1;
-        }
-        else
-        {
-            l1postinit->in_band_b_flag = 0;
-        }
-        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1postinit->reserved_1 = 0x7ff;
-        }
-        else
-        {
-            l1postinit->reserved_1 = 0x0;
-        }
-        if (version == gr::dvbt2::VERSION_111)
-        {
-            l1postinit->plp_mode = 0;
-        }
-        else
-        {
-            l1postinit->plp_mode = inputmode + 1;
-        }
-        if (fef_present == FALSE)
-        {
-            l1postinit->static_flag = 0;
-            l1postinit->static_padding_flag = 0;    /* fix */
-        }
-        else
-        {
-            l1postinit->static_flag = 1;
-            l1postinit->static_padding_flag = 1;
-        }
-        l1postinit->fef_length_msb = 0;
-        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1postinit->reserved_2 = 0x3fffffff;
-        }
-        else
-        {
-            l1postinit->reserved_2 = 0;
-        }
-        l1postinit->frame_idx = 0;
-        l1postinit->sub_slice_interval = 0;
-        l1postinit->type_2_start = 0;
-        l1postinit->l1_change_counter = 0;
-        l1postinit->start_rf_idx = 0;
-        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1postinit->reserved_3 = 0xff;
-        }
-        else
-        {
-            l1postinit->reserved_3 = 0;
-        }
-        l1postinit->plp_id = 0;
-        l1postinit->plp_start = 0;
-        l1postinit->plp_num_blocks = fecblocks;
-        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
-        {
-            l1postinit->reserved_4 = 0xff;
-            l1postinit->reserved_5 = 0xff;
-        }
-        else
-        {
-            l1postinit->reserved_4 = 0;
-            l1postinit->reserved_5 = 0;
-        }
 
         bch_poly_build_tables();
         l1pre_ldpc_lookup_generate();
@@ -1033,32 +851,28 @@ namespace gr {
                 C_FC = 0;
             }
         }
-        if (fef_present == FALSE)
-        {
-            N_punc_temp = (6 * (KBCH_1_2 - KSIG_POST)) / 5;
-            N_post_temp = KSIG_POST + NBCH_PARITY + 9000 - N_punc_temp;
-        }
-        else
-        {
-            N_punc_temp = (6 * (KBCH_1_2 - (KSIG_POST + 34))) / 5;
-            N_post_temp = (KSIG_POST + 34) + NBCH_PARITY + 9000 - N_punc_temp;
-        }
-        if (N_P2 == 1)
-        {
-            N_post = ceil((float)N_post_temp / (2 * (float)eta_mod)) * 2 * eta_mod;
-        }
-        else
-        {
-            N_post = ceil((float)N_post_temp / ((float)eta_mod * (float)N_P2)) * eta_mod * N_P2;
-        }
-        N_punc = N_punc_temp - (N_post - N_post_temp);
-        l1preinit->l1_post_size = N_post / eta_mod;
+        N_post = signalling.N_post;
+        N_punc = signalling.N_punc;
         add_l1pre(&l1pre_cache[0]);
         l1_constellation = l1constellation;
         t2_frames = t2frames;
         t2_frame_num = 0;
+        num_data_symbols = numdatasyms;
+        superframe_num = 0;
+        t2frame_key = pmt::string_to_symbol("t2_frame_idx");
+        superframe_key = pmt::string_to_symbol("superframe_idx");
+        symbol_key = pmt::string_to_symbol("symbol_idx");
+        set_tag_propagation_policy(TPP_DONT);
+        modcod_key = pmt::string_to_symbol("modcod");
+        modcod_announce_key = pmt::string_to_symbol("modcod_announce");
+        modcod_announce = pmt::PMT_NIL;
+        modcod_switch = FALSE;
+        modcod_expected = FALSE;
+        message_port_register_in(pmt::mp("l1"));
+        set_msg_handler(pmt::mp("l1"), boost::bind(&framemapper_cc_impl::handle_l1, this, _1));
+        message_port_register_in(pmt::mp("l1update"));
+        set_msg_handler(pmt::mp("l1update"), boost::bind(&framemapper_cc_impl::handle_l1_update, this, _1));
         l1_scrambled = l1scrambled;
-        stream_items = cell_size * fecblocks;
         if (N_FC == 0)
         {
             set_output_multiple((N_P2 * C_P2) + (numdatasyms * C_DATA));
@@ -1068,11 +882,6 @@ namespace gr {
                 fprintf(stderr, "Too many FEC blocks in T2 frame.\n");
                 mapped_items = stream_items + 1840 + (N_post / eta_mod) + (N_FC - C_FC);    /* avoid segfault */
             }
-            zigzag_interleave = (gr_complex *) malloc(sizeof(gr_complex) * mapped_items);
-            if (zigzag_interleave == NULL) {
-                fprintf(stderr, "Frame mapper 1st malloc, Out of memory.\n");
-                exit(1);
-            }
         }
         else
         {
@@ -1083,20 +892,20 @@ namespace gr {
                 fprintf(stderr, "Too many FEC blocks in T2 frame.\n");
                 mapped_items = stream_items + 1840 + (N_post / eta_mod) + (N_FC - C_FC);    /* avoid segfault */
             }
-            zigzag_interleave = (gr_complex *) malloc(sizeof(gr_complex) * mapped_items);
-            if (zigzag_interleave == NULL) {
-                fprintf(stderr, "Frame mapper 1st malloc, Out of memory.\n");
-                exit(1);
-            }
         }
-        dummy_randomize = (gr_complex *) malloc(sizeof(gr_complex) * mapped_items - stream_items - 1840 - (N_post / eta_mod) - (N_FC - C_FC));
-        if (dummy_randomize == NULL) {
-            free(zigzag_interleave);
-            fprintf(stderr, "Frame mapper 2nd malloc, Out of memory.\n");
+        data_capacity = mapped_items - 1840 - (N_post / eta_mod) - (N_FC - C_FC);
+        /* 256QAM leaves the most room for dummy cells */
+        max_dummy_items = data_capacity - ((frame_size / 8) * fecblocks);
+        arena.add(&zigzag_interleave, mapped_items);
+        arena.add(&dummy_randomize, max_dummy_items);
+        if (!arena.allocate())
+        {
+            fprintf(stderr, "Frame mapper arena, Out of memory.\n");
             exit(1);
         }
         init_dummy_randomizer();
         init_l1_randomizer();
+        stats.attach(this, mapped_items, 1);
     }
 
     /*
@@ -1104,8 +913,6 @@ namespace gr {
      */
     framemapper_cc_impl::~framemapper_cc_impl()
     {
-        free(dummy_randomize);
-        free(zigzag_interleave);
     }
 
     void
@@ -1285,7 +1092,7 @@ void framemapper_cc_impl::add_l1pre(gr_complex *out)
     const unsigned char *d;
     unsigned char *p;
     unsigned char *l1pre = l1_temp;
-    L1Pre *l1preinit = &L1_Signalling[0].l1pre_data;
+    L1Pre *l1preinit = &signalling.current.l1pre_data;
     int g, o, index;
 
     temp = l1preinit->type;
@@ -1304,7 +1111,7 @@ void framemapper_cc_impl::add_l1pre(gr_complex *out)
     {
         l1pre[offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    if (fef_present == FALSE)
+    if (signalling.fef_present == FALSE)
     {
         l1pre[offset_bits++] = 0;
     }
@@ -1496,7 +1303,7 @@ void framemapper_cc_impl::add_l1post(gr_complex *out, int t2_frame_num)
     const unsigned char *d;
     unsigned char *p;
     unsigned char *l1post = l1_interleave;
-    L1Post *l1postinit = &L1_Signalling[0].l1post_data;
+    L1Post *l1postinit = &signalling.current.l1post_data;
     int m, g, o, last, index;
     const int *post_padding;
     const int *post_puncture;
@@ -1533,19 +1340,19 @@ void framemapper_cc_impl::add_l1post(gr_complex *out, int t2_frame_num)
     {
         l1post[offset_bits++] = temp & (1 << n) ? 1 : 0;
     }
-    if (fef_present == TRUE)
+    if (signalling.fef_present == TRUE)
     {
         temp = 0;
         for (int n = 3; n >= 0; n--)
         {
             l1post[offset_bits++] = temp & (1 << n) ? 1 : 0;
         }
-        temp = fef_length;
+        temp = signalling.fef_length;
         for (int n = 21; n >= 0; n--)
         {
             l1post[offset_bits++] = temp & (1 << n) ? 1 : 0;
         }
-        temp = fef_interval;
+        temp = signalling.fef_interval;
         for (int n = 7; n >= 0; n--)
         {
             l1post[offset_bits++] = temp & (1 << n) ? 1 : 0;
@@ -1960,7 +1767,7 @@ void framemapper_cc_impl::add_l1post(gr_complex *out, int t2_frame_num)
 void framemapper_cc_impl::init_dummy_randomizer(void)
 {
     int sr = 0x4A80;
-    for (int i = 0; i < mapped_items - stream_items - 1840 - (N_post / eta_mod) - (N_FC - C_FC); i++)
+    for (int i = 0; i < max_dummy_items; i++)
     {
         int b = ((sr) ^ (sr >> 1)) & 1;
         if (b)
@@ -1985,6 +1792,154 @@ void framemapper_cc_impl::init_l1_randomizer(void)
     }
 }
 
+void framemapper_cc_impl::handle_l1(pmt::pmt_t msg)
+{
+    /* L1-post is coded every frame, only the L1-pre cells are cached */
+    if (signalling.set(msg) == TRUE)
+    {
+        add_l1pre(&l1pre_cache[0]);
+    }
+}
+
+void framemapper_cc_impl::handle_l1_update(pmt::pmt_t msg)
+{
+    signalling.update(msg);
+}
+
+void framemapper_cc_impl::set_constellation(int constellation)
+{
+    switch (constellation)
+    {
+        case gr::dvbt2::MOD_QPSK:
+            cell_size = frame_size / 2;
+            break;
+        case gr::dvbt2::MOD_16QAM:
+            cell_size = frame_size / 4;
+            break;
+        case gr::dvbt2::MOD_64QAM:
+            cell_size = frame_size / 6;
+            break;
+        case gr::dvbt2::MOD_256QAM:
+            cell_size = frame_size / 8;
+            break;
+    }
+    stream_items = cell_size * fec_blocks;
+}
+
+/*
+ * bbheader_bb announces a modcod change with a "modcod_announce" tag
+ * and switches a superframe later with a "modcod" tag, both on the
+ * first cell of a superframe.  A tag anywhere else, or a switch that
+ * doesn't follow its announcement, means bbheader_bb counts frames
+ * differently (fecblocks or t2frames don't match) and FALSE is
+ * returned.  The cell count of the frame follows the constellation at
+ * once, the L1-post changes with the superframe, see general_work().
+ */
+int framemapper_cc_impl::apply_modcod(uint64_t offset, int available)
+{
+    std::vector<tag_t> tags;
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+
+    if (available == 0)
+    {
+        return TRUE;
+    }
+    modcod_switch = FALSE;
+    modcod_announce = pmt::PMT_NIL;
+    get_tags_in_range(tags, 0, offset, offset + 1, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (t2_frame_num != 0 || modcod_expected == FALSE)
+        {
+            return FALSE;
+        }
+        if (pmt::dict_has_key(tags[t].value, constellation_key))
+        {
+            set_constellation(pmt::to_long(pmt::dict_ref(tags[t].value, constellation_key, pmt::PMT_NIL)));
+        }
+        modcod_switch = TRUE;
+    }
+    if (t2_frame_num == 0 && modcod_expected == TRUE && modcod_switch == FALSE)
+    {
+        return FALSE;
+    }
+    get_tags_in_range(tags, 0, offset, offset + 1, modcod_announce_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (t2_frame_num != 0)
+        {
+            return FALSE;
+        }
+        modcod_announce = tags[t].value;
+    }
+    if (available > stream_items)
+    {
+        available = stream_items;
+    }
+    get_tags_in_range(tags, 0, offset + 1, offset + available, modcod_key);
+    if (tags.size() != 0)
+    {
+        return FALSE;
+    }
+    get_tags_in_range(tags, 0, offset + 1, offset + available, modcod_announce_key);
+    if (tags.size() != 0)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * The FEC blocks of a T2 frame must fit in its data cells with the
+ * announced constellation.  The blocks before framemapper_cc switch
+ * with the "modcod" tag, so the change can't be held back here.
+ */
+int framemapper_cc_impl::modcod_fits(pmt::pmt_t modcod)
+{
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+    int constellation;
+
+    if (!pmt::dict_has_key(modcod, constellation_key))
+    {
+        return TRUE;
+    }
+    constellation = pmt::to_long(pmt::dict_ref(modcod, constellation_key, pmt::PMT_NIL));
+    /* QPSK to 256QAM carry 2 to 8 bits per cell */
+    if (fec_blocks * (frame_size / (2 * (constellation + 1))) > data_capacity)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void framemapper_cc_impl::add_frame_tags(uint64_t offset)
+{
+    int cells;
+
+    add_item_tag(0, offset, t2frame_key, pmt::from_long(t2_frame_num));
+    if (t2_frame_num == 0)
+    {
+        add_item_tag(0, offset, superframe_key, pmt::from_uint64(superframe_num));
+    }
+    for (int n = 0; n < N_P2 + num_data_symbols; n++)
+    {
+        add_item_tag(0, offset, symbol_key, pmt::from_long(n));
+        if (n < N_P2)
+        {
+            cells = C_P2;
+        }
+        else if (n == N_P2 + num_data_symbols - 1 && N_FC != 0)
+        {
+            cells = N_FC;
+        }
+        else
+        {
+            cells = C_DATA;
+        }
+        offset += cells;
+    }
+}
+
     int
     framemapper_cc_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
@@ -1993,12 +1948,55 @@ void framemapper_cc_impl::init_l1_randomizer(void)
     {
         const gr_complex *in = (const gr_complex *) input_items[0];
         gr_complex *out = (gr_complex *) output_items[0];
-        int index = 0;
-        int read, save, count = 0;
+        int index;
+        int read, count;
+        int dummy_items;
+        int consumed = 0;
+        int produced = 0;
         gr_complex *interleave = zigzag_interleave;
+        stats.begin();
 
         for (int i = 0; i < noutput_items; i += mapped_items)
         {
+            if (apply_modcod(nitems_read(0) + consumed, ninput_items[0] - consumed) == FALSE)
+            {
+                fprintf(stderr, "Modcod change not aligned to a superframe, check fecblocks and t2frames of bbheader_bb.\n");
+                return WORK_DONE;
+            }
+            if (pmt::is_dict(modcod_announce) && modcod_fits(modcod_announce) == FALSE)
+            {
+                // send the frames before it, then stop rather than truncate
+                if (produced != 0)
+                {
+                    break;
+                }
+                fprintf(stderr, "Too many FEC blocks in T2 frame for the announced modcod, set datacells of bbheader_bb to refuse it.\n");
+                return WORK_DONE;
+            }
+            if (consumed + stream_items > ninput_items[0])
+            {
+                break;
+            }
+            dummy_items = data_capacity - stream_items;
+            if (t2_frame_num == 0)
+            {
+                if (signalling.superframe_start() == TRUE)
+                {
+                    add_l1pre(&l1pre_cache[0]);
+                }
+                if (modcod_switch == TRUE)
+                {
+                    modcod_expected = FALSE;
+                }
+                if (pmt::is_dict(modcod_announce))
+                {
+                    signalling.announce(modcod_announce);
+                    modcod_expected = TRUE;
+                }
+            }
+            index = 0;
+            count = 0;
+            add_frame_tags(nitems_written(0) + i);
             if (N_P2 == 1)
             {
                 for (int j = 0; j < 1840; j++)
@@ -2007,13 +2005,17 @@ void framemapper_cc_impl::init_l1_randomizer(void)
                 }
                 add_l1post(out, t2_frame_num);
                 t2_frame_num = (t2_frame_num + 1) % t2_frames;
+                if (t2_frame_num == 0)
+                {
+                    superframe_num++;
+                }
                 out += N_post / eta_mod;
                 for (int j = 0; j < stream_items; j++)
                 {
                     *out++ = *in++;
                 }
                 index = 0;
-                for (int j = 0; j < mapped_items - stream_items - 1840 - (N_post / eta_mod) - (N_FC - C_FC); j++)
+                for (int j = 0; j < dummy_items; j++)
                 {
                     *out++ = dummy_randomize[index++];
                 }
@@ -2030,13 +2032,17 @@ void framemapper_cc_impl::init_l1_randomizer(void)
                 }
                 add_l1post(interleave, t2_frame_num);
                 t2_frame_num = (t2_frame_num + 1) % t2_frames;
+                if (t2_frame_num == 0)
+                {
+                    superframe_num++;
+                }
                 interleave += N_post / eta_mod;
                 for (int j = 0; j < stream_items; j++)
                 {
                     *interleave++ = *in++;
                 }
                 index = 0;
-                for (int j = 0; j < mapped_items - stream_items - 1840 - (N_post / eta_mod) - (N_FC - C_FC); j++)
+                for (int j = 0; j < dummy_items; j++)
                 {
                     *interleave++ = dummy_randomize[index++];
                 }
@@ -2049,29 +2055,19 @@ void framemapper_cc_impl::init_l1_randomizer(void)
                 index = 0;
                 for (int n = 0; n < N_P2; n++)
                 {
-                    save = read;
-                    for (int j = 0; j < 1840 / N_P2; j++)
-                    {
-                        out[index++] = interleave[read];
-                        count++;
-                        read += N_P2;
-                    }
-                    read = save + 1;
-                    index += C_P2 - (1840 / N_P2);
+                    gather_cells_strided(&out[index], &interleave[read], N_P2, 1840 / N_P2);
+                    count += 1840 / N_P2;
+                    read++;
+                    index += C_P2;
                 }
                 read = 1840;
                 index = 1840 / N_P2;
                 for (int n = 0; n < N_P2; n++)
                 {
-                    save = read;
-                    for (int j = 0; j < (N_post / eta_mod) / N_P2; j++)
-                    {
-                        out[index++] = interleave[read];
-                        count++;
-                        read += N_P2;
-                    }
-                    read = save + 1;
-                    index += C_P2 - ((N_post / eta_mod) / N_P2);
+                    gather_cells_strided(&out[index], &interleave[read], N_P2, (N_post / eta_mod) / N_P2);
+                    count += (N_post / eta_mod) / N_P2;
+                    read++;
+                    index += C_P2;
                 }
                 read = 1840 + (N_post / eta_mod);
                 index = (1840 / N_P2) + ((N_post / eta_mod) / N_P2);
@@ -2091,14 +2087,18 @@ void framemapper_cc_impl::init_l1_randomizer(void)
                 }
                 out += mapped_items;
             }
+            consumed += stream_items;
+            produced += mapped_items;
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
-        consume_each (stream_items);
+        consume_each (consumed);
+
+        stats.end(produced);
 
         // Tell runtime system how many output items we produced.
-        return noutput_items;
+        return produced;
     }
 
 const int framemapper_cc_impl::ldpc_tab_1_4S[9][13]=
@@ -22,94 +22,9 @@
 #define INCLUDED_DVBT2_FRAMEMAPPER_CC_IMPL_H
 
 #include <dvbt2/framemapper_cc.h>
-
-#define KBCH_1_4 3072
-#define NBCH_1_4 3240
-#define KBCH_1_2 7032
-#define NBCH_1_2 7200
-
-#define KSIG_PRE 200
-#define KSIG_POST 350
-#define NBCH_PARITY 168
-
-typedef struct{
-    int type;
-    int bwt_ext;
-    int s1;
-    int s2;
-    int l1_repetition_flag;
-    int guard_interval;
-    int papr;
-    int l1_mod;
-    int l1_cod;
-    int l1_fec_type;
-    int l1_post_size;
-    int l1_post_info_size;
-    int pilot_pattern;
-    int tx_id_availability;
-    int cell_id;
-    int network_id;
-    int t2_system_id;
-    int num_t2_frames;
-    int num_data_symbols;
-    int regen_flag;
-    int l1_post_extension;
-    int num_rf;
-    int current_rf_index;
-    int t2_version;
-    int l1_post_scrambled;
-    int t2_base_lite;
-    int reserved;
-    int crc_32;
-}L1Pre;
-
-typedef struct{
-    int sub_slices_per_frame;
-    int num_plp;
-    int num_aux;
-    int aux_config_rfu;
-    int rf_idx;
-    int frequency;
-    int plp_id;
-    int plp_type;
-    int plp_payload_type;
-    int ff_flag;
-    int first_rf_idx;
-    int first_frame_idx;
-    int plp_group_id;
-    int plp_cod;
-    int plp_mod;
-    int plp_rotation;
-    int plp_fec_type;
-    int plp_num_blocks_max;
-    int frame_interval;
-    int time_il_length;
-    int time_il_type;
-    int in_band_a_flag;
-    int in_band_b_flag;
-    int reserved_1;
-    int plp_mode;
-    int static_flag;
-    int static_padding_flag;
-    int fef_length_msb;
-    int reserved_2;
-    int frame_idx;
-    int sub_slice_interval;
-    int type_2_start;
-    int l1_change_counter;
-    int start_rf_idx;
-    int reserved_3;
-    int plp_id_dynamic;
-    int plp_start;
-    int plp_num_blocks;
-    int reserved_4;
-    int reserved_5;
-}L1Post;
-
-typedef struct{
-   L1Pre l1pre_data;
-   L1Post l1post_data;
-}L1Signalling;
+#include "block_stats.h"
+#include "block_arena.h"
+#include "l1_signalling.h"
 
 typedef struct{
     int table_length;
@@ -129,18 +44,19 @@ namespace gr {
     class framemapper_cc_impl : public framemapper_cc
     {
      private:
+      int frame_size;
+      int fec_blocks;
       int cell_size;
       int stream_items;
       int mapped_items;
+      int data_capacity;
+      int max_dummy_items;
       int l1_constellation;
       int fft_size;
       int eta_mod;
       int t2_frames;
       int t2_frame_num;
       int l1_scrambled;
-      int fef_present;
-      int fef_length;
-      int fef_interval;
       int N_P2;
       int C_P2;
       int N_FC;
@@ -148,9 +64,25 @@ namespace gr {
       int C_DATA;
       int N_post;
       int N_punc;
-      L1Signalling L1_Signalling[1];
+      int num_data_symbols;
+      uint64_t superframe_num;
+      pmt::pmt_t t2frame_key;
+      pmt::pmt_t superframe_key;
+      pmt::pmt_t symbol_key;
+      pmt::pmt_t modcod_key;
+      pmt::pmt_t modcod_announce_key;
+      pmt::pmt_t modcod_announce;
+      int modcod_switch;
+      int modcod_expected;
+      l1_signalling signalling;
       void add_l1pre(gr_complex *);
       void add_l1post(gr_complex *, int);
+      void add_frame_tags(uint64_t);
+      void set_constellation(int);
+      int apply_modcod(uint64_t, int);
+      int modcod_fits(pmt::pmt_t);
+      void handle_l1(pmt::pmt_t);
+      void handle_l1_update(pmt::pmt_t);
       int add_crc32_bits(unsigned char *, int);
       unsigned int m_poly_s_12[6];
       int poly_mult(const int*, int, const int*, int, int*);
@@ -170,6 +102,7 @@ namespace gr {
       unsigned char l1_randomize[KBCH_1_2];
       gr_complex *zigzag_interleave;
       gr_complex *dummy_randomize;
+      block_arena arena;
       gr_complex l1pre_cache[1840];
       gr_complex unmodulated[1];
       gr_complex m_bpsk[2];
@@ -191,10 +124,13 @@ namespace gr {
       const static int mux16[8];
       const static int mux64[12];
 
+      block_stats stats;
      public:
-      framemapper_cc_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband);
+      framemapper_cc_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype);
       ~framemapper_cc_impl();
 
+      int data_cells() const { return data_capacity; }
+
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
 
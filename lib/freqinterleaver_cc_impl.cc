@@ -24,22 +24,96 @@
 
 #include <gnuradio/io_signature.h>
 #include "freqinterleaver_cc_impl.h"
+#include "table_cache.h"
+#include "cell_gather.h"
+#include <gnuradio/thread/thread.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <string>
 
 namespace gr {
   namespace dvbt2 {
 
+/*
+ * The permutations depend only on the FFT size and the carrier counts,
+ * so blocks with the same configuration share one read only set.  Sets
+ * are kept for the life of the process.
+ *
+ * Cell indices are below 32768, so each table is uint16_t and holds
+ * exactly the cells of its symbol type, all six in one allocation.
+ */
+struct freq_permutations
+{
+    uint16_t *table;
+    size_t size;
+    uint16_t *Heven;
+    uint16_t *Hodd;
+    uint16_t *HevenP2;
+    uint16_t *HoddP2;
+    uint16_t *HevenFC;
+    uint16_t *HoddFC;
+    int data;
+    int p2;
+    int fc;
+
+    freq_permutations(int data, int p2, int fc)
+      : data(data), p2(p2), fc(fc)
+    {
+        size = 2 * (data + p2 + fc) * sizeof(uint16_t);
+        table = new uint16_t[2 * (data + p2 + fc)];
+        Heven = table;
+        Hodd = Heven + data;
+        HevenP2 = Hodd + data;
+        HoddP2 = HevenP2 + p2;
+        HevenFC = HoddP2 + p2;
+        HoddFC = HevenFC + fc;
+    }
+
+    /* every index of a cached set must fall inside its symbol */
+    bool
+    valid(void) const
+    {
+        for (int i = 0; i < data; i++)
+        {
+            if (Heven[i] >= data || Hodd[i] >= data)
+            {
+                return false;
+            }
+        }
+        for (int i = 0; i < p2; i++)
+        {
+            if (HevenP2[i] >= p2 || HoddP2[i] >= p2)
+            {
+                return false;
+            }
+        }
+        for (int i = 0; i < fc; i++)
+        {
+            if (HevenFC[i] >= fc || HoddFC[i] >= fc)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static gr::thread::mutex permutations_lock;
+static std::map<std::string, freq_permutations *> permutations;
+
     freqinterleaver_cc::sptr
-    freqinterleaver_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble)
+    freqinterleaver_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_processing_t processing)
     {
       return gnuradio::get_initial_sptr
-        (new freqinterleaver_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, preamble));
+        (new freqinterleaver_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, preamble, processing));
     }
 
     /*
      * The private constructor
      */
-    freqinterleaver_cc_impl::freqinterleaver_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble)
+    freqinterleaver_cc_impl::freqinterleaver_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_processing_t processing)
       : gr::sync_block("freqinterleaver_cc",
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(1, 1, sizeof(gr_complex)))
@@ -730,97 +804,130 @@ namespace gr {
                 C_FC = 0;
             }
         }
-        for (int i = 0; i < max_states; i++)
+        char key[64];
+        snprintf(key, sizeof(key), "freqinterleaver_%d_%d_%d_%d", fftsize, C_DATA, C_P2, N_FC);
+        gr::thread::scoped_lock guard(permutations_lock);
+        freq_permutations *perm = permutations[key];
+        if (perm == NULL)
         {
-            if (i == 0 || i == 1)
-            {
-                lfsr = 0;
-            }
-            else if (i == 2)
+            perm = new freq_permutations(C_DATA, C_P2, N_FC);
+            table_cache cache("%s", key);
+            if (!(cache.load() && cache.get(perm->table, perm->size) && perm->valid()))
             {
-                lfsr = 1;
-            }
-            else
-            {
-                result = 0;
-                for (int k = 0; k < xor_size; k++)
+                for (int i = 0; i < max_states; i++)
                 {
-                    result ^= (lfsr >> logic[k]) & 1;
+                    if (i == 0 || i == 1)
+                    {
+                        lfsr = 0;
+                    }
+                    else if (i == 2)
+                    {
+                        lfsr = 1;
+                    }
+                    else
+                    {
+                        result = 0;
+                        for (int k = 0; k < xor_size; k++)
+                        {
+                            result ^= (lfsr >> logic[k]) & 1;
+                        }
+                        lfsr &= pn_mask;
+                        lfsr >>= 1;
+                        lfsr |= result << (pn_degree - 1);
+                    }
+                    even = 0;
+                    odd = 0;
+                    for (int n = 0; n < pn_degree; n++)
+                    {
+                        even |= ((lfsr >> n) & 0x1) << bitpermeven[n];
+                    }
+                    for (int n = 0; n < pn_degree; n++)
+                    {
+                        odd |= ((lfsr >> n) & 0x1) << bitpermodd[n];
+                    }
+                    even = even + ((i % 2) * (max_states / 2));
+                    odd = odd + ((i % 2) * (max_states / 2));
+                    if (even < C_DATA)
+                    {
+                        perm->Heven[q_even++] = even;
+                    }
+                    if (odd < C_DATA)
+                    {
+                        perm->Hodd[q_odd++] = odd;
+                    }
+                    if (even < C_P2)
+                    {
+                        perm->HevenP2[q_evenP2++] = even;
+                    }
+                    if (odd < C_P2)
+                    {
+                        perm->HoddP2[q_oddP2++] = odd;
+                    }
+                    if (even < N_FC)
+                    {
+                        perm->HevenFC[q_evenFC++] = even;
+                    }
+                    if (odd < N_FC)
+                    {
+                        perm->HoddFC[q_oddFC++] = odd;
+                    }
                 }
-                lfsr &= pn_mask;
-                lfsr >>= 1;
-                lfsr |= result << (pn_degree - 1);
-            }
-            even = 0;
-            odd = 0;
-            for (int n = 0; n < pn_degree; n++)
-            {
-                even |= ((lfsr >> n) & 0x1) << bitpermeven[n];
-            }
-            for (int n = 0; n < pn_degree; n++)
-            {
-                odd |= ((lfsr >> n) & 0x1) << bitpermodd[n];
-            }
-            even = even + ((i % 2) * (max_states / 2));
-            odd = odd + ((i % 2) * (max_states / 2));
-            if (even < C_DATA)
-            {
-                Heven[q_even++] = even;
-            }
-            if (odd < C_DATA)
-            {
-                Hodd[q_odd++] = odd;
-            }
-            if (even < C_P2)
-            {
-                HevenP2[q_evenP2++] = even;
-            }
-            if (odd < C_P2)
-            {
-                HoddP2[q_oddP2++] = odd;
-            }
-            if (even < N_FC)
-            {
-                HevenFC[q_evenFC++] = even;
-            }
-            if (odd < N_FC)
-            {
-                HoddFC[q_oddFC++] = odd;
-            }
-        }
-        if (fftsize == gr::dvbt2::FFTSIZE_32K || fftsize == gr::dvbt2::FFTSIZE_32K_T2GI)
-        {
-            for (int j = 0; j < q_odd; j++)
-            {
-                int a;
-                a = Hodd[j];
-                Heven[a] = j;
-            }
-            for (int j = 0; j < q_oddP2; j++)
-            {
-                int a;
-                a = HoddP2[j];
-                HevenP2[a] = j;
-            }
-            for (int j = 0; j < q_oddFC; j++)
-            {
-                int a;
-                a = HoddFC[j];
-                HevenFC[a] = j;
+                if (fftsize == gr::dvbt2::FFTSIZE_32K || fftsize == gr::dvbt2::FFTSIZE_32K_T2GI)
+                {
+                    for (int j = 0; j < q_odd; j++)
+                    {
+                        int a;
+                        a = perm->Hodd[j];
+                        perm->Heven[a] = j;
+                    }
+                    for (int j = 0; j < q_oddP2; j++)
+                    {
+                        int a;
+                        a = perm->HoddP2[j];
+                        perm->HevenP2[a] = j;
+                    }
+                    for (int j = 0; j < q_oddFC; j++)
+                    {
+                        int a;
+                        a = perm->HoddFC[j];
+                        perm->HevenFC[a] = j;
+                    }
+                }
+                cache.put(perm->table, perm->size);
+                cache.store();
             }
+            permutations[key] = perm;
         }
+        Heven = perm->Heven;
+        Hodd = perm->Hodd;
+        HevenP2 = perm->HevenP2;
+        HoddP2 = perm->HoddP2;
+        HevenFC = perm->HevenFC;
+        HoddFC = perm->HoddFC;
         if (N_FC == 0)
         {
-            set_output_multiple((N_P2 * C_P2) + (numdatasyms * C_DATA));
             interleaved_items = (N_P2 * C_P2) + (numdatasyms * C_DATA);
             num_data_symbols = numdatasyms;
         }
         else
         {
-            set_output_multiple((N_P2 * C_P2) + ((numdatasyms - 1) * C_DATA) + N_FC);
             interleaved_items = (N_P2 * C_P2) + ((numdatasyms - 1) * C_DATA) + N_FC;
             num_data_symbols = numdatasyms - 1;
         }
+        num_symbols = numdatasyms + N_P2;
+        symbol_index = 0;
+        processing_mode = processing;
+        symbol_key = pmt::string_to_symbol("symbol_idx");
+        if (processing == gr::dvbt2::PROCESSING_SYMBOL)
+        {
+            /* room for the largest symbol, work() only emits whole symbols */
+            set_output_multiple(std::max(C_P2, std::max(C_DATA, N_FC)));
+        }
+        else
+        {
+            set_output_multiple(interleaved_items);
+        }
+        stats.attach(this, interleaved_items, 1);
     }
 
     /*
@@ -837,66 +944,59 @@ namespace gr {
     {
         const gr_complex *in = (const gr_complex *) input_items[0];
         gr_complex *out = (gr_complex *) output_items[0];
-        int symbol = 0;
-        int *H;
+        const uint64_t nread = nitems_read(0);
+        std::vector<tag_t> tags;
+        unsigned int t = 0;
+        int produced = 0;
+        int cells;
+        const uint16_t *H;
+        stats.begin();
 
-        for (int i = 0; i < noutput_items; i += interleaved_items)
+        if (processing_mode == gr::dvbt2::PROCESSING_SYMBOL)
         {
-            for (int j = 0; j < N_P2; j++)
+            get_tags_in_range(tags, 0, nread, nread + noutput_items, symbol_key);
+            std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
+        }
+        while (produced < noutput_items)
+        {
+            while (t < tags.size() && tags[t].offset < nread + produced)
             {
-                if ((symbol % 2) == 0)
-                {
-                    H = HevenP2;
-                }
-                else
-                {
-                    H = HoddP2;
-                }
-                for (int j = 0; j < C_P2; j++)
-                {
-                    *out++ = in[H[j]];
-                }
-                symbol++;
-                in += C_P2;
+                t++;
             }
-            for (int j = 0; j < num_data_symbols; j++)
+            if (t < tags.size() && tags[t].offset == nread + produced)
             {
-                if ((symbol % 2) == 0)
-                {
-                    H = Heven;
-                }
-                else
-                {
-                    H = Hodd;
-                }
-                for (int j = 0; j < C_DATA; j++)
-                {
-                    *out++ = in[H[j]];
-                }
-                symbol++;
-                in += C_DATA;
+                symbol_index = pmt::to_long(tags[t].value);
             }
-            if (N_FC != 0)
+            if (symbol_index < N_P2)
             {
-                if ((symbol % 2) == 0)
-                {
-                    H = HevenFC;
-                }
-                else
-                {
-                    H = HoddFC;
-                }
-                for (int j = 0; j < N_FC; j++)
-                {
-                    *out++ = in[H[j]];
-                }
-                symbol++;
-                in += N_FC;
+                cells = C_P2;
+                H = (symbol_index % 2) == 0 ? HevenP2 : HoddP2;
+            }
+            else if (N_FC != 0 && symbol_index == num_symbols - 1)
+            {
+                cells = N_FC;
+                H = (symbol_index % 2) == 0 ? HevenFC : HoddFC;
             }
+            else
+            {
+                cells = C_DATA;
+                H = (symbol_index % 2) == 0 ? Heven : Hodd;
+            }
+            if (produced + cells > noutput_items)
+            {
+                break;
+            }
+            gather_cells(out, in, H, cells);
+            out += cells;
+            in += cells;
+            produced += cells;
+            symbol_index = (symbol_index + 1) % num_symbols;
         }
 
+        stats.end(produced);
+
         // Tell runtime system how many output items we produced.
-        return noutput_items;
+        return produced;
     }
 
     const int freqinterleaver_cc_impl::bitperm1keven[9] = 
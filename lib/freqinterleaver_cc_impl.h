@@ -22,6 +22,7 @@
 #define INCLUDED_DVBT2_FREQINTERLEAVER_CC_IMPL_H
 
 #include <dvbt2/freqinterleaver_cc.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
@@ -31,12 +32,16 @@ namespace gr {
      private:
       int interleaved_items;
       int num_data_symbols;
-      int Heven[32768];
-      int Hodd[32768];
-      int HevenP2[32768];
-      int HoddP2[32768];
-      int HevenFC[32768];
-      int HoddFC[32768];
+      int num_symbols;
+      int symbol_index;
+      int processing_mode;
+      pmt::pmt_t symbol_key;
+      const uint16_t *Heven;
+      const uint16_t *Hodd;
+      const uint16_t *HevenP2;
+      const uint16_t *HoddP2;
+      const uint16_t *HevenFC;
+      const uint16_t *HoddFC;
       int N_P2;
       int C_P2;
       int N_FC;
@@ -55,8 +60,9 @@ namespace gr {
       const static int bitperm16kodd[13];
       const static int bitperm32k[14];
 
+      block_stats stats;
      public:
-      freqinterleaver_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble);
+      freqinterleaver_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_processing_t processing);
       ~freqinterleaver_cc_impl();
 
       // Where all the action really happens
@@ -25,6 +25,7 @@
 #include <gnuradio/io_signature.h>
 #include "interleaver_bb_impl.h"
 #include <stdio.h>
+#include <string.h>
 
 namespace gr {
   namespace dvbt2 {
@@ -44,103 +45,15 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(unsigned char)),
               gr::io_signature::make(1, 1, sizeof(unsigned char)))
     {
-        signal_constellation = constellation;
-        code_rate = rate;
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            frame_size = FRAME_SIZE_NORMAL;
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                case gr::dvbt2::C2_5:
-                case gr::dvbt2::C1_2:
-                    nbch = 32400;
-                    q_val = 90;
-                    break;
-                case gr::dvbt2::C3_5:
-                    nbch = 38880;
-                    q_val = 72;
-                    break;
-                case gr::dvbt2::C2_3:
-                    nbch = 43200;
-                    q_val = 60;
-                    break;
-                case gr::dvbt2::C3_4:
-                    nbch = 48600;
-                    q_val = 45;
-                    break;
-                case gr::dvbt2::C4_5:
-                    nbch = 51840;
-                    q_val = 36;
-                    break;
-                case gr::dvbt2::C5_6:
-                    nbch = 54000;
-                    q_val = 30;
-                    break;
-            }
-        }
-        else
-        {
-            frame_size = FRAME_SIZE_SHORT;
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                    nbch = 5400;
-                    q_val = 30;
-                    break;
-                case gr::dvbt2::C2_5:
-                    nbch = 6480;
-                    q_val = 27;
-                    break;
-                case gr::dvbt2::C1_2:
-                    nbch = 7200;
-                    q_val = 25;
-                    break;
-                case gr::dvbt2::C3_5:
-                    nbch = 9720;
-                    q_val = 18;
-                    break;
-                case gr::dvbt2::C2_3:
-                    nbch = 10800;
-                    q_val = 15;
-                    break;
-                case gr::dvbt2::C3_4:
-                    nbch = 11880;
-                    q_val = 12;
-                    break;
-                case gr::dvbt2::C4_5:
-                    nbch = 12600;
-                    q_val = 10;
-                    break;
-                case gr::dvbt2::C5_6:
-                    nbch = 13320;
-                    q_val = 8;
-                    break;
-            }
-        }
-        switch (constellation)
-        {
-            case gr::dvbt2::MOD_QPSK:
-                mod = 2;
-                set_output_multiple(frame_size / mod);
-                packed_items = frame_size / mod;
-                break;
-            case gr::dvbt2::MOD_16QAM:
-                mod = 4;
-                set_output_multiple(frame_size / mod);
-                packed_items = frame_size / mod;
-                break;
-            case gr::dvbt2::MOD_64QAM:
-                mod = 6;
-                set_output_multiple(frame_size / mod);
-                packed_items = frame_size / mod;
-                break;
-            case gr::dvbt2::MOD_256QAM:
-                mod = 8;
-                set_output_multiple(frame_size / mod);
-                packed_items = frame_size / mod;
-                break;
-        }
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        set_rate(rate);
+        set_constellation(constellation);
+        select_kernel();
+        modcod_key = pmt::string_to_symbol("modcod");
+        // sizes the buffers for a QPSK frame, the largest packed frame, see start()
+        set_output_multiple(frame_size / 2);
+        set_tag_propagation_policy(TPP_DONT);
+        stats.attach(this, frame_size / mod, 1);
     }
 
     /*
@@ -150,431 +63,413 @@ namespace gr {
     {
     }
 
+    /* buffers are allocated by now, run with the current constellation */
+    bool
+    interleaver_bb_impl::start()
+    {
+        set_output_multiple(frame_size / mod);
+        return true;
+    }
+
     void
     interleaver_bb_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
         ninput_items_required[0] = noutput_items * mod;
     }
 
-    int
-    interleaver_bb_impl::general_work (int noutput_items,
-                       gr_vector_int &ninput_items,
-                       gr_vector_const_void_star &input_items,
-                       gr_vector_void_star &output_items)
+void interleaver_bb_impl::set_rate(int rate)
+{
+    code_rate = rate;
+    if (frame_size == FRAME_SIZE_NORMAL)
     {
-        const unsigned char *in = (const unsigned char *) input_items[0];
-        unsigned char *out = (unsigned char *) output_items[0];
-        int consumed = 0;
-        int produced = 0;
-        int rows, offset, index;
-        unsigned int pack;
-        const int *twist;
-        const int *mux;
-
-        switch (signal_constellation)
+        switch (rate)
         {
-            case gr::dvbt2::MOD_QPSK:
-                for (int i = 0; i < noutput_items; i += packed_items)
-                {
-                    rows = frame_size / 2;
-                    if (code_rate == gr::dvbt2::C1_3 || code_rate == gr::dvbt2::C2_5)
-                    {
-                        for (int k = 0; k < nbch; k++)
-                        {
-                            tempu[k] = *in++;
-                        }
-                        for (int t = 0; t < q_val; t++)
-                        {
-                            for (int s = 0; s < 360; s++)
-                            {
-                                tempu[nbch + (360 * t) + s] = in[(q_val * s) + t];
-                            }
-                        }
-                        in = in + (q_val * 360);
-                        index = 0;
-                        for (int j = 0; j < rows; j++)
-                        {
-                            out[produced] = tempu[index++] << 1;
-                            out[produced++] |= tempu[index++];
-                            consumed += 2;
-                        }
-                    }
-                    else
-                    {
-                        for (int j = 0; j < rows; j++)
-                        {
-                            out[produced] = in[consumed++] << 1;
-                            out[produced++] |= in[consumed++];
-                        }
-                    }
-                }
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                nbch = 32400;
+                q_val = 90;
                 break;
-            case gr::dvbt2::MOD_16QAM:
-                if (frame_size == FRAME_SIZE_NORMAL)
-                {
-                    twist = &twist16n[0];
-                }
-                else
-                {
-                    twist = &twist16s[0];
-                }
-                if (code_rate == gr::dvbt2::C3_5 && frame_size == FRAME_SIZE_NORMAL)
-                {
-                    mux = &mux16_35[0];
-                }
-                else if (code_rate == gr::dvbt2::C1_3 && frame_size == FRAME_SIZE_SHORT)
-                {
-                    mux = &mux16_13[0];
-                }
-                else if (code_rate == gr::dvbt2::C2_5 && frame_size == FRAME_SIZE_SHORT)
-                {
-                    mux = &mux16_25[0];
-                }
-                else
-                {
-                    mux = &mux16[0];
-                }
-                for (int i = 0; i < noutput_items; i += packed_items)
-                {
-                    rows = frame_size / (mod * 2);
-                    const unsigned char *c1, *c2, *c3, *c4, *c5, *c6, *c7, *c8;
-                    c1 = &tempv[0];
-                    c2 = &tempv[rows];
-                    c3 = &tempv[rows * 2];
-                    c4 = &tempv[rows * 3];
-                    c5 = &tempv[rows * 4];
-                    c6 = &tempv[rows * 5];
-                    c7 = &tempv[rows * 6];
-                    c8 = &tempv[rows * 7];
-                    for (int k = 0; k < nbch; k++)
-                    {
-                        tempu[k] = *in++;
-                    }
-                    for (int t = 0; t < q_val; t++)
-                    {
-                        for (int s = 0; s < 360; s++)
-                        {
-                            tempu[nbch + (360 * t) + s] = in[(q_val * s) + t];
-                        }
-                    }
-                    in = in + (q_val * 360);
-                    index = 0;
-                    for (int col = 0; col < (mod * 2); col++)
-                    {
-                        offset = twist[col];
-                        for (int row = 0; row < rows; row++)
-                        {
-                            tempv[offset + (rows * col)] = tempu[index++];
-                            offset = (offset + 1) % rows;
-                        }
-                    }
-                    index = 0;
-                    for (int j = 0; j < rows; j++)
-                    {
-                        tempu[index++] = c1[j];
-                        tempu[index++] = c2[j];
-                        tempu[index++] = c3[j];
-                        tempu[index++] = c4[j];
-                        tempu[index++] = c5[j];
-                        tempu[index++] = c6[j];
-                        tempu[index++] = c7[j];
-                        tempu[index++] = c8[j];
-                    }
-                    index = 0;
-                    for (int d = 0; d < frame_size / (mod * 2); d++)
-                    {
-                        pack = 0;
-                        for (int e = 0; e < (mod * 2); e++)
-                        {
-                            offset = mux[e];
-                            pack |= tempu[index + offset];
-                            pack <<= 1;
-                        }
-                        pack >>= 1;
-                        out[produced++] = pack >> 4;
-                        out[produced++] = pack & 0xf;
-                        index += (mod * 2);
-                        consumed += (mod * 2);
-                    }
-                }
+            case gr::dvbt2::C3_5:
+                nbch = 38880;
+                q_val = 72;
                 break;
-            case gr::dvbt2::MOD_64QAM:
-                if (frame_size == FRAME_SIZE_NORMAL)
-                {
-                    twist = &twist64n[0];
-                }
-                else
-                {
-                    twist = &twist64s[0];
-                }
-                if (code_rate == gr::dvbt2::C3_5 && frame_size == FRAME_SIZE_NORMAL)
-                {
-                    mux = &mux64_35[0];
-                }
-                else if (code_rate == gr::dvbt2::C1_3 && frame_size == FRAME_SIZE_SHORT)
+            case gr::dvbt2::C2_3:
+                nbch = 43200;
+                q_val = 60;
+                break;
+            case gr::dvbt2::C3_4:
+                nbch = 48600;
+                q_val = 45;
+                break;
+            case gr::dvbt2::C4_5:
+                nbch = 51840;
+                q_val = 36;
+                break;
+            case gr::dvbt2::C5_6:
+                nbch = 54000;
+                q_val = 30;
+                break;
+        }
+    }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                nbch = 5400;
+                q_val = 30;
+                break;
+            case gr::dvbt2::C2_5:
+                nbch = 6480;
+                q_val = 27;
+                break;
+            case gr::dvbt2::C1_2:
+                nbch = 7200;
+                q_val = 25;
+                break;
+            case gr::dvbt2::C3_5:
+                nbch = 9720;
+                q_val = 18;
+                break;
+            case gr::dvbt2::C2_3:
+                nbch = 10800;
+                q_val = 15;
+                break;
+            case gr::dvbt2::C3_4:
+                nbch = 11880;
+                q_val = 12;
+                break;
+            case gr::dvbt2::C4_5:
+                nbch = 12600;
+                q_val = 10;
+                break;
+            case gr::dvbt2::C5_6:
+                nbch = 13320;
+                q_val = 8;
+                break;
+        }
+    }
+}
+
+void interleaver_bb_impl::set_constellation(int constellation)
+{
+    signal_constellation = constellation;
+    switch (constellation)
+    {
+        case gr::dvbt2::MOD_QPSK:
+            mod = 2;
+            packed_items = frame_size / mod;
+            break;
+        case gr::dvbt2::MOD_16QAM:
+            mod = 4;
+            packed_items = frame_size / mod;
+            break;
+        case gr::dvbt2::MOD_64QAM:
+            mod = 6;
+            packed_items = frame_size / mod;
+            break;
+        case gr::dvbt2::MOD_256QAM:
+            mod = 8;
+            packed_items = frame_size / mod;
+            break;
+    }
+}
+
+/*
+ * Parity interleave one FECFRAME into tempu.
+ */
+template <int NBCH, int Q>
+static inline void
+parity_interleave(const unsigned char *in, unsigned char *tempu)
+{
+    memcpy(tempu, in, NBCH);
+    for (int t = 0; t < Q; t++)
+    {
+        for (int s = 0; s < 360; s++)
+        {
+            tempu[NBCH + (360 * t) + s] = in[NBCH + (Q * s) + t];
+        }
+    }
+}
+
+/*
+ * QPSK has no column twist, only the short 1/3 and 2/5 codes are
+ * parity interleaved.
+ */
+template <int FRAME, int NBCH, int Q, bool PARITY>
+static void
+interleave_qpsk(const unsigned char *in, unsigned char *out, unsigned char *tempu, unsigned char *, const int *, const int *)
+{
+    const unsigned char *src = in;
+
+    if (PARITY)
+    {
+        parity_interleave<NBCH, Q>(in, tempu);
+        src = tempu;
+    }
+    for (int j = 0; j < FRAME / 2; j++)
+    {
+        out[j] = (src[2 * j] << 1) | src[(2 * j) + 1];
+    }
+}
+
+/*
+ * Parity interleaving, the column twist interleaver with COLS columns
+ * and the bit to cell demux for MOD bit cells.  Each row of the
+ * interleaver is read straight through the demux table into
+ * COLS / MOD cells.
+ */
+template <int FRAME, int NBCH, int Q, int COLS, int MOD>
+static void
+interleave_qam(const unsigned char *in, unsigned char *out, unsigned char *tempu, unsigned char *tempv, const int *twist, const int *mux)
+{
+    const int rows = FRAME / COLS;
+    const int cells = COLS / MOD;
+    const unsigned char *u = tempu;
+    unsigned int pack;
+    int offset;
+
+    parity_interleave<NBCH, Q>(in, tempu);
+    for (int col = 0; col < COLS; col++)
+    {
+        unsigned char *column = &tempv[rows * col];
+        offset = twist[col];
+        for (int row = 0; row < rows; row++)
+        {
+            column[offset] = *u++;
+            if (++offset == rows)
+            {
+                offset = 0;
+            }
+        }
+    }
+    for (int row = 0; row < rows; row++)
+    {
+        pack = 0;
+        for (int e = 0; e < COLS; e++)
+        {
+            pack = (pack << 1) | tempv[(rows * mux[e]) + row];
+        }
+        for (int n = cells - 1; n >= 0; n--)
+        {
+            *out++ = (pack >> (MOD * n)) & ((1 << MOD) - 1);
+        }
+    }
+}
+
+#define KERNELS_NORMAL(N, Q, P) \
+    { interleave_qpsk<FRAME_SIZE_NORMAL, N, Q, P>, \
+      interleave_qam<FRAME_SIZE_NORMAL, N, Q, 8, 4>, \
+      interleave_qam<FRAME_SIZE_NORMAL, N, Q, 12, 6>, \
+      interleave_qam<FRAME_SIZE_NORMAL, N, Q, 16, 8> }
+
+#define KERNELS_SHORT(N, Q, P) \
+    { interleave_qpsk<FRAME_SIZE_SHORT, N, Q, P>, \
+      interleave_qam<FRAME_SIZE_SHORT, N, Q, 8, 4>, \
+      interleave_qam<FRAME_SIZE_SHORT, N, Q, 12, 6>, \
+      interleave_qam<FRAME_SIZE_SHORT, N, Q, 8, 8> }
+
+// [frame size][code rate][constellation], C1_3 and C2_5 fall back
+// to 1/2 for normal frames.
+static const interleaver_bb_impl::interleave_kernel_t interleave_kernels[2][8][4] =
+{
+    {
+        KERNELS_NORMAL(32400, 90, false),
+        KERNELS_NORMAL(38880, 72, false),
+        KERNELS_NORMAL(43200, 60, false),
+        KERNELS_NORMAL(48600, 45, false),
+        KERNELS_NORMAL(51840, 36, false),
+        KERNELS_NORMAL(54000, 30, false),
+        KERNELS_NORMAL(32400, 90, true),
+        KERNELS_NORMAL(32400, 90, true)
+    },
+    {
+        KERNELS_SHORT(7200, 25, false),
+        KERNELS_SHORT(9720, 18, false),
+        KERNELS_SHORT(10800, 15, false),
+        KERNELS_SHORT(11880, 12, false),
+        KERNELS_SHORT(12600, 10, false),
+        KERNELS_SHORT(13320, 8, false),
+        KERNELS_SHORT(5400, 30, true),
+        KERNELS_SHORT(6480, 27, true)
+    }
+};
+
+void interleaver_bb_impl::select_kernel(void)
+{
+    int normal = frame_size == FRAME_SIZE_NORMAL;
+
+    interleave_kernel = interleave_kernels[normal ? 0 : 1][code_rate][signal_constellation];
+    twist = NULL;
+    mux = NULL;
+    switch (signal_constellation)
+    {
+        case gr::dvbt2::MOD_16QAM:
+            twist = normal ? twist16n : twist16s;
+            if (code_rate == gr::dvbt2::C3_5 && normal)
+            {
+                mux = mux16_35;
+            }
+            else if (code_rate == gr::dvbt2::C1_3 && !normal)
+            {
+                mux = mux16_13;
+            }
+            else if (code_rate == gr::dvbt2::C2_5 && !normal)
+            {
+                mux = mux16_25;
+            }
+            else
+            {
+                mux = mux16;
+            }
+            break;
+        case gr::dvbt2::MOD_64QAM:
+            twist = normal ? twist64n : twist64s;
+            if (code_rate == gr::dvbt2::C3_5 && normal)
+            {
+                mux = mux64_35;
+            }
+            else if (code_rate == gr::dvbt2::C1_3 && !normal)
+            {
+                mux = mux64_13;
+            }
+            else if (code_rate == gr::dvbt2::C2_5 && !normal)
+            {
+                mux = mux64_25;
+            }
+            else
+            {
+                mux = mux64;
+            }
+            break;
+        case gr::dvbt2::MOD_256QAM:
+            if (normal)
+            {
+                twist = twist256n;
+                if (code_rate == gr::dvbt2::C3_5)
                 {
-                    mux = &mux64_13[0];
+                    mux = mux256_35;
                 }
-                else if (code_rate == gr::dvbt2::C2_5 && frame_size == FRAME_SIZE_SHORT)
+                else if (code_rate == gr::dvbt2::C2_3)
                 {
-                    mux = &mux64_25[0];
+                    mux = mux256_23;
                 }
                 else
                 {
-                    mux = &mux64[0];
+                    mux = mux256;
                 }
-                for (int i = 0; i < noutput_items; i += packed_items)
+            }
+            else
+            {
+                twist = twist256s;
+                if (code_rate == gr::dvbt2::C1_3)
                 {
-                    rows = frame_size / (mod * 2);
-                    const unsigned char *c1, *c2, *c3, *c4, *c5, *c6, *c7, *c8, *c9, *c10, *c11, *c12;
-                    c1 = &tempv[0];
-                    c2 = &tempv[rows];
-                    c3 = &tempv[rows * 2];
-                    c4 = &tempv[rows * 3];
-                    c5 = &tempv[rows * 4];
-                    c6 = &tempv[rows * 5];
-                    c7 = &tempv[rows * 6];
-                    c8 = &tempv[rows * 7];
-                    c9 = &tempv[rows * 8];
-                    c10 = &tempv[rows * 9];
-                    c11 = &tempv[rows * 10];
-                    c12 = &tempv[rows * 11];
-                    for (int k = 0; k < nbch; k++)
-                    {
-                        tempu[k] = *in++;
-                    }
-                    for (int t = 0; t < q_val; t++)
-                    {
-                        for (int s = 0; s < 360; s++)
-                        {
-                            tempu[nbch + (360 * t) + s] = in[(q_val * s) + t];
-                        }
-                    }
-                    in = in + (q_val * 360);
-                    index = 0;
-                    for (int col = 0; col < (mod * 2); col++)
-                    {
-                        offset = twist[col];
-                        for (int row = 0; row < rows; row++)
-                        {
-                            tempv[offset + (rows * col)] = tempu[index++];
-                            offset = (offset + 1) % rows;
-                        }
-                    }
-                    index = 0;
-                    for (int j = 0; j < rows; j++)
-                    {
-                        tempu[index++] = c1[j];
-                        tempu[index++] = c2[j];
-                        tempu[index++] = c3[j];
-                        tempu[index++] = c4[j];
-                        tempu[index++] = c5[j];
-                        tempu[index++] = c6[j];
-                        tempu[index++] = c7[j];
-                        tempu[index++] = c8[j];
-                        tempu[index++] = c9[j];
-                        tempu[index++] = c10[j];
-                        tempu[index++] = c11[j];
-                        tempu[index++] = c12[j];
-                    }
-                    index = 0;
-                    for (int d = 0; d < frame_size / (mod * 2); d++)
-                    {
-                        pack = 0;
-                        for (int e = 0; e < (mod * 2); e++)
-                        {
-                            offset = mux[e];
-                            pack |= tempu[index + offset];
-                            pack <<= 1;
-                        }
-                        pack >>= 1;
-                        out[produced++] = pack >> 6;
-                        out[produced++] = pack & 0x3f;
-                        index += (mod * 2);
-                        consumed += (mod * 2);
-                    }
+                    mux = mux256s_13;
                 }
-                break;
-            case gr::dvbt2::MOD_256QAM:
-                if (frame_size == FRAME_SIZE_NORMAL)
+                else if (code_rate == gr::dvbt2::C2_5)
                 {
-                    if (code_rate == gr::dvbt2::C3_5)
-                    {
-                        mux = &mux256_35[0];
-                    }
-                    else if (code_rate == gr::dvbt2::C2_3)
-                    {
-                        mux = &mux256_23[0];
-                    }
-                    else
-                    {
-                        mux = &mux256[0];
-                    }
-                    for (int i = 0; i < noutput_items; i += packed_items)
-                    {
-                        rows = frame_size / (mod * 2);
-                        const unsigned char *c1, *c2, *c3, *c4, *c5, *c6, *c7, *c8;
-                        const unsigned char *c9, *c10, *c11, *c12, *c13, *c14, *c15, *c16;
-                        c1 = &tempv[0];
-                        c2 = &tempv[rows];
-                        c3 = &tempv[rows * 2];
-                        c4 = &tempv[rows * 3];
-                        c5 = &tempv[rows * 4];
-                        c6 = &tempv[rows * 5];
-                        c7 = &tempv[rows * 6];
-                        c8 = &tempv[rows * 7];
-                        c9 = &tempv[rows * 8];
-                        c10 = &tempv[rows * 9];
-                        c11 = &tempv[rows * 10];
-                        c12 = &tempv[rows * 11];
-                        c13 = &tempv[rows * 12];
-                        c14 = &tempv[rows * 13];
-                        c15 = &tempv[rows * 14];
-                        c16 = &tempv[rows * 15];
-                        for (int k = 0; k < nbch; k++)
-                        {
-                            tempu[k] = *in++;
-                        }
-                        for (int t = 0; t < q_val; t++)
-                        {
-                            for (int s = 0; s < 360; s++)
-                            {
-                                tempu[nbch + (360 * t) + s] = in[(q_val * s) + t];
-                            }
-                        }
-                        in = in + (q_val * 360);
-                        index = 0;
-                        for (int col = 0; col < (mod * 2); col++)
-                        {
-                            offset = twist256n[col];
-                            for (int row = 0; row < rows; row++)
-                            {
-                                tempv[offset + (rows * col)] = tempu[index++];
-                                offset = (offset + 1) % rows;
-                            }
-                        }
-                        index = 0;
-                        for (int j = 0; j < rows; j++)
-                        {
-                            tempu[index++] = c1[j];
-                            tempu[index++] = c2[j];
-                            tempu[index++] = c3[j];
-                            tempu[index++] = c4[j];
-                            tempu[index++] = c5[j];
-                            tempu[index++] = c6[j];
-                            tempu[index++] = c7[j];
-                            tempu[index++] = c8[j];
-                            tempu[index++] = c9[j];
-                            tempu[index++] = c10[j];
-                            tempu[index++] = c11[j];
-                            tempu[index++] = c12[j];
-                            tempu[index++] = c13[j];
-                            tempu[index++] = c14[j];
-                            tempu[index++] = c15[j];
-                            tempu[index++] = c16[j];
-                        }
-                        index = 0;
-                        for (int d = 0; d < frame_size / (mod * 2); d++)
-                        {
-                            pack = 0;
-                            for (int e = 0; e < (mod * 2); e++)
-                            {
-                                offset = mux[e];
-                                pack |= tempu[index + offset];
-                                pack <<= 1;
-                            }
-                            pack >>= 1;
-                            out[produced++] = pack >> 8;
-                            out[produced++] = pack & 0xff;
-                            index += (mod * 2);
-                            consumed += (mod * 2);
-                        }
-                    }
+                    mux = mux256s_25;
                 }
                 else
                 {
-                    if (code_rate == gr::dvbt2::C1_3)
-                    {
-                        mux = &mux256s_13[0];
-                    }
-                    else if (code_rate == gr::dvbt2::C2_5)
-                    {
-                        mux = &mux256s_25[0];
-                    }
-                    else
-                    {
-                        mux = &mux256s[0];
-                    }
-                    for (int i = 0; i < noutput_items; i += packed_items)
-                    {
-                        rows = frame_size / mod;
-                        const unsigned char *c1, *c2, *c3, *c4, *c5, *c6, *c7, *c8;
-                        c1 = &tempv[0];
-                        c2 = &tempv[rows];
-                        c3 = &tempv[rows * 2];
-                        c4 = &tempv[rows * 3];
-                        c5 = &tempv[rows * 4];
-                        c6 = &tempv[rows * 5];
-                        c7 = &tempv[rows * 6];
-                        c8 = &tempv[rows * 7];
-                        for (int k = 0; k < nbch; k++)
-                        {
-                            tempu[k] = *in++;
-                        }
-                        for (int t = 0; t < q_val; t++)
-                        {
-                            for (int s = 0; s < 360; s++)
-                            {
-                                tempu[nbch + (360 * t) + s] = in[(q_val * s) + t];
-                            }
-                        }
-                        in = in + (q_val * 360);
-                        index = 0;
-                        for (int col = 0; col < mod; col++)
-                        {
-                            offset = twist256s[col];
-                            for (int row = 0; row < rows; row++)
-                            {
-                                tempv[offset + (rows * col)] = tempu[index++];
-                                offset = (offset + 1) % rows;
-                            }
-                        }
-                        index = 0;
-                        for (int j = 0; j < rows; j++)
-                        {
-                            tempu[index++] = c1[j];
-                            tempu[index++] = c2[j];
-                            tempu[index++] = c3[j];
-                            tempu[index++] = c4[j];
-                            tempu[index++] = c5[j];
-                            tempu[index++] = c6[j];
-                            tempu[index++] = c7[j];
-                            tempu[index++] = c8[j];
-                        }
-                        index = 0;
-                        for (int d = 0; d < frame_size / mod; d++)
-                        {
-                            pack = 0;
-                            for (int e = 0; e < mod; e++)
-                            {
-                                offset = mux[e];
-                                pack |= tempu[index + offset];
-                                pack <<= 1;
-                            }
-                            pack >>= 1;
-                            out[produced++] = pack & 0xff;
-                            index += mod;
-                            consumed += mod;
-                        }
-                    }
+                    mux = mux256s;
                 }
-                break;
+            }
+            break;
+    }
+}
+
+void interleaver_bb_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+
+    if (pmt::dict_has_key(modcod, rate_key))
+    {
+        set_rate(pmt::to_long(pmt::dict_ref(modcod, rate_key, pmt::PMT_NIL)));
+    }
+    if (pmt::dict_has_key(modcod, constellation_key))
+    {
+        set_constellation(pmt::to_long(pmt::dict_ref(modcod, constellation_key, pmt::PMT_NIL)));
+    }
+    select_kernel();
+    set_output_multiple(frame_size / mod);
+    stats.set_frame_items(frame_size / mod);
+}
+
+/*
+ * Both the code rate (parity interleaving, column twist) and the
+ * constellation (demux) can change at a "modcod" tag.  Input is only
+ * consumed up to the next tag, so one call uses one set of tables.
+ */
+int interleaver_bb_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
+}
+
+    int
+    interleaver_bb_impl::general_work (int noutput_items,
+                       gr_vector_int &ninput_items,
+                       gr_vector_const_void_star &input_items,
+                       gr_vector_void_star &output_items)
+    {
+        int available = modcod_run(ninput_items[0]);
+        int frames = noutput_items / packed_items;
+        if (frames > available / frame_size)
+        {
+            frames = available / frame_size;
+        }
+        noutput_items = frames * packed_items;
+
+        const unsigned char *in = (const unsigned char *) input_items[0];
+        unsigned char *out = (unsigned char *) output_items[0];
+        int consumed = 0;
+        stats.begin();
+
+        for (int i = 0; i < noutput_items; i += packed_items)
+        {
+            interleave_kernel(in, out, tempu, tempv, twist, mux);
+            in += frame_size;
+            out += packed_items;
+            consumed += frame_size;
+        }
+
+        std::vector<tag_t> tags;
+        const uint64_t nread = nitems_read(0);
+        const uint64_t nwritten = nitems_written(0);
+        uint64_t rel;
+
+        // Map FEC frame tags onto the output frame with the same index.
+        get_tags_in_range(tags, 0, nread, nread + consumed);
+        for (unsigned int t = 0; t < tags.size(); t++)
+        {
+            rel = tags[t].offset - nread;
+            add_item_tag(0, nwritten + (rel / mod), tags[t].key, tags[t].value, tags[t].srcid);
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
         consume_each (consumed);
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
@@ -22,12 +22,16 @@
 #define INCLUDED_DVBT2_INTERLEAVER_BB_IMPL_H
 
 #include <dvbt2/interleaver_bb.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
 
     class interleaver_bb_impl : public interleaver_bb
     {
+     public:
+      typedef void (*interleave_kernel_t)(const unsigned char *, unsigned char *, unsigned char *, unsigned char *, const int *, const int *);
+
      private:
       int frame_size;
       int signal_constellation;
@@ -36,6 +40,15 @@ namespace gr {
       int q_val;
       int mod;
       int packed_items;
+      interleave_kernel_t interleave_kernel;
+      const int *twist;
+      const int *mux;
+      void select_kernel(void);
+      pmt::pmt_t modcod_key;
+      void set_rate(int);
+      void set_constellation(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
       unsigned char tempu[FRAME_SIZE_NORMAL];
       unsigned char tempv[FRAME_SIZE_NORMAL];
 
@@ -64,9 +77,11 @@ namespace gr {
       const static int mux256s_13[8];
       const static int mux256s_25[8];
 
+      block_stats stats;
      public:
       interleaver_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation);
       ~interleaver_bb_impl();
+      bool start();
 
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
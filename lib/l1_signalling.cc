@@ -0,0 +1,532 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "l1_signalling.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+namespace gr {
+  namespace dvbt2 {
+
+    l1_signalling::l1_signalling()
+      : countdown(0),
+        queue_pending(FALSE)
+    {
+        pending = pmt::make_dict();
+        queued = pmt::make_dict();
+    }
+
+    void
+    l1_signalling::init(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype)
+    {
+        L1Pre *l1preinit = &current.l1pre_data;
+        L1Post *l1postinit = &current.l1post_data;
+        int N_P2, eta_mod;
+        int N_punc_temp, N_post_temp;
+        fef_present = FALSE;    /* for testing only */
+        fef_length = 134144;    /*  "     "     "   */
+        fef_interval = 1;       /*  "     "     "   */
+        if (payloadtype == gr::dvbt2::PAYLOAD_TS)
+        {
+            l1preinit->type = gr::dvbt2::STREAMTYPE_TS;
+        }
+        else
+        {
+            l1preinit->type = gr::dvbt2::STREAMTYPE_GS;
+        }
+        l1preinit->bwt_ext = carriermode;
+        l1preinit->s1 = preamble;
+        l1preinit->s2 = fftsize & 0x7;
+        l1preinit->l1_repetition_flag = FALSE;
+        l1preinit->guard_interval = guardinterval;
+        l1preinit->papr = paprmode;
+        l1preinit->l1_mod = l1constellation;
+        l1preinit->l1_cod = 0;
+        l1preinit->l1_fec_type = 0;
+        if (fef_present == FALSE)
+        {
+            l1preinit->l1_post_info_size = KSIG_POST - 32;
+        }
+        else
+        {
+            l1preinit->l1_post_info_size = KSIG_POST + 34 - 32;
+        }
+        l1preinit->pilot_pattern = pilotpattern;
+        l1preinit->tx_id_availability = 0;
+        l1preinit->cell_id = 0;
+        l1preinit->network_id = 0x3085;
+        l1preinit->t2_system_id = 0x8001;
+        l1preinit->num_t2_frames = t2frames;
+        l1preinit->num_data_symbols = numdatasyms;
+        l1preinit->regen_flag = FALSE;
+        l1preinit->l1_post_extension = FALSE;
+        l1preinit->num_rf = 1;
+        l1preinit->current_rf_index = 0;
+        l1preinit->t2_version = version;
+        if (version == gr::dvbt2::VERSION_131)
+        {
+            l1preinit->l1_post_scrambled = l1scrambled;
+        }
+        else
+        {
+            l1preinit->l1_post_scrambled = FALSE;
+        }
+        l1preinit->t2_base_lite = FALSE;
+        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1preinit->reserved = 0xf;
+        }
+        else
+        {
+            l1preinit->reserved = 0x0;
+        }
+
+        l1postinit->sub_slices_per_frame = 1;
+        l1postinit->num_plp = 1;
+        l1postinit->num_aux = 0;
+        l1postinit->aux_config_rfu = 0;
+        l1postinit->rf_idx = 0;
+        l1postinit->frequency = 729833333;
+        l1postinit->plp_id = 0;
+        l1postinit->plp_type = 1;
+        l1postinit->plp_payload_type = payloadtype;
+        l1postinit->ff_flag = 0;
+        l1postinit->first_rf_idx = 0;
+        l1postinit->first_frame_idx = 0;
+        if (fef_present == FALSE)
+        {
+            l1postinit->plp_group_id = 1;
+        }
+        else
+        {
+            l1postinit->plp_group_id = 0;
+        }
+        l1postinit->plp_cod = rate;
+        l1postinit->plp_mod = constellation;
+        l1postinit->plp_rotation = rotation;
+        l1postinit->plp_fec_type = framesize;
+        l1postinit->plp_num_blocks_max = fecblocks;
+        l1postinit->frame_interval = 1;
+        l1postinit->time_il_length = tiblocks;
+        l1postinit->time_il_type = 0;
+        l1postinit->in_band_a_flag = 0;
+        if (inband == gr::dvbt2::INBAND_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1postinit->in_band_b_flag = 1;
+        }
+        else
+        {
+            l1postinit->in_band_b_flag = 0;
+        }
+        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1postinit->reserved_1 = 0x7ff;
+        }
+        else
+        {
+            l1postinit->reserved_1 = 0x0;
+        }
+        if (version == gr::dvbt2::VERSION_111)
+        {
+            l1postinit->plp_mode = 0;
+        }
+        else
+        {
+            l1postinit->plp_mode = inputmode + 1;
+        }
+        if (fef_present == FALSE)
+        {
+            l1postinit->static_flag = 0;
+            l1postinit->static_padding_flag = 0;    /* fix */
+        }
+        else
+        {
+            l1postinit->static_flag = 1;
+            l1postinit->static_padding_flag = 1;
+        }
+        l1postinit->fef_length_msb = 0;
+        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1postinit->reserved_2 = 0x3fffffff;
+        }
+        else
+        {
+            l1postinit->reserved_2 = 0;
+        }
+        l1postinit->frame_idx = 0;
+        l1postinit->sub_slice_interval = 0;
+        l1postinit->type_2_start = 0;
+        l1postinit->l1_change_counter = 0;
+        l1postinit->start_rf_idx = 0;
+        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1postinit->reserved_3 = 0xff;
+        }
+        else
+        {
+            l1postinit->reserved_3 = 0;
+        }
+        l1postinit->plp_id_dynamic = 0;
+        l1postinit->plp_start = 0;
+        l1postinit->plp_num_blocks = fecblocks;
+        if (reservedbiasbits == gr::dvbt2::RESERVED_ON && version == gr::dvbt2::VERSION_131)
+        {
+            l1postinit->reserved_4 = 0xff;
+            l1postinit->reserved_5 = 0xff;
+        }
+        else
+        {
+            l1postinit->reserved_4 = 0;
+            l1postinit->reserved_5 = 0;
+        }
+
+        switch (fftsize)
+        {
+            case gr::dvbt2::FFTSIZE_1K:
+                N_P2 = 16;
+                break;
+            case gr::dvbt2::FFTSIZE_2K:
+                N_P2 = 8;
+                break;
+            case gr::dvbt2::FFTSIZE_4K:
+                N_P2 = 4;
+                break;
+            case gr::dvbt2::FFTSIZE_8K:
+            case gr::dvbt2::FFTSIZE_8K_T2GI:
+                N_P2 = 2;
+                break;
+            default:
+                N_P2 = 1;
+                break;
+        }
+        switch (l1constellation)
+        {
+            case gr::dvbt2::L1_MOD_BPSK:
+                eta_mod = 1;
+                break;
+            case gr::dvbt2::L1_MOD_QPSK:
+                eta_mod = 2;
+                break;
+            case gr::dvbt2::L1_MOD_16QAM:
+                eta_mod = 4;
+                break;
+            default:
+                eta_mod = 6;
+                break;
+        }
+        if (fef_present == FALSE)
+        {
+            N_punc_temp = (6 * (KBCH_1_2 - KSIG_POST)) / 5;
+            N_post_temp = KSIG_POST + NBCH_PARITY + 9000 - N_punc_temp;
+        }
+        else
+        {
+            N_punc_temp = (6 * (KBCH_1_2 - (KSIG_POST + 34))) / 5;
+            N_post_temp = (KSIG_POST + 34) + NBCH_PARITY + 9000 - N_punc_temp;
+        }
+        if (N_P2 == 1)
+        {
+            N_post = ceil((float)N_post_temp / (2 * (float)eta_mod)) * 2 * eta_mod;
+        }
+        else
+        {
+            N_post = ceil((float)N_post_temp / ((float)eta_mod * (float)N_P2)) * eta_mod * N_P2;
+        }
+        N_punc = N_punc_temp - (N_post - N_post_temp);
+        l1preinit->l1_post_size = N_post / eta_mod;
+    }
+
+    int *
+    l1_signalling::field(int index)
+    {
+        return (int *)((char *)&current + field_map[index].offset);
+    }
+
+    /*
+     * Fields received on an "l1" port, for example from a T2-MI
+     * stream, take effect with the next frame.  Fields that follow
+     * from the frame structure must match.  Returns TRUE when the
+     * coded L1-pre has to be rebuilt.
+     */
+    int
+    l1_signalling::set(pmt::pmt_t msg)
+    {
+        pmt::pmt_t key, value;
+        int mismatch = FALSE;
+        int l1pre_changed = FALSE;
+
+        if (!pmt::is_dict(msg))
+        {
+            return FALSE;
+        }
+        for (int i = 0; i < 54; i++)
+        {
+            key = pmt::intern(field_map[i].name);
+            if (!pmt::dict_has_key(msg, key))
+            {
+                continue;
+            }
+            value = pmt::dict_ref(msg, key, pmt::PMT_NIL);
+            if (field_map[i].fixed == TRUE)
+            {
+                /* these change the frame structure and can't follow the message */
+                if (*field(i) != (int)pmt::to_long(value))
+                {
+                    mismatch = TRUE;
+                }
+            }
+            else if (*field(i) != (int)pmt::to_long(value))
+            {
+                *field(i) = pmt::to_long(value);
+                if (field_map[i].offset < (int)sizeof(L1Pre))
+                {
+                    l1pre_changed = TRUE;
+                }
+            }
+        }
+        if (mismatch == TRUE)
+        {
+            printf("L1 signalling does not match the block configuration!\n");
+        }
+        return l1pre_changed;
+    }
+
+    /*
+     * Network reconfiguration.  Fields received on "l1update" are held
+     * back until L1_CHANGE_COUNTER has announced them for at least one
+     * complete superframe: the rest of the current superframe signals
+     * 2, the next one 1, and the change takes effect after it.  An
+     * update that arrives during that last superframe is queued behind
+     * the announced one.
+     */
+    void
+    l1_signalling::update(pmt::pmt_t msg)
+    {
+        pmt::pmt_t key;
+        pmt::pmt_t fields = pmt::make_dict();
+        int count = 0;
+
+        if (!pmt::is_dict(msg))
+        {
+            return;
+        }
+        for (int i = 0; i < 54; i++)
+        {
+            key = pmt::intern(field_map[i].name);
+            if (!pmt::dict_has_key(msg, key))
+            {
+                continue;
+            }
+            if (field_map[i].offset == (int)offsetof(L1Signalling, l1post_data.l1_change_counter))
+            {
+                continue;
+            }
+            if (field_map[i].fixed == TRUE)
+            {
+                printf("L1 field %s is set by the frame structure and can't be updated.\n", field_map[i].name);
+                continue;
+            }
+            fields = pmt::dict_add(fields, key, pmt::dict_ref(msg, key, pmt::PMT_NIL));
+            count++;
+        }
+        if (count == 0)
+        {
+            return;
+        }
+        if (countdown == 1)
+        {
+            queued = merge(queued, fields);
+            queue_pending = TRUE;
+        }
+        else
+        {
+            pending = merge(pending, fields);
+            countdown = 2;
+        }
+        current.l1post_data.l1_change_counter = countdown;
+    }
+
+    /*
+     * Called before the first frame of every superframe.  Returns TRUE
+     * when the coded L1-pre has to be rebuilt.
+     */
+    int
+    l1_signalling::superframe_start(void)
+    {
+        pmt::pmt_t key;
+        int value;
+        int l1pre_changed = FALSE;
+
+        if (countdown == 0)
+        {
+            return FALSE;
+        }
+        countdown--;
+        if (countdown == 0)
+        {
+            for (int i = 0; i < 54; i++)
+            {
+                key = pmt::intern(field_map[i].name);
+                if (!pmt::dict_has_key(pending, key))
+                {
+                    continue;
+                }
+                value = pmt::to_long(pmt::dict_ref(pending, key, pmt::PMT_NIL));
+                if (*field(i) != value)
+                {
+                    *field(i) = value;
+                    if (field_map[i].offset < (int)sizeof(L1Pre))
+                    {
+                        l1pre_changed = TRUE;
+                    }
+                }
+            }
+            pending = pmt::make_dict();
+            if (queue_pending == TRUE)
+            {
+                /* announced from here on for this whole superframe */
+                pending = queued;
+                queued = pmt::make_dict();
+                queue_pending = FALSE;
+                countdown = 1;
+            }
+        }
+        current.l1post_data.l1_change_counter = countdown;
+        return l1pre_changed;
+    }
+
+    /*
+     * A "modcod_announce" tag from bbheader_bb, seen at a superframe
+     * start after superframe_start().  The new PLP_COD and PLP_MOD go
+     * on air with the next superframe, so L1_CHANGE_COUNTER is 1 for
+     * all of this one.  An update still counting down from 2 is queued
+     * behind it and changes at the superframe it announced.
+     */
+    void
+    l1_signalling::announce(pmt::pmt_t modcod)
+    {
+        pmt::pmt_t rate_key = pmt::intern("rate");
+        pmt::pmt_t constellation_key = pmt::intern("constellation");
+        pmt::pmt_t fields = pmt::make_dict();
+
+        if (pmt::dict_has_key(modcod, rate_key))
+        {
+            fields = pmt::dict_add(fields, pmt::intern("plp_cod"), pmt::dict_ref(modcod, rate_key, pmt::PMT_NIL));
+        }
+        if (pmt::dict_has_key(modcod, constellation_key))
+        {
+            fields = pmt::dict_add(fields, pmt::intern("plp_mod"), pmt::dict_ref(modcod, constellation_key, pmt::PMT_NIL));
+        }
+        if (countdown == 2)
+        {
+            queued = pending;
+            queue_pending = TRUE;
+            pending = pmt::make_dict();
+        }
+        pending = merge(pending, fields);
+        countdown = 1;
+        current.l1post_data.l1_change_counter = countdown;
+    }
+
+    /* fields of both dictionaries, those in fields win */
+    pmt::pmt_t
+    l1_signalling::merge(pmt::pmt_t dict, pmt::pmt_t fields)
+    {
+        pmt::pmt_t key;
+
+        for (int i = 0; i < 54; i++)
+        {
+            key = pmt::intern(field_map[i].name);
+            if (pmt::dict_has_key(fields, key))
+            {
+                dict = pmt::dict_add(dict, key, pmt::dict_ref(fields, key, pmt::PMT_NIL));
+            }
+        }
+        return dict;
+    }
+
+#define L1_PRE(f, fixed) {#f, offsetof(L1Signalling, l1pre_data.f), fixed}
+#define L1_POST(f, fixed) {#f, offsetof(L1Signalling, l1post_data.f), fixed}
+
+const L1FieldMap l1_signalling::field_map[54] =
+{
+    L1_PRE(type, TRUE),
+    L1_PRE(bwt_ext, TRUE),
+    L1_PRE(s1, TRUE),
+    L1_PRE(s2, TRUE),
+    L1_PRE(l1_repetition_flag, TRUE),
+    L1_PRE(guard_interval, TRUE),
+    L1_PRE(papr, TRUE),
+    L1_PRE(l1_mod, TRUE),
+    L1_PRE(l1_cod, TRUE),
+    L1_PRE(l1_fec_type, TRUE),
+    L1_PRE(l1_post_size, TRUE),
+    L1_PRE(l1_post_info_size, TRUE),
+    L1_PRE(pilot_pattern, TRUE),
+    L1_PRE(tx_id_availability, FALSE),
+    L1_PRE(cell_id, FALSE),
+    L1_PRE(network_id, FALSE),
+    L1_PRE(t2_system_id, FALSE),
+    L1_PRE(num_t2_frames, TRUE),
+    L1_PRE(num_data_symbols, TRUE),
+    L1_PRE(regen_flag, FALSE),
+    L1_PRE(l1_post_extension, TRUE),
+    L1_PRE(num_rf, FALSE),
+    L1_PRE(current_rf_index, FALSE),
+    L1_PRE(t2_version, TRUE),
+    L1_PRE(l1_post_scrambled, TRUE),
+    L1_PRE(t2_base_lite, TRUE),
+    L1_PRE(reserved, FALSE),
+    L1_POST(sub_slices_per_frame, TRUE),
+    L1_POST(num_plp, TRUE),
+    L1_POST(num_aux, TRUE),
+    L1_POST(rf_idx, FALSE),
+    L1_POST(frequency, FALSE),
+    L1_POST(plp_id, FALSE),
+    L1_POST(plp_type, TRUE),
+    L1_POST(plp_payload_type, FALSE),
+    L1_POST(first_frame_idx, FALSE),
+    L1_POST(plp_group_id, FALSE),
+    L1_POST(plp_cod, TRUE),
+    L1_POST(plp_mod, TRUE),
+    L1_POST(plp_rotation, TRUE),
+    L1_POST(plp_fec_type, TRUE),
+    L1_POST(plp_num_blocks_max, TRUE),
+    L1_POST(time_il_length, TRUE),
+    L1_POST(in_band_b_flag, TRUE),
+    L1_POST(reserved_1, FALSE),
+    L1_POST(plp_mode, TRUE),
+    L1_POST(reserved_2, FALSE),
+    L1_POST(l1_change_counter, FALSE),
+    L1_POST(start_rf_idx, FALSE),
+    L1_POST(reserved_3, FALSE),
+    L1_POST(plp_id_dynamic, FALSE),
+    L1_POST(plp_num_blocks, TRUE),
+    L1_POST(reserved_4, FALSE),
+    L1_POST(reserved_5, FALSE)
+};
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
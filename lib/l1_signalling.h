@@ -0,0 +1,167 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_L1_SIGNALLING_H
+#define INCLUDED_DVBT2_L1_SIGNALLING_H
+
+#include <dvbt2/dvbt2_config.h>
+#include <pmt/pmt.h>
+
+#define KBCH_1_4 3072
+#define NBCH_1_4 3240
+#define KBCH_1_2 7032
+#define NBCH_1_2 7200
+
+#define KSIG_PRE 200
+#define KSIG_POST 350
+#define NBCH_PARITY 168
+
+typedef struct{
+    int type;
+    int bwt_ext;
+    int s1;
+    int s2;
+    int l1_repetition_flag;
+    int guard_interval;
+    int papr;
+    int l1_mod;
+    int l1_cod;
+    int l1_fec_type;
+    int l1_post_size;
+    int l1_post_info_size;
+    int pilot_pattern;
+    int tx_id_availability;
+    int cell_id;
+    int network_id;
+    int t2_system_id;
+    int num_t2_frames;
+    int num_data_symbols;
+    int regen_flag;
+    int l1_post_extension;
+    int num_rf;
+    int current_rf_index;
+    int t2_version;
+    int l1_post_scrambled;
+    int t2_base_lite;
+    int reserved;
+    int crc_32;
+}L1Pre;
+
+typedef struct{
+    int sub_slices_per_frame;
+    int num_plp;
+    int num_aux;
+    int aux_config_rfu;
+    int rf_idx;
+    int frequency;
+    int plp_id;
+    int plp_type;
+    int plp_payload_type;
+    int ff_flag;
+    int first_rf_idx;
+    int first_frame_idx;
+    int plp_group_id;
+    int plp_cod;
+    int plp_mod;
+    int plp_rotation;
+    int plp_fec_type;
+    int plp_num_blocks_max;
+    int frame_interval;
+    int time_il_length;
+    int time_il_type;
+    int in_band_a_flag;
+    int in_band_b_flag;
+    int reserved_1;
+    int plp_mode;
+    int static_flag;
+    int static_padding_flag;
+    int fef_length_msb;
+    int reserved_2;
+    int frame_idx;
+    int sub_slice_interval;
+    int type_2_start;
+    int l1_change_counter;
+    int start_rf_idx;
+    int reserved_3;
+    int plp_id_dynamic;
+    int plp_start;
+    int plp_num_blocks;
+    int reserved_4;
+    int reserved_5;
+}L1Post;
+
+typedef struct{
+   L1Pre l1pre_data;
+   L1Post l1post_data;
+}L1Signalling;
+
+typedef struct{
+    const char *name;
+    int offset;
+    int fixed;
+}L1FieldMap;
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*
+     * L1-pre and L1-post configuration of the single PLP, shared by
+     * framemapper_cc and t2mi_gateway_bb so both signal the same
+     * fields and change them at the same frames.
+     *
+     * set() changes fields at once, as received on an "l1" port.
+     * update() holds fields back, as received on an "l1update" port,
+     * and superframe_start() applies them once L1_CHANGE_COUNTER has
+     * announced them for a complete superframe.  announce() does the
+     * same for a modcod change, one superframe ahead.
+     * Fields set by the frame structure can't be changed either way.
+     */
+    class l1_signalling
+    {
+     private:
+      pmt::pmt_t pending;
+      pmt::pmt_t queued;
+      int countdown;
+      int queue_pending;
+      int *field(int);
+      pmt::pmt_t merge(pmt::pmt_t, pmt::pmt_t);
+
+      const static L1FieldMap field_map[54];
+
+     public:
+      L1Signalling current;
+      int fef_present;
+      int fef_length;
+      int fef_interval;
+      int N_post;
+      int N_punc;
+
+      l1_signalling();
+      void init(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_payloadtype_t payloadtype);
+      int set(pmt::pmt_t msg);
+      void update(pmt::pmt_t msg);
+      int superframe_start(void);
+      void announce(pmt::pmt_t modcod);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_L1_SIGNALLING_H */
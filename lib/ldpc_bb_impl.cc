@@ -24,6 +24,9 @@
 
 #include <gnuradio/io_signature.h>
 #include "ldpc_bb_impl.h"
+#include "table_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace gr {
   namespace dvbt2 {
@@ -43,81 +46,16 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(unsigned char)),
               gr::io_signature::make(1, 1, sizeof(unsigned char)))
     {
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        for (int i = 0; i < 8; i++)
         {
-            frame_size = FRAME_SIZE_NORMAL;
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                case gr::dvbt2::C2_5:
-                case gr::dvbt2::C1_2:
-                    nbch = 32400;
-                    q_val = 90;
-                    break;
-                case gr::dvbt2::C3_5:
-                    nbch = 38880;
-                    q_val = 72;
-                    break;
-                case gr::dvbt2::C2_3:
-                    nbch = 43200;
-                    q_val = 60;
-                    break;
-                case gr::dvbt2::C3_4:
-                    nbch = 48600;
-                    q_val = 45;
-                    break;
-                case gr::dvbt2::C4_5:
-                    nbch = 51840;
-                    q_val = 36;
-                    break;
-                case gr::dvbt2::C5_6:
-                    nbch = 54000;
-                    q_val = 30;
-                    break;
-            }
-        }
-        else
-        {
-            frame_size = FRAME_SIZE_SHORT;
-            switch (rate)
-            {
-                case gr::dvbt2::C1_3:
-                    nbch = 5400;
-                    q_val = 30;
-                    break;
-                case gr::dvbt2::C2_5:
-                    nbch = 6480;
-                    q_val = 27;
-                    break;
-                case gr::dvbt2::C1_2:
-                    nbch = 7200;
-                    q_val = 25;
-                    break;
-                case gr::dvbt2::C3_5:
-                    nbch = 9720;
-                    q_val = 18;
-                    break;
-                case gr::dvbt2::C2_3:
-                    nbch = 10800;
-                    q_val = 15;
-                    break;
-                case gr::dvbt2::C3_4:
-                    nbch = 11880;
-                    q_val = 12;
-                    break;
-                case gr::dvbt2::C4_5:
-                    nbch = 12600;
-                    q_val = 10;
-                    break;
-                case gr::dvbt2::C5_6:
-                    nbch = 13320;
-                    q_val = 8;
-                    break;
-            }
+            ldpc_cache[i] = NULL;
         }
-        code_rate = rate;
-        ldpc_lookup_generate();
+        set_rate(rate);
+        modcod_key = pmt::string_to_symbol("modcod");
+        set_tag_propagation_policy(TPP_DONT);
         set_output_multiple(frame_size);
+        stats.attach(this, frame_size, 1);
     }
 
     /*
@@ -125,6 +63,10 @@ namespace gr {
      */
     ldpc_bb_impl::~ldpc_bb_impl()
     {
+        for (int i = 0; i < 8; i++)
+        {
+            free(ldpc_cache[i]);
+        }
     }
 
     void
@@ -140,8 +82,8 @@ for (int row = 0; row < ROWS; row++) \
     { \
         for (int col = 1; col <= TABLE_NAME[row][0]; col++) \
         { \
-            ldpc_encode.p[index] = (TABLE_NAME[row][col] + (n * q)) % pbits; \
-            ldpc_encode.d[index] = im; \
+            ldpc_encode->p[index] = (TABLE_NAME[row][col] + (n * q)) % pbits; \
+            ldpc_encode->d[index] = im; \
             index++; \
         } \
         im++; \
@@ -180,7 +122,159 @@ void ldpc_bb_impl::ldpc_lookup_generate(void)
         if (code_rate == gr::dvbt2::C4_5) LDPC_BF(ldpc_tab_4_5S, 35);
         if (code_rate == gr::dvbt2::C5_6) LDPC_BF(ldpc_tab_5_6S, 37);
     }
-    ldpc_encode.table_length = index;
+    ldpc_encode->table_length = index;
+}
+
+/* a cached table must not index outside the frame */
+int ldpc_bb_impl::ldpc_lookup_valid(void)
+{
+    const int pbits = frame_size - nbch;
+
+    for (int j = 0; j < ldpc_encode->table_length; j++)
+    {
+        if (ldpc_encode->d[j] < 0 || ldpc_encode->d[j] >= (int)nbch ||
+            ldpc_encode->p[j] < 0 || ldpc_encode->p[j] >= pbits)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void ldpc_bb_impl::set_rate(int rate)
+{
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                nbch = 32400;
+                q_val = 90;
+                break;
+            case gr::dvbt2::C3_5:
+                nbch = 38880;
+                q_val = 72;
+                break;
+            case gr::dvbt2::C2_3:
+                nbch = 43200;
+                q_val = 60;
+                break;
+            case gr::dvbt2::C3_4:
+                nbch = 48600;
+                q_val = 45;
+                break;
+            case gr::dvbt2::C4_5:
+                nbch = 51840;
+                q_val = 36;
+                break;
+            case gr::dvbt2::C5_6:
+                nbch = 54000;
+                q_val = 30;
+                break;
+        }
+    }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                nbch = 5400;
+                q_val = 30;
+                break;
+            case gr::dvbt2::C2_5:
+                nbch = 6480;
+                q_val = 27;
+                break;
+            case gr::dvbt2::C1_2:
+                nbch = 7200;
+                q_val = 25;
+                break;
+            case gr::dvbt2::C3_5:
+                nbch = 9720;
+                q_val = 18;
+                break;
+            case gr::dvbt2::C2_3:
+                nbch = 10800;
+                q_val = 15;
+                break;
+            case gr::dvbt2::C3_4:
+                nbch = 11880;
+                q_val = 12;
+                break;
+            case gr::dvbt2::C4_5:
+                nbch = 12600;
+                q_val = 10;
+                break;
+            case gr::dvbt2::C5_6:
+                nbch = 13320;
+                q_val = 8;
+                break;
+        }
+    }
+    code_rate = rate;
+    /* parity tables are built the first time a code rate is used */
+    if (ldpc_cache[rate] == NULL)
+    {
+        ldpc_cache[rate] = (ldpc_encode_table *) malloc(sizeof(ldpc_encode_table));
+        if (ldpc_cache[rate] == NULL)
+        {
+            fprintf(stderr, "LDPC encoder malloc, Out of memory.\n");
+            exit(1);
+        }
+        ldpc_encode = ldpc_cache[rate];
+        table_cache cache("ldpc_%d_%d", frame_size, rate);
+        if (!(cache.load() &&
+              cache.get(&ldpc_encode->table_length, sizeof(int)) &&
+              ldpc_encode->table_length >= 0 && ldpc_encode->table_length <= LDPC_ENCODE_TABLE_LENGTH &&
+              cache.get(ldpc_encode->d, sizeof(int) * ldpc_encode->table_length) &&
+              cache.get(ldpc_encode->p, sizeof(int) * ldpc_encode->table_length) &&
+              ldpc_lookup_valid()))
+        {
+            ldpc_lookup_generate();
+            cache.put(&ldpc_encode->table_length, sizeof(int));
+            cache.put(ldpc_encode->d, sizeof(int) * ldpc_encode->table_length);
+            cache.put(ldpc_encode->p, sizeof(int) * ldpc_encode->table_length);
+            cache.store();
+        }
+    }
+    ldpc_encode = ldpc_cache[rate];
+}
+
+void ldpc_bb_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t rate_key = pmt::intern("rate");
+
+    if (pmt::dict_has_key(modcod, rate_key))
+    {
+        set_rate(pmt::to_long(pmt::dict_ref(modcod, rate_key, pmt::PMT_NIL)));
+    }
+}
+
+/*
+ * Apply a "modcod" tag sitting at the start of the input, and return
+ * how much input comes before the next one.
+ */
+int ldpc_bb_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
 }
 
     int
@@ -189,6 +283,13 @@ void ldpc_bb_impl::ldpc_lookup_generate(void)
                        gr_vector_const_void_star &input_items,
                        gr_vector_void_star &output_items)
     {
+        // A code rate change starts a run with its own nbch.
+        int available = modcod_run(ninput_items[0]);
+        if (noutput_items / (int)frame_size > available / (int)nbch)
+        {
+            noutput_items = (available / nbch) * frame_size;
+        }
+
         const unsigned char *in = (const unsigned char *) input_items[0];
         unsigned char *out = (unsigned char *) output_items[0];
         const unsigned char *d;
@@ -198,6 +299,7 @@ void ldpc_bb_impl::ldpc_lookup_generate(void)
         d = in;
         p = &out[nbch];
         int consumed = 0;
+        stats.begin();
 
         for (int i = 0; i < noutput_items; i += frame_size)
         {
@@ -209,9 +311,9 @@ void ldpc_bb_impl::ldpc_lookup_generate(void)
                 consumed++;
             }
             // now do the parity checking
-            for(int j = 0; j < ldpc_encode.table_length; j++)
+            for(int j = 0; j < ldpc_encode->table_length; j++)
             {
-                p[ldpc_encode.p[j]] ^= d[ldpc_encode.d[j]];
+                p[ldpc_encode->p[j]] ^= d[ldpc_encode->d[j]];
             }
             for(int j = 1; j < plen; j++)
             {
@@ -221,10 +323,25 @@ void ldpc_bb_impl::ldpc_lookup_generate(void)
             p += frame_size;
         }
 
+        std::vector<tag_t> tags;
+        const uint64_t nread = nitems_read(0);
+        const uint64_t nwritten = nitems_written(0);
+        uint64_t rel;
+
+        // Map FEC frame tags onto the output frame with the same index.
+        get_tags_in_range(tags, 0, nread, nread + consumed);
+        for (unsigned int t = 0; t < tags.size(); t++)
+        {
+            rel = tags[t].offset - nread;
+            add_item_tag(0, nwritten + ((rel / nbch) * frame_size) + (rel % nbch), tags[t].key, tags[t].value, tags[t].srcid);
+        }
+
         // Tell runtime system how many input items we consumed on
         // each input stream.
         consume_each (consumed);
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
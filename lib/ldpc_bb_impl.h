@@ -22,6 +22,7 @@
 #define INCLUDED_DVBT2_LDPC_BB_IMPL_H
 
 #include <dvbt2/ldpc_bb.h>
+#include "block_stats.h"
 
 typedef struct{
     int table_length;
@@ -41,7 +42,13 @@ namespace gr {
       unsigned int q_val;
       unsigned int table_length;
       void ldpc_lookup_generate(void);
-      ldpc_encode_table ldpc_encode;
+      int ldpc_lookup_valid(void);
+      ldpc_encode_table *ldpc_encode;
+      ldpc_encode_table *ldpc_cache[8];
+      pmt::pmt_t modcod_key;
+      void set_rate(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
 
       const static int ldpc_tab_1_2N[90][9];
       const static int ldpc_tab_3_5N[108][13];
@@ -59,6 +66,7 @@ namespace gr {
       const static int ldpc_tab_4_5S[35][4];
       const static int ldpc_tab_5_6S[37][14];
 
+      block_stats stats;
      public:
       ldpc_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate);
       ~ldpc_bb_impl();
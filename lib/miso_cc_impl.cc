@@ -24,21 +24,22 @@
 
 #include <gnuradio/io_signature.h>
 #include "miso_cc_impl.h"
+#include <algorithm>
 
 namespace gr {
   namespace dvbt2 {
 
     miso_cc::sptr
-    miso_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode)
+    miso_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_processing_t processing)
     {
       return gnuradio::get_initial_sptr
-        (new miso_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode));
+        (new miso_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, processing));
     }
 
     /*
      * The private constructor
      */
-    miso_cc_impl::miso_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode)
+    miso_cc_impl::miso_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_processing_t processing)
       : gr::sync_block("miso_cc",
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(2, 2, sizeof(gr_complex)))
@@ -588,14 +589,25 @@ namespace gr {
         }
         if (N_FC == 0)
         {
-            set_output_multiple((N_P2 * C_P2) + (numdatasyms * C_DATA));
             miso_items = (N_P2 * C_P2) + (numdatasyms * C_DATA);
         }
         else
         {
-            set_output_multiple((N_P2 * C_P2) + ((numdatasyms - 1) * C_DATA) + N_FC);
             miso_items = (N_P2 * C_P2) + ((numdatasyms - 1) * C_DATA) + N_FC;
         }
+        num_symbols = numdatasyms + N_P2;
+        symbol_index = 0;
+        processing_mode = processing;
+        symbol_key = pmt::string_to_symbol("symbol_idx");
+        if (processing == gr::dvbt2::PROCESSING_SYMBOL)
+        {
+            set_output_multiple(std::max(C_P2, std::max(C_DATA, N_FC)));
+        }
+        else
+        {
+            set_output_multiple(miso_items);
+        }
+        stats.attach(this, miso_items, 1);
     }
 
     /*
@@ -614,12 +626,47 @@ namespace gr {
         gr_complex *out1 = (gr_complex *) output_items[0];
         gr_complex *out2 = (gr_complex *) output_items[1];
         gr_complex temp1, temp2;
+        const uint64_t nread = nitems_read(0);
+        std::vector<tag_t> tags;
+        unsigned int t = 0;
+        int produced = 0;
+        int cells;
+        stats.begin();
 
-        for (int i = 0; i < noutput_items; i += miso_items)
+        if (processing_mode == gr::dvbt2::PROCESSING_SYMBOL)
         {
-            memcpy(out1, in, sizeof(gr_complex) * miso_items);
-            out1 += miso_items;
-            for (int j = 0; j < miso_items; j += 2)
+            get_tags_in_range(tags, 0, nread, nread + noutput_items, symbol_key);
+            std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
+        }
+        while (produced < noutput_items)
+        {
+            while (t < tags.size() && tags[t].offset < nread + produced)
+            {
+                t++;
+            }
+            if (t < tags.size() && tags[t].offset == nread + produced)
+            {
+                symbol_index = pmt::to_long(tags[t].value);
+            }
+            if (symbol_index < N_P2)
+            {
+                cells = C_P2;
+            }
+            else if (N_FC != 0 && symbol_index == num_symbols - 1)
+            {
+                cells = N_FC;
+            }
+            else
+            {
+                cells = C_DATA;
+            }
+            if (produced + cells > noutput_items)
+            {
+                break;
+            }
+            memcpy(out1, in, sizeof(gr_complex) * cells);
+            out1 += cells;
+            for (int j = 0; j < cells; j += 2)
             {
                 temp1 = *in++;
                 temp2 = *in++;
@@ -630,10 +677,14 @@ namespace gr {
                 out2->imag() = -temp1.imag();
                 out2++;
             }
+            produced += cells;
+            symbol_index = (symbol_index + 1) % num_symbols;
         }
 
+        stats.end(produced);
+
         // Tell runtime system how many output items we produced.
-        return noutput_items;
+        return produced;
     }
 
   } /* namespace dvbt2 */
@@ -22,6 +22,7 @@
 #define INCLUDED_DVBT2_MISO_CC_IMPL_H
 
 #include <dvbt2/miso_cc.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
@@ -30,14 +31,19 @@ namespace gr {
     {
      private:
       int miso_items;
+      int num_symbols;
+      int symbol_index;
+      int processing_mode;
+      pmt::pmt_t symbol_key;
       int N_P2;
       int C_P2;
       int N_FC;
       int C_FC;
       int C_DATA;
 
+      block_stats stats;
      public:
-      miso_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode);
+      miso_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_processing_t processing);
       ~miso_cc_impl();
 
       // Where all the action really happens
@@ -47,43 +47,10 @@ namespace gr {
         double rotation_angle;
         gr_complex m_temp[1];
         cyclic_delay = FALSE;
-        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
-        {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 32400;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 16200;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 10800;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 8100;
-                    break;
-            }
-        }
-        else
-        {
-            switch (constellation)
-            {
-                case gr::dvbt2::MOD_QPSK:
-                    cell_size = 8100;
-                    break;
-                case gr::dvbt2::MOD_16QAM:
-                    cell_size = 4050;
-                    break;
-                case gr::dvbt2::MOD_64QAM:
-                    cell_size = 2700;
-                    break;
-                case gr::dvbt2::MOD_256QAM:
-                    cell_size = 2025;
-                    break;
-            }
-        }
-        switch (constellation)
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        // Every table is built, a modcod change may select any of them.
+        for (int c = gr::dvbt2::MOD_QPSK; c <= gr::dvbt2::MOD_256QAM; c++)
+        switch (c)
         {
             case gr::dvbt2::MOD_QPSK:
                 normalization = sqrt(2);
@@ -822,8 +789,11 @@ namespace gr {
                 }
                 break;
         }
-        signal_constellation = constellation;
-        set_output_multiple(cell_size);
+        set_constellation(constellation);
+        modcod_key = pmt::string_to_symbol("modcod");
+        // sizes the buffers for QPSK, the most cells per FEC frame, see start()
+        set_output_multiple(frame_size / 2);
+        stats.attach(this, cell_size, 1);
     }
 
     /*
@@ -833,136 +803,152 @@ namespace gr {
     {
     }
 
+    /* buffers are allocated by now, run with the current constellation */
+    bool
+    modulator_bc_impl::start()
+    {
+        set_output_multiple(cell_size);
+        return true;
+    }
+
     void
     modulator_bc_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
         ninput_items_required[0] = noutput_items;
     }
 
+/*
+ * Map one FEC frame of CELLS cells.  With rotation the Q component of
+ * each cell is taken from the previous cell of the frame (cyclic Q
+ * delay).
+ */
+template <int CELLS, int MASK, bool ROTATED>
+static void
+modulate(const unsigned char *in, gr_complex *out, const gr_complex *table)
+{
+    if (!ROTATED)
+    {
+        for (int j = 0; j < CELLS; j++)
+        {
+            out[j] = table[in[j] & MASK];
+        }
+    }
+    else
+    {
+        out[0] = gr_complex(table[in[0] & MASK].real(), table[in[CELLS - 1] & MASK].imag());
+        for (int j = 1; j < CELLS; j++)
+        {
+            out[j] = gr_complex(table[in[j] & MASK].real(), table[in[j - 1] & MASK].imag());
+        }
+    }
+}
+
+#define KERNELS(FRAME) \
+    { { modulate<FRAME / 2, 0x3, false>, modulate<FRAME / 2, 0x3, true> }, \
+      { modulate<FRAME / 4, 0xf, false>, modulate<FRAME / 4, 0xf, true> }, \
+      { modulate<FRAME / 6, 0x3f, false>, modulate<FRAME / 6, 0x3f, true> }, \
+      { modulate<FRAME / 8, 0xff, false>, modulate<FRAME / 8, 0xff, true> } }
+
+// [frame size][constellation][rotation]
+static const modulator_bc_impl::modulate_kernel_t modulate_kernels[2][4][2] =
+{
+    KERNELS(FRAME_SIZE_NORMAL),
+    KERNELS(FRAME_SIZE_SHORT)
+};
+
+void modulator_bc_impl::set_constellation(int constellation)
+{
+    signal_constellation = constellation;
+    switch (constellation)
+    {
+        case gr::dvbt2::MOD_QPSK:
+            cell_size = frame_size / 2;
+            constellation_table = m_qpsk;
+            break;
+        case gr::dvbt2::MOD_16QAM:
+            cell_size = frame_size / 4;
+            constellation_table = m_16qam;
+            break;
+        case gr::dvbt2::MOD_64QAM:
+            cell_size = frame_size / 6;
+            constellation_table = m_64qam;
+            break;
+        case gr::dvbt2::MOD_256QAM:
+            cell_size = frame_size / 8;
+            constellation_table = m_256qam;
+            break;
+    }
+    modulate_kernel = modulate_kernels[frame_size == FRAME_SIZE_NORMAL ? 0 : 1][constellation][cyclic_delay ? 1 : 0];
+}
+
+void modulator_bc_impl::set_modcod(pmt::pmt_t modcod)
+{
+    pmt::pmt_t constellation_key = pmt::intern("constellation");
+
+    if (pmt::dict_has_key(modcod, constellation_key))
+    {
+        set_constellation(pmt::to_long(pmt::dict_ref(modcod, constellation_key, pmt::PMT_NIL)));
+    }
+    set_output_multiple(cell_size);
+    stats.set_frame_items(cell_size);
+}
+
+/*
+ * The cells of one FEC frame share a constellation.  A "modcod" tag on
+ * the first cell selects the table from there on; the return value
+ * stops the run at the next tag.
+ */
+int modulator_bc_impl::modcod_run(int available)
+{
+    std::vector<tag_t> tags;
+    const uint64_t nread = nitems_read(0);
+    int limit = available;
+
+    get_tags_in_range(tags, 0, nread, nread + available, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (tags[t].offset == nread)
+        {
+            set_modcod(tags[t].value);
+        }
+        else if ((int)(tags[t].offset - nread) < limit)
+        {
+            limit = tags[t].offset - nread;
+        }
+    }
+    return limit;
+}
+
     int
     modulator_bc_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
                        gr_vector_const_void_star &input_items,
                        gr_vector_void_star &output_items)
     {
+        int available = modcod_run(ninput_items[0]);
+        if (noutput_items > available)
+        {
+            noutput_items = available;
+        }
+        noutput_items -= noutput_items % cell_size;
+
         const unsigned char *in = (const unsigned char *) input_items[0];
         gr_complex *out = (gr_complex *) output_items[0];
-        const unsigned char *in_delay;
-        gr_complex f_temp[1], g_temp[1];
-        int index, index_delay;
+        stats.begin();
 
-        switch (signal_constellation)
+        for (int i = 0; i < noutput_items; i += cell_size)
         {
-            case gr::dvbt2::MOD_QPSK:
-                for (int i = 0; i < noutput_items; i += cell_size)
-                {
-                    if (cyclic_delay == FALSE)
-                    {
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            *out++ = m_qpsk[index & 0x3];
-                        }
-                    }
-                    else
-                    {
-                        in_delay = in;
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            index_delay = in_delay[(j + cell_size - 1) % cell_size];
-                            f_temp[0] = m_qpsk[index & 0x3];
-                            g_temp[0] = m_qpsk[index_delay & 0x3];
-                            f_temp[0].imag() = g_temp[0].imag();
-                            *out++ = f_temp[0];
-                        }
-                    }
-                }
-                break;
-            case gr::dvbt2::MOD_16QAM:
-                for (int i = 0; i < noutput_items; i += cell_size)
-                {
-                    if (cyclic_delay == FALSE)
-                    {
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                           index = *in++;
-                           *out++ = m_16qam[index & 0xf];
-                        }
-                    }
-                    else
-                    {
-                        in_delay = in;
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            index_delay = in_delay[(j + cell_size - 1) % cell_size];
-                            f_temp[0] = m_16qam[index & 0xf];
-                            g_temp[0] = m_16qam[index_delay & 0xf];
-                            f_temp[0].imag() = g_temp[0].imag();
-                            *out++ = f_temp[0];
-                        }
-                    }
-                }
-                break;
-            case gr::dvbt2::MOD_64QAM:
-                for (int i = 0; i < noutput_items; i += cell_size)
-                {
-                    if (cyclic_delay == FALSE)
-                    {
-                        for (int j = 0; j < noutput_items; j++)
-                        {
-                            index = *in++;
-                            *out++ = m_64qam[index & 0x3f];
-                        }
-                    }
-                    else
-                    {
-                        in_delay = in;
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            index_delay = in_delay[(j + cell_size - 1) % cell_size];
-                            f_temp[0] = m_64qam[index & 0x3f];
-                            g_temp[0] = m_64qam[index_delay & 0x3f];
-                            f_temp[0].imag() = g_temp[0].imag();
-                            *out++ = f_temp[0];
-                        }
-                    }
-                }
-                break;
-            case gr::dvbt2::MOD_256QAM:
-                for (int i = 0; i < noutput_items; i += cell_size)
-                {
-                    if (cyclic_delay == FALSE)
-                    {
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            *out++ = m_256qam[index & 0xff];
-                        }
-                    }
-                    else
-                    {
-                        in_delay = in;
-                        for (int j = 0; j < cell_size; j++)
-                        {
-                            index = *in++;
-                            index_delay = in_delay[(j + cell_size - 1) % cell_size];
-                            f_temp[0] = m_256qam[index & 0xff];
-                            g_temp[0] = m_256qam[index_delay & 0xff];
-                            f_temp[0].imag() = g_temp[0].imag();
-                            *out++ = f_temp[0];
-                        }
-                    }
-                }
-                break;
+            modulate_kernel(in, out, constellation_table);
+            in += cell_size;
+            out += cell_size;
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
         consume_each (noutput_items);
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
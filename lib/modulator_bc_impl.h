@@ -22,24 +22,37 @@
 #define INCLUDED_DVBT2_MODULATOR_BC_IMPL_H
 
 #include <dvbt2/modulator_bc.h>
+#include "block_stats.h"
 
 namespace gr {
   namespace dvbt2 {
 
     class modulator_bc_impl : public modulator_bc
     {
+     public:
+      typedef void (*modulate_kernel_t)(const unsigned char *, gr_complex *, const gr_complex *);
+
      private:
       int signal_constellation;
       int cyclic_delay;
       int cell_size;
+      int frame_size;
+      pmt::pmt_t modcod_key;
+      void set_constellation(int);
+      void set_modcod(pmt::pmt_t);
+      int modcod_run(int);
       gr_complex m_qpsk[4];
       gr_complex m_16qam[16];
       gr_complex m_64qam[64];
       gr_complex m_256qam[256];
+      const gr_complex *constellation_table;
+      modulate_kernel_t modulate_kernel;
 
+      block_stats stats;
      public:
       modulator_bc_impl(dvbt2_framesize_t framesize, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation);
       ~modulator_bc_impl();
+      bool start();
 
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
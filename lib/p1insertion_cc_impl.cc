@@ -25,23 +25,48 @@
 #include <gnuradio/io_signature.h>
 #include "p1insertion_cc_impl.h"
 #include <stdio.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace gr {
   namespace dvbt2 {
 
+    static int
+    p1_vlength(dvbt2_fftsize_t fftsize)
+    {
+      switch (fftsize) {
+        case gr::dvbt2::FFTSIZE_1K:
+          return 1024;
+        case gr::dvbt2::FFTSIZE_2K:
+          return 2048;
+        case gr::dvbt2::FFTSIZE_4K:
+          return 4096;
+        case gr::dvbt2::FFTSIZE_8K:
+        case gr::dvbt2::FFTSIZE_8K_T2GI:
+          return 8192;
+        case gr::dvbt2::FFTSIZE_16K:
+        case gr::dvbt2::FFTSIZE_16K_T2GI:
+          return 16384;
+        default:
+          return 32768;
+      }
+    }
+
     p1insertion_cc::sptr
-    p1insertion_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip)
+    p1insertion_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip, dvbt2_cyclicprefix_t cyclicprefix, dvbt2_txtime_t txtime, dvbt2_bandwidth_t bandwidth, int t2frames, double epoch)
     {
       return gnuradio::get_initial_sptr
-        (new p1insertion_cc_impl(carriermode, fftsize, guardinterval, numdatasyms, preamble, showlevels, vclip));
+        (new p1insertion_cc_impl(carriermode, fftsize, guardinterval, numdatasyms, preamble, showlevels, vclip, cyclicprefix, txtime, bandwidth, t2frames, epoch));
     }
 
     /*
      * The private constructor
      */
-    p1insertion_cc_impl::p1insertion_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip)
+    p1insertion_cc_impl::p1insertion_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip, dvbt2_cyclicprefix_t cyclicprefix, dvbt2_txtime_t txtime, dvbt2_bandwidth_t bandwidth, int t2frames, double epoch)
       : gr::block("p1insertion_cc",
-              gr::io_signature::make(1, 1, sizeof(gr_complex)),
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * (cyclicprefix == gr::dvbt2::CYCLICPREFIX_INTERNAL ? p1_vlength(fftsize) : 1)),
               gr::io_signature::make(1, 1, sizeof(gr_complex)))
     {
         int s1, s2, index = 0;
@@ -188,8 +213,21 @@ namespace gr {
             p1_timeshft[i].real() *= 1 / sqrt(384);
             p1_timeshft[i].imag() *= 1 / sqrt(384);
         }
-        frame_items = ((numdatasyms + N_P2) * fft_size) + ((numdatasyms + N_P2) * guard_interval);
+        num_symbols = numdatasyms + N_P2;
+        frame_items = (num_symbols * fft_size) + (num_symbols * guard_interval);
         insertion_items = frame_items + 2048;
+        cyclic_prefix = cyclicprefix;
+        t2frame_key = pmt::string_to_symbol("t2_frame_idx");
+        superframe_key = pmt::string_to_symbol("superframe_idx");
+        tx_time_key = pmt::string_to_symbol("tx_time");
+        tx_time_mode = txtime;
+        bandwidth_code = bandwidth;
+        t2_frames = t2frames;
+        epoch_secs = (uint64_t)floor(epoch);
+        epoch_frac = epoch - floor(epoch);
+        superframe_num = 0;
+        frame_count = 0;
+        set_tag_propagation_policy(TPP_DONT);
         set_output_multiple(frame_items + 2048);
         show_levels = showlevels;
         real_positive = 0.0;
@@ -204,24 +242,127 @@ namespace gr {
         real_negative_threshold_count = 0;
         imag_positive_threshold_count = 0;
         imag_negative_threshold_count = 0;
+        stats.attach(this, insertion_items, 1);
+    }
+
+// Fixed by the standard, one copy serves every P1 inserter.
+struct p1_randomizer_table
+{
+    int sequence[384];
+
+    p1_randomizer_table()
+    {
+        int sr = 0x4e46;
+        for (int i = 0; i < 384; i++)
+        {
+            int b = ((sr) ^ (sr >> 1)) & 1;
+            if (b == 0)
+            {
+               sequence[i] = 1;
+            }
+            else
+            {
+               sequence[i] = -1;
+            }
+            sr >>= 1;
+            if(b) sr |= 0x4000;
+        }
     }
+};
 
 void p1insertion_cc_impl::init_p1_randomizer(void)
 {
-    int sr = 0x4e46;
-    for (int i = 0; i < 384; i++)
+    static const p1_randomizer_table table;
+    p1_randomize = table.sequence;
+}
+
+/*
+ * Fold the peak levels and clip counts of one output frame into the
+ * running statistics.  The samples are treated as interleaved floats
+ * (real, imag, real, imag) so each SSE register carries two complex
+ * samples; lanes are only reduced once at the end of the frame.
+ */
+void p1insertion_cc_impl::measure_levels(const gr_complex *level, int length)
+{
+    const float *in = (const float *) level;
+    int j = 0;
+#ifdef __SSE2__
+    __m128 vmax0, vmax1, vmin0, vmin1, pthr, nthr, x0, x1;
+    __m128i pcnt, ncnt;
+    float maxs[4], mins[4];
+    int pcnts[4], ncnts[4];
+
+    vmax0 = _mm_setr_ps(real_positive, imag_positive, real_positive, imag_positive);
+    vmin0 = _mm_setr_ps(real_negative, imag_negative, real_negative, imag_negative);
+    vmax1 = vmax0;
+    vmin1 = vmin0;
+    pthr = _mm_setr_ps(real_positive_threshold, imag_positive_threshold, real_positive_threshold, imag_positive_threshold);
+    nthr = _mm_setr_ps(real_negative_threshold, imag_negative_threshold, real_negative_threshold, imag_negative_threshold);
+    pcnt = _mm_setzero_si128();
+    ncnt = _mm_setzero_si128();
+    for (; j + 4 <= length; j += 4)
+    {
+        x0 = _mm_loadu_ps(&in[j * 2]);
+        x1 = _mm_loadu_ps(&in[j * 2 + 4]);
+        vmax0 = _mm_max_ps(vmax0, x0);
+        vmax1 = _mm_max_ps(vmax1, x1);
+        vmin0 = _mm_min_ps(vmin0, x0);
+        vmin1 = _mm_min_ps(vmin1, x1);
+        /* compare masks are all ones (-1) in each lane that crosses */
+        pcnt = _mm_sub_epi32(pcnt, _mm_castps_si128(_mm_cmpgt_ps(x0, pthr)));
+        pcnt = _mm_sub_epi32(pcnt, _mm_castps_si128(_mm_cmpgt_ps(x1, pthr)));
+        ncnt = _mm_sub_epi32(ncnt, _mm_castps_si128(_mm_cmplt_ps(x0, nthr)));
+        ncnt = _mm_sub_epi32(ncnt, _mm_castps_si128(_mm_cmplt_ps(x1, nthr)));
+    }
+    _mm_storeu_ps(maxs, _mm_max_ps(vmax0, vmax1));
+    _mm_storeu_ps(mins, _mm_min_ps(vmin0, vmin1));
+    _mm_storeu_si128((__m128i *) pcnts, pcnt);
+    _mm_storeu_si128((__m128i *) ncnts, ncnt);
+    real_positive = maxs[0] > maxs[2] ? maxs[0] : maxs[2];
+    imag_positive = maxs[1] > maxs[3] ? maxs[1] : maxs[3];
+    real_negative = mins[0] < mins[2] ? mins[0] : mins[2];
+    imag_negative = mins[1] < mins[3] ? mins[1] : mins[3];
+    real_positive_threshold_count += pcnts[0] + pcnts[2];
+    imag_positive_threshold_count += pcnts[1] + pcnts[3];
+    real_negative_threshold_count += ncnts[0] + ncnts[2];
+    imag_negative_threshold_count += ncnts[1] + ncnts[3];
+#endif
+    for (; j < length; j++)
     {
-        int b = ((sr) ^ (sr >> 1)) & 1;
-        if (b == 0)
+        float re = in[j * 2];
+        float im = in[j * 2 + 1];
+        if (re > real_positive)
         {
-           p1_randomize[i] = 1;
+            real_positive = re;
         }
-        else
+        if (re < real_negative)
+        {
+            real_negative = re;
+        }
+        if (im > imag_positive)
+        {
+            imag_positive = im;
+        }
+        if (im < imag_negative)
         {
-           p1_randomize[i] = -1;
+            imag_negative = im;
+        }
+        if (re > real_positive_threshold)
+        {
+            real_positive_threshold_count++;
+        }
+        if (re < real_negative_threshold)
+        {
+            real_negative_threshold_count++;
+        }
+        if (im > imag_positive_threshold)
+        {
+            imag_positive_threshold_count++;
+        }
+        if (im < imag_negative_threshold)
+        {
+            imag_negative_threshold_count++;
         }
-        sr >>= 1;
-        if(b) sr |= 0x4000;
     }
 }
 
@@ -236,8 +377,49 @@ void p1insertion_cc_impl::init_p1_randomizer(void)
     void
     p1insertion_cc_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-        ninput_items_required[0] = frame_items * (noutput_items / insertion_items);
+        if (cyclic_prefix == gr::dvbt2::CYCLICPREFIX_INTERNAL)
+        {
+            ninput_items_required[0] = num_symbols * (noutput_items / insertion_items);
+        }
+        else
+        {
+            ninput_items_required[0] = frame_items * (noutput_items / insertion_items);
+        }
+    }
+
+void p1insertion_cc_impl::add_tx_time(uint64_t in_offset, uint64_t out_offset)
+{
+    std::vector<tag_t> tags;
+    uint64_t ticks, second, full_secs;
+    double frac_secs;
+
+    /* resync the frame count from the frame mapper tags, if present */
+    get_tags_in_range(tags, 0, in_offset, in_offset + 1, superframe_key);
+    if (tags.size() != 0)
+    {
+        superframe_num = pmt::to_uint64(tags[0].value);
+    }
+    get_tags_in_range(tags, 0, in_offset, in_offset + 1, t2frame_key);
+    if (tags.size() != 0)
+    {
+        frame_count = (superframe_num * t2_frames) + pmt::to_long(tags[0].value);
+    }
+    if (tx_time_mode == gr::dvbt2::TXTIME_ALL || out_offset == 0)
+    {
+        /* frame duration is exact in units of 1 / (1000000 * den) seconds */
+        ticks = frame_count * insertion_items * elementary_period[bandwidth_code][0];
+        second = (uint64_t)1000000 * elementary_period[bandwidth_code][1];
+        full_secs = epoch_secs + (ticks / second);
+        frac_secs = epoch_frac + ((double)(ticks % second) / second);
+        if (frac_secs >= 1.0)
+        {
+            full_secs++;
+            frac_secs -= 1.0;
+        }
+        add_item_tag(0, out_offset, tx_time_key, pmt::make_tuple(pmt::from_uint64(full_secs), pmt::from_double(frac_secs)));
     }
+    frame_count++;
+}
 
     int
     p1insertion_cc_impl::general_work (int noutput_items,
@@ -248,9 +430,19 @@ void p1insertion_cc_impl::init_p1_randomizer(void)
         const gr_complex *in = (const gr_complex *) input_items[0];
         gr_complex *out = (gr_complex *) output_items[0];
         gr_complex *level;
+        std::vector<tag_t> tags;
+        const uint64_t nread = nitems_read(0);
+        const uint64_t nwritten = nitems_written(0);
+        uint64_t rel, offset;
+        int consumed = 0;
+        stats.begin();
 
         for (int i = 0; i < noutput_items; i += insertion_items)
         {
+            if (tx_time_mode != gr::dvbt2::TXTIME_OFF)
+            {
+                add_tx_time(nread + consumed, nwritten + i);
+            }
             level = out;
             for (int j = 0; j < 542; j++)
             {
@@ -264,59 +456,77 @@ void p1insertion_cc_impl::init_p1_randomizer(void)
             {
                 *out++ = p1_timeshft[j];
             }
-            memcpy(out, in, sizeof(gr_complex) * frame_items);
-            if (show_levels == TRUE)
+            if (cyclic_prefix == gr::dvbt2::CYCLICPREFIX_INTERNAL)
             {
-                for (int j = 0; j < frame_items + 2048; j++)
+                for (int j = 0; j < num_symbols; j++)
                 {
-                    if (level[j].real() > real_positive)
-                    {
-                       real_positive = level[j].real();
-                    }
-                    if (level[j].real() < real_negative)
-                    {
-                        real_negative = level[j].real();
-                    }
-                    if (level[j].imag() > imag_positive)
-                    {
-                        imag_positive = level[j].imag();
-                    }
-                    if (level[j].imag() < imag_negative)
-                    {
-                        imag_negative = level[j].imag();
-                    }
-                    if (level[j].real() > real_positive_threshold)
-                    {
-                        real_positive_threshold_count++;
-                    }
-                    if (level[j].real() < real_negative_threshold)
-                    {
-                        real_negative_threshold_count++;
-                    }
-                    if (level[j].imag() > imag_positive_threshold)
-                    {
-                        imag_positive_threshold_count++;
-                    }
-                    if (level[j].imag() < imag_negative_threshold)
-                    {
-                        imag_negative_threshold_count++;
-                    }
+                    memcpy(out, &in[fft_size - guard_interval], sizeof(gr_complex) * guard_interval);
+                    out += guard_interval;
+                    memcpy(out, in, sizeof(gr_complex) * fft_size);
+                    out += fft_size;
+                    in += fft_size;
                 }
+                consumed += num_symbols;
+            }
+            else
+            {
+                memcpy(out, in, sizeof(gr_complex) * frame_items);
+                out += frame_items;
+                in += frame_items;
+                consumed += frame_items;
+            }
+            if (show_levels == TRUE)
+            {
+                measure_levels(level, frame_items + 2048);
                 printf("peak real = %+e, %+e, %d, %d\n", real_positive, real_negative, real_positive_threshold_count, real_negative_threshold_count);
                 printf("peak imag = %+e, %+e, %d, %d\n", imag_positive, imag_negative, imag_positive_threshold_count, imag_negative_threshold_count);
             }
-            out += frame_items;
-            in += frame_items;
+        }
+
+        // Frame tags move to the start of the P1 symbol, all other
+        // tags to the same sample of the frame after the P1 symbol.
+        get_tags_in_range(tags, 0, nread, nread + consumed);
+        for (unsigned int t = 0; t < tags.size(); t++)
+        {
+            rel = tags[t].offset - nread;
+            if (cyclic_prefix == gr::dvbt2::CYCLICPREFIX_INTERNAL)
+            {
+                offset = nwritten + ((rel / num_symbols) * insertion_items);
+                rel = (rel % num_symbols) * (fft_size + guard_interval);
+            }
+            else
+            {
+                offset = nwritten + ((rel / frame_items) * insertion_items);
+                rel = rel % frame_items;
+            }
+            if (!pmt::eq(tags[t].key, t2frame_key) && !pmt::eq(tags[t].key, superframe_key))
+            {
+                offset += 2048 + rel;
+            }
+            add_item_tag(0, offset, tags[t].key, tags[t].value, tags[t].srcid);
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
-        consume_each (frame_items);
+        consume_each (consumed);
+
+        stats.end(noutput_items);
 
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
 
+    /* elementary period T in microseconds, as numerator and denominator */
+    const int p1insertion_cc_impl::elementary_period[6][2] =
+    {
+        {71, 131},
+        {7, 40},
+        {7, 48},
+        {1, 8},
+        {7, 64},
+        {7, 80}
+    };
+
     const int p1insertion_cc_impl::p1_active_carriers[384] = 
     {
         44, 45, 47, 51, 54, 59, 62, 64, 65, 66, 70, 75, 78, 80, 81, 82, 84, 85, 87, 88, 89, 90,
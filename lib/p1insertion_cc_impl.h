@@ -22,6 +22,7 @@
 #define INCLUDED_DVBT2_P1INSERTION_CC_IMPL_H
 
 #include <dvbt2/p1insertion_cc.h>
+#include "block_stats.h"
 #include <gnuradio/fft/fft.h>
 
 namespace gr {
@@ -34,8 +35,21 @@ namespace gr {
       int guard_interval;
       int frame_items;
       int insertion_items;
+      int num_symbols;
+      int cyclic_prefix;
+      pmt::pmt_t t2frame_key;
+      pmt::pmt_t superframe_key;
+      pmt::pmt_t tx_time_key;
+      int tx_time_mode;
+      int bandwidth_code;
+      int t2_frames;
+      uint64_t epoch_secs;
+      double epoch_frac;
+      uint64_t superframe_num;
+      uint64_t frame_count;
+      void add_tx_time(uint64_t, uint64_t);
       int N_P2;
-      int p1_randomize[384];
+      const int *p1_randomize;
       int modulation_sequence[384];
       int dbpsk_modulation_sequence[385];
       gr_complex p1_freq[1024];
@@ -57,6 +71,7 @@ namespace gr {
       int real_negative_threshold_count;
       int imag_positive_threshold_count;
       int imag_negative_threshold_count;
+      void measure_levels(const gr_complex *, int);
 
       fft::fft_complex *p1_fft;
       int p1_fft_size;
@@ -64,9 +79,11 @@ namespace gr {
       const static int p1_active_carriers[384];
       const static unsigned char s1_modulation_patterns[8][8];
       const static unsigned char s2_modulation_patterns[16][32];
+      const static int elementary_period[6][2];
 
+      block_stats stats;
      public:
-      p1insertion_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip);
+      p1insertion_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_preamble_t preamble, dvbt2_showlevels_t showlevels, float vclip, dvbt2_cyclicprefix_t cyclicprefix, dvbt2_txtime_t txtime, dvbt2_bandwidth_t bandwidth, int t2frames, double epoch);
       ~p1insertion_cc_impl();
 
       // Where all the action really happens
@@ -27,24 +27,25 @@
 #include <complex.h>
 #include <volk/volk.h>
 #include <stdio.h>
+#include <algorithm>
 
 namespace gr {
   namespace dvbt2 {
 
     paprtr_cc::sptr
-    paprtr_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength)
+    paprtr_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength, dvbt2_processing_t processing)
     {
       return gnuradio::get_initial_sptr
-        (new paprtr_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, vclip, iterations, vlength));
+        (new paprtr_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, vclip, iterations, vlength, processing));
     }
 
     /*
      * The private constructor
      */
-    paprtr_cc_impl::paprtr_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength)
+    paprtr_cc_impl::paprtr_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength, dvbt2_processing_t processing)
       : gr::sync_block("paprtr_cc",
-              gr::io_signature::make(1, 1, sizeof(gr_complex) * vlength),
-              gr::io_signature::make(1, 1, sizeof(gr_complex) * vlength))
+              gr::io_signature::make(1, 2, sizeof(gr_complex) * vlength),
+              gr::io_signature::make(1, 2, sizeof(gr_complex) * vlength))
     {
         switch (fftsize)
         {
@@ -568,92 +569,31 @@ namespace gr {
         right_nulls = (vlength - C_PS) / 2;
         papr_fft_size = vlength;
         papr_fft = new fft::fft_complex(papr_fft_size, false, 1);
-        ones_freq = (gr_complex*) volk_malloc(sizeof(gr_complex) * papr_fft_size, volk_get_alignment());
-        if (ones_freq == NULL)
+        arena.add(&ones_freq, papr_fft_size);
+        arena.add(&ones_time, papr_fft_size);
+        arena.add(&c, papr_fft_size);
+        arena.add(&ctemp, papr_fft_size);
+        arena.add(&magnitude, papr_fft_size);
+        arena.add(&r, N_TR);
+        arena.add(&rNew, N_TR);
+        arena.add(&v, N_TR);
+        if (!arena.allocate())
         {
-            fprintf(stderr, "Tone reservation PAPR 1st volk_malloc, Out of memory.\n");
+            fprintf(stderr, "Tone reservation PAPR arena, Out of memory.\n");
             delete papr_fft;
             exit(1);
         }
-        ones_time = (gr_complex*) volk_malloc(sizeof(gr_complex) * papr_fft_size, volk_get_alignment());
-        if (ones_time == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 2nd volk_malloc, Out of memory.\n");
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        c = (gr_complex*) volk_malloc(sizeof(gr_complex) * papr_fft_size, volk_get_alignment());
-        if (c == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 3rd volk_malloc, Out of memory.\n");
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        ctemp = (gr_complex*) volk_malloc(sizeof(gr_complex) * papr_fft_size, volk_get_alignment());
-        if (ctemp == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 4th volk_malloc, Out of memory.\n");
-            volk_free(c);
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        magnitude = (float*) volk_malloc(sizeof(float) * papr_fft_size, volk_get_alignment());
-        if (magnitude == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 5th volk_malloc, Out of memory.\n");
-            volk_free(ctemp);
-            volk_free(c);
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        r = (gr_complex*) volk_malloc(sizeof(gr_complex) * N_TR, volk_get_alignment());
-        if (r == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 6th volk_malloc, Out of memory.\n");
-            volk_free(magnitude);
-            volk_free(ctemp);
-            volk_free(c);
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        rNew = (gr_complex*) volk_malloc(sizeof(gr_complex) * N_TR, volk_get_alignment());
-        if (rNew == NULL)
-        {
-            fprintf(stderr, "Tone reservation PAPR 7th volk_malloc, Out of memory.\n");
-            volk_free(r);
-            volk_free(magnitude);
-            volk_free(ctemp);
-            volk_free(c);
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
-        }
-        v = (gr_complex*) volk_malloc(sizeof(gr_complex) * N_TR, volk_get_alignment());
-        if (v == NULL)
+        num_symbols = numdatasyms + N_P2;
+        symbol_index = 0;
+        processing_mode = processing;
+        symbol_key = pmt::string_to_symbol("symbol_idx");
+        set_tag_propagation_policy(TPP_ONE_TO_ONE);
+        if (processing != gr::dvbt2::PROCESSING_SYMBOL)
         {
-            fprintf(stderr, "Tone reservation PAPR 8th volk_malloc, Out of memory.\n");
-            volk_free(rNew);
-            volk_free(r);
-            volk_free(magnitude);
-            volk_free(ctemp);
-            volk_free(c);
-            volk_free(ones_time);
-            volk_free(ones_freq);
-            delete papr_fft;
-            exit(1);
+            set_output_multiple(num_symbols);
         }
-        num_symbols = numdatasyms + N_P2;
-        set_output_multiple(num_symbols);
+        stats.attach(this, num_symbols, vlength);
+        iteration_counter = stats.add_counter("papr_iterations");
     }
 
     /*
@@ -661,17 +601,15 @@ namespace gr {
      */
     paprtr_cc_impl::~paprtr_cc_impl()
     {
-        volk_free(v);
-        volk_free(rNew);
-        volk_free(r);
-        volk_free(magnitude);
-        volk_free(ctemp);
-        volk_free(c);
-        volk_free(ones_time);
-        volk_free(ones_freq);
         delete papr_fft;
     }
 
+    bool
+    paprtr_cc_impl::check_topology(int ninputs, int noutputs)
+    {
+        return ninputs == noutputs;
+    }
+
 void paprtr_cc_impl::init_pilots(int symbol)
 {
     for (int i = 0; i < C_PS; i++)
@@ -735,10 +673,14 @@ void paprtr_cc_impl::init_pilots(int symbol)
 			  gr_vector_const_void_star &input_items,
 			  gr_vector_void_star &output_items)
     {
-        const gr_complex *in = (const gr_complex *) input_items[0];
-        gr_complex *out = (gr_complex *) output_items[0];
+        const gr_complex *in;
+        gr_complex *out;
+        int streams = output_items.size();
+        const uint64_t nread = nitems_read(0);
+        std::vector<tag_t> tags;
+        unsigned int t = 0;
         gr_complex zero, one;
-        int index, valid;
+        int index, valid, j;
         int L_FC = 0;
         gr_complex *dst;
         float normalization = 1.0 / N_TR;
@@ -747,6 +689,7 @@ void paprtr_cc_impl::init_pilots(int symbol)
         float aMax = 5.0 * N_TR * sqrt(10.0 / (27.0 * C_PS));
         gr_complex u, result, temp;
         double _Complex vtemp;
+        stats.begin();
 
         one.real() = 1.0;
         one.imag() = 0.0;
@@ -756,82 +699,98 @@ void paprtr_cc_impl::init_pilots(int symbol)
         {
             L_FC = 1;
         }
-        for (int i = 0; i < noutput_items; i += num_symbols)
+        if (processing_mode == gr::dvbt2::PROCESSING_SYMBOL)
+        {
+            get_tags_in_range(tags, 0, nread, nread + noutput_items, symbol_key);
+            std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
+        }
+        for (int i = 0; i < noutput_items; i++)
         {
+            while (t < tags.size() && tags[t].offset < nread + i)
+            {
+                t++;
+            }
+            if (t < tags.size() && tags[t].offset == nread + i)
+            {
+                symbol_index = pmt::to_long(tags[t].value);
+            }
+            j = symbol_index;
             if (papr_mode == gr::dvbt2::PAPR_TR || papr_mode == gr::dvbt2::PAPR_BOTH || (version_num == gr::dvbt2::VERSION_131 && papr_mode == gr::dvbt2::PAPR_OFF))
             {
-                for (int j = 0; j < num_symbols; j++)
+                init_pilots(j);
+                valid = FALSE;
+                if (j < N_P2)
                 {
-                    init_pilots(j);
-                    valid = FALSE;
-                    if (j < N_P2)
+                    index = 0;
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
+                    index = left_nulls;
+                    for (int n = 0; n < C_PS; n++)
                     {
-                        index = 0;
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
-                        index = left_nulls;
-                        for (int n = 0; n < C_PS; n++)
+                        if (p2_carrier_map[n] == P2PAPR_CARRIER)
                         {
-                            if (p2_carrier_map[n] == P2PAPR_CARRIER)
-                            {
-                                ones_freq[index++] = one;
-                            }
-                            else
-                            {
-                                ones_freq[index++] = zero;
-                            }
+                            ones_freq[index++] = one;
+                        }
+                        else
+                        {
+                            ones_freq[index++] = zero;
                         }
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
-                        papr_map = p2_papr_map;
-                        valid = TRUE;
                     }
-                    else if (j == (num_symbols - L_FC) && (papr_mode == gr::dvbt2::PAPR_TR || papr_mode == gr::dvbt2::PAPR_BOTH))
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
+                    papr_map = p2_papr_map;
+                    valid = TRUE;
+                }
+                else if (j == (num_symbols - L_FC) && (papr_mode == gr::dvbt2::PAPR_TR || papr_mode == gr::dvbt2::PAPR_BOTH))
+                {
+                    index = 0;
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
+                    index = left_nulls;
+                    for (int n = 0; n < C_PS; n++)
                     {
-                        index = 0;
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
-                        index = left_nulls;
-                        for (int n = 0; n < C_PS; n++)
+                        if (fc_carrier_map[n] == TRPAPR_CARRIER)
                         {
-                            if (fc_carrier_map[n] == TRPAPR_CARRIER)
-                            {
-                                ones_freq[index++] = one;
-                            }
-                            else
-                            {
-                                ones_freq[index++] = zero;
-                            }
+                            ones_freq[index++] = one;
+                        }
+                        else
+                        {
+                            ones_freq[index++] = zero;
                         }
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
-                        papr_map = p2_papr_map;
-                        valid = TRUE;
                     }
-                    else if (papr_mode == gr::dvbt2::PAPR_TR || papr_mode == gr::dvbt2::PAPR_BOTH)
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
+                    papr_map = p2_papr_map;
+                    valid = TRUE;
+                }
+                else if (papr_mode == gr::dvbt2::PAPR_TR || papr_mode == gr::dvbt2::PAPR_BOTH)
+                {
+                    index = 0;
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
+                    index = left_nulls;
+                    for (int n = 0; n < C_PS; n++)
                     {
-                        index = 0;
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * left_nulls);
-                        index = left_nulls;
-                        for (int n = 0; n < C_PS; n++)
+                        if (data_carrier_map[n] == TRPAPR_CARRIER)
                         {
-                            if (data_carrier_map[n] == TRPAPR_CARRIER)
-                            {
-                                ones_freq[index++] = one;
-                            }
-                            else
-                            {
-                                ones_freq[index++] = zero;
-                            }
+                            ones_freq[index++] = one;
+                        }
+                        else
+                        {
+                            ones_freq[index++] = zero;
                         }
-                        memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
-                        papr_map = tr_papr_map;
-                        valid = TRUE;
                     }
-                    if (valid == TRUE)
+                    memset(&ones_freq[index], 0, sizeof(gr_complex) * right_nulls);
+                    papr_map = tr_papr_map;
+                    valid = TRUE;
+                }
+                if (valid == TRUE)
+                {
+                    dst = papr_fft->get_inbuf();
+                    memcpy(&dst[papr_fft_size / 2], &ones_freq[0], sizeof(gr_complex) * papr_fft_size / 2);
+                    memcpy(&dst[0], &ones_freq[papr_fft_size / 2], sizeof(gr_complex) * papr_fft_size / 2);
+                    papr_fft->execute();
+                    memcpy(ones_time, papr_fft->get_outbuf(), sizeof(gr_complex) * papr_fft_size);
+                    volk_32fc_s32fc_multiply_32fc(ones_time, ones_time, normalization, papr_fft_size);
+                    for (int s = 0; s < streams; s++)
                     {
-                        dst = papr_fft->get_inbuf();
-                        memcpy(&dst[papr_fft_size / 2], &ones_freq[0], sizeof(gr_complex) * papr_fft_size / 2);
-                        memcpy(&dst[0], &ones_freq[papr_fft_size / 2], sizeof(gr_complex) * papr_fft_size / 2);
-                        papr_fft->execute();
-                        memcpy(ones_time, papr_fft->get_outbuf(), sizeof(gr_complex) * papr_fft_size);
-                        volk_32fc_s32fc_multiply_32fc(ones_time, ones_time, normalization, papr_fft_size);
+                        in = (const gr_complex *) input_items[s] + (i * papr_fft_size);
+                        out = (gr_complex *) output_items[s] + (i * papr_fft_size);
                         memset(&r[0], 0, sizeof(gr_complex) * N_TR);
                         memset(&c[0], 0, sizeof(gr_complex) * papr_fft_size);
                         for (int k = 1; k <= num_iterations; k++)
@@ -851,6 +810,7 @@ void paprtr_cc_impl::init_pilots(int symbol)
                             {
                                 break;
                             }
+                            stats.count(iteration_counter, 1);
                             u.real() = (in[m].real() + c[m].real()) / y;
                             u.imag() = (in[m].imag() + c[m].imag()) / y;
                             alpha = y - v_clip;
@@ -909,28 +869,32 @@ void paprtr_cc_impl::init_pilots(int symbol)
                             memcpy(r, rNew, sizeof(gr_complex) * N_TR);
                         }
                         volk_32f_x2_add_32f((float*)out, (float*)in, (float*)c, papr_fft_size * 2);
-                        in = in + papr_fft_size;
-                        out = out + papr_fft_size;
                     }
-                    else
+                }
+                else
+                {
+                    for (int s = 0; s < streams; s++)
                     {
+                        in = (const gr_complex *) input_items[s] + (i * papr_fft_size);
+                        out = (gr_complex *) output_items[s] + (i * papr_fft_size);
                         memcpy(out, in, sizeof(gr_complex) * papr_fft_size);
-                        in = in + papr_fft_size;
-                        out = out + papr_fft_size;
                     }
                 }
             }
             else
             {
-                for (int j = 0; j < num_symbols; j++)
+                for (int s = 0; s < streams; s++)
                 {
+                    in = (const gr_complex *) input_items[s] + (i * papr_fft_size);
+                    out = (gr_complex *) output_items[s] + (i * papr_fft_size);
                     memcpy(out, in, sizeof(gr_complex) * papr_fft_size);
-                    in = in + papr_fft_size;
-                    out = out + papr_fft_size;
                 }
             }
+            symbol_index = (symbol_index + 1) % num_symbols;
         }
 
+        stats.end(noutput_items);
+
         // Tell runtime system how many output items we produced.
         return noutput_items;
     }
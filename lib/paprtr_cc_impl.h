@@ -22,6 +22,8 @@
 #define INCLUDED_DVBT2_PAPRTR_CC_IMPL_H
 
 #include <dvbt2/paprtr_cc.h>
+#include "block_stats.h"
+#include "block_arena.h"
 #include <gnuradio/fft/fft.h>
 
 #define MAX_CARRIERS 27841
@@ -67,6 +69,7 @@ namespace gr {
       gr_complex *r;
       gr_complex *rNew;
       gr_complex *v;
+      block_arena arena;
       float alphaLimit[MAX_PAPRTONES];
       float alphaLimitMax[MAX_PAPRTONES];
       int N_P2;
@@ -77,6 +80,9 @@ namespace gr {
       int dx;
       int dy;
       int shift;
+      int symbol_index;
+      int processing_mode;
+      pmt::pmt_t symbol_key;
       void init_pilots(int);
 
       fft::fft_complex *papr_fft;
@@ -95,10 +101,14 @@ namespace gr {
       const static int tr_papr_map_16k[144];
       const static int tr_papr_map_32k[288];
 
+      block_stats stats;
+      int iteration_counter;
      public:
-      paprtr_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength);
+      paprtr_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, float vclip, int iterations, int vlength, dvbt2_processing_t processing);
       ~paprtr_cc_impl();
 
+      bool check_topology(int ninputs, int noutputs);
+
       // Where all the action really happens
       int work(int noutput_items,
 	       gr_vector_const_void_star &input_items,
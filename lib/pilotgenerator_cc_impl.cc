@@ -24,31 +24,45 @@
 
 #include <gnuradio/io_signature.h>
 #include "pilotgenerator_cc_impl.h"
+#include "table_cache.h"
+#include <algorithm>
 #include <volk/volk.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 namespace gr {
   namespace dvbt2 {
 
     pilotgenerator_cc::sptr
-    pilotgenerator_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength)
+    pilotgenerator_cc::make(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength, dvbt2_processing_t processing)
     {
       return gnuradio::get_initial_sptr
-        (new pilotgenerator_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, preamble, misogroup, equalization, bandwidth, vlength));
+        (new pilotgenerator_cc_impl(carriermode, fftsize, pilotpattern, guardinterval, numdatasyms, paprmode, version, preamble, misogroup, equalization, bandwidth, vlength, processing));
     }
 
     /*
      * The private constructor
      */
-    pilotgenerator_cc_impl::pilotgenerator_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength)
+    pilotgenerator_cc_impl::pilotgenerator_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength, dvbt2_processing_t processing)
       : gr::block("pilotgenerator_cc",
-              gr::io_signature::make(1, 1, sizeof(gr_complex)),
-              gr::io_signature::make(1, 1, sizeof(gr_complex) * vlength))
+              gr::io_signature::make(misogroup == gr::dvbt2::MISO_TX1_TX2 ? 2 : 1, misogroup == gr::dvbt2::MISO_TX1_TX2 ? 2 : 1, sizeof(gr_complex)),
+              gr::io_signature::make(misogroup == gr::dvbt2::MISO_TX1_TX2 ? 2 : 1, misogroup == gr::dvbt2::MISO_TX1_TX2 ? 2 : 1, sizeof(gr_complex) * vlength))
     {
         int step, ki;
         double x, sinc, sincrms = 0.0;
         double fs, fstep, f = 0.0;
-        miso_group = misogroup;
+        if (misogroup == gr::dvbt2::MISO_TX1_TX2)
+        {
+            /* The TX2 carrier maps are a superset of the TX1 maps, TX1 */
+            /* simply ignores the inverted pilot types. */
+            miso_dual = TRUE;
+            miso_group = MISO_TX2;
+        }
+        else
+        {
+            miso_dual = FALSE;
+            miso_group = misogroup;
+        }
         if ((preamble == gr::dvbt2::PREAMBLE_T2_SISO) || (preamble == gr::dvbt2::PREAMBLE_T2_LITE_SISO))
         {
             miso = FALSE;
@@ -1344,35 +1358,55 @@ namespace gr {
                 fs = 1.0;
                 break;
         }
-        fstep = fs / vlength;
-        for (int i = 0; i < vlength / 2; i++)
+        arena.add(&inverse_sinc, vlength);
+        if (!arena.allocate())
+        {
+            fprintf(stderr, "Pilot generator arena, Out of memory.\n");
+            exit(1);
+        }
+        table_cache cache("pilotgenerator_sinc_%d_%d", vlength, bandwidth);
+        if (!(cache.load() && cache.get(inverse_sinc, sizeof(gr_complex) * vlength)))
         {
-            x = M_PI * f / fs;
-            if (i == 0)
+            fstep = fs / vlength;
+            for (int i = 0; i < vlength / 2; i++)
             {
-                sinc = 1.0;
+                x = M_PI * f / fs;
+                if (i == 0)
+                {
+                    sinc = 1.0;
+                }
+                else
+                {
+                    sinc = sin(x) / x;
+                }
+                sincrms += sinc * sinc;
+                inverse_sinc[i + (vlength / 2)].real() = 1.0 / sinc;
+                inverse_sinc[i + (vlength / 2)].imag() = 0.0;
+                inverse_sinc[(vlength / 2) - i - 1].real() = 1.0 / sinc;
+                inverse_sinc[(vlength / 2) - i - 1].imag() = 0.0;
+                f = f + fstep;
             }
-            else
+            sincrms = sqrt(sincrms / (vlength / 2));
+            for (int i = 0; i < vlength; i++)
             {
-                sinc = sin(x) / x;
+                inverse_sinc[i].real() *= sincrms;
             }
-            sincrms += sinc * sinc;
-            inverse_sinc[i + (vlength / 2)].real() = 1.0 / sinc;
-            inverse_sinc[i + (vlength / 2)].imag() = 0.0;
-            inverse_sinc[(vlength / 2) - i - 1].real() = 1.0 / sinc;
-            inverse_sinc[(vlength / 2) - i - 1].imag() = 0.0;
-            f = f + fstep;
-        }
-        sincrms = sqrt(sincrms / (vlength / 2));
-        for (int i = 0; i < vlength; i++)
-        {
-            inverse_sinc[i].real() *= sincrms;
+            cache.put(inverse_sinc, sizeof(gr_complex) * vlength);
+            cache.store();
         }
         equalization_enable = equalization;
         ofdm_fft_size = vlength;
         ofdm_fft = new fft::fft_complex(ofdm_fft_size, false, 1);
         num_symbols = numdatasyms + N_P2;
-        set_output_multiple(num_symbols);
+        symbol_index = 0;
+        processing_mode = processing;
+        symbol_key = pmt::string_to_symbol("symbol_idx");
+        set_tag_propagation_policy(TPP_DONT);
+        if (processing != gr::dvbt2::PROCESSING_SYMBOL)
+        {
+            set_output_multiple(num_symbols);
+        }
+        stats.attach(this, num_symbols, ofdm_fft_size);
     }
 
     /*
@@ -1386,30 +1420,72 @@ namespace gr {
     void
     pilotgenerator_cc_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-        ninput_items_required[0] = active_items * (noutput_items / num_symbols);
+        int required = 0;
+        for (int i = 0; i < noutput_items; i++)
+        {
+            required += symbol_cells((symbol_index + i) % num_symbols);
+        }
+        for (unsigned int i = 0; i < ninput_items_required.size(); i++)
+        {
+            ninput_items_required[i] = required;
+        }
     }
 
-void pilotgenerator_cc_impl::init_prbs(void)
+int pilotgenerator_cc_impl::symbol_cells(int symbol)
 {
-    int sr = 0x7ff;
-    int j = 0;
-
-    for (int i = 0; i < MAX_CARRIERS; i++)
+    if (symbol < N_P2)
+    {
+        return C_P2;
+    }
+    else if (N_FC != 0 && symbol == num_symbols - 1)
     {
-        int b = ((sr) ^ (sr >> 2)) & 1;
-        prbs[i] = sr & 1;
-        sr >>= 1;
-        if(b) sr |= 0x400;
+        return N_FC;
     }
+    else
+    {
+        return C_DATA;
+    }
+}
 
-    for (int i = 0; i < (CHIPS / 8); i++)
+/*
+ * The reference PRBS and the unpacked PN sequence are the same for
+ * every FFT size and pilot pattern.  They are built once per process
+ * and shared by all pilot generators.
+ */
+struct pilot_sequences
+{
+    int prbs[MAX_CARRIERS];
+    int pn_sequence[CHIPS];
+
+    pilot_sequences(const unsigned char *pn_sequence_table)
     {
-        for (int k = 7; k >= 0; k--)
+        int sr = 0x7ff;
+        int j = 0;
+
+        for (int i = 0; i < MAX_CARRIERS; i++)
         {
-            pn_sequence[j] = (pn_sequence_table[i] >> k) & 0x1;
-            j = j + 1;
+            int b = ((sr) ^ (sr >> 2)) & 1;
+            prbs[i] = sr & 1;
+            sr >>= 1;
+            if(b) sr |= 0x400;
+        }
+
+        for (int i = 0; i < (CHIPS / 8); i++)
+        {
+            for (int k = 7; k >= 0; k--)
+            {
+                pn_sequence[j] = (pn_sequence_table[i] >> k) & 0x1;
+                j = j + 1;
+            }
         }
     }
+};
+
+void pilotgenerator_cc_impl::init_prbs(void)
+{
+    static const pilot_sequences sequences(pn_sequence_table);
+    prbs = sequences.prbs;
+    pn_sequence = sequences.pn_sequence;
 }
 
 void pilotgenerator_cc_impl::init_pilots(int symbol)
@@ -3430,147 +3506,330 @@ void pilotgenerator_cc_impl::init_pilots(int symbol)
     }
 }
 
+int pilotgenerator_cc_impl::generate_dual(int symbol, const gr_complex *in, const gr_complex *in2, gr_complex *out, gr_complex *out2)
+{
+    const gr_complex *first = in;
+    gr_complex zero;
+    int L_FC = 0;
+    int j = symbol;
+
+    zero.real() = 0.0;
+    zero.imag() = 0.0;
+    if (N_FC != 0)
+    {
+        L_FC = 1;
+    }
+    for (int n = 0; n < left_nulls; n++)
+    {
+        *out++ = zero;
+        *out2++ = zero;
+    }
+    if (j < N_P2)
+    {
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (p2_carrier_map[n] == P2PILOT_CARRIER)
+            {
+                *out++ = p2_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = p2_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (p2_carrier_map[n] == P2PILOT_CARRIER_INVERTED)
+            {
+                *out++ = p2_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = p2_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (p2_carrier_map[n] == P2PAPR_CARRIER)
+            {
+                *out++ = zero;
+                *out2++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+                *out2++ = *in2++;
+            }
+        }
+    }
+    else if (j == (num_symbols - L_FC))
+    {
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (fc_carrier_map[n] == SCATTERED_CARRIER)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (fc_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (fc_carrier_map[n] == TRPAPR_CARRIER)
+            {
+                *out++ = zero;
+                *out2++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+                *out2++ = *in2++;
+            }
+        }
+    }
+    else
+    {
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (data_carrier_map[n] == SCATTERED_CARRIER)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == CONTINUAL_CARRIER)
+            {
+                *out++ = cp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = cp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == CONTINUAL_CARRIER_INVERTED)
+            {
+                *out++ = cp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+                *out2++ = cp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == TRPAPR_CARRIER)
+            {
+                *out++ = zero;
+                *out2++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+                *out2++ = *in2++;
+            }
+        }
+    }
+    for (int n = 0; n < right_nulls; n++)
+    {
+        *out++ = zero;
+        *out2++ = zero;
+    }
+    return in - first;
+}
+
+int pilotgenerator_cc_impl::generate_symbol(int symbol, const gr_complex *in, gr_complex *out)
+{
+    const gr_complex *first = in;
+    gr_complex zero;
+    int L_FC = 0;
+    int j = symbol;
+
+    zero.real() = 0.0;
+    zero.imag() = 0.0;
+    if (N_FC != 0)
+    {
+        L_FC = 1;
+    }
+    if (j < N_P2)
+    {
+        for (int n = 0; n < left_nulls; n++)
+        {
+            *out++ = zero;
+        }
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (p2_carrier_map[n] == P2PILOT_CARRIER)
+            {
+                *out++ = p2_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (p2_carrier_map[n] == P2PILOT_CARRIER_INVERTED)
+            {
+                *out++ = p2_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (p2_carrier_map[n] == P2PAPR_CARRIER)
+            {
+                *out++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+            }
+        }
+        for (int n = 0; n < right_nulls; n++)
+        {
+            *out++ = zero;
+        }
+    }
+    else if (j == (num_symbols - L_FC))
+    {
+        for (int n = 0; n < left_nulls; n++)
+        {
+            *out++ = zero;
+        }
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (fc_carrier_map[n] == SCATTERED_CARRIER)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (fc_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
+            {
+                *out++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (fc_carrier_map[n] == TRPAPR_CARRIER)
+            {
+                *out++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+            }
+        }
+        for (int n = 0; n < right_nulls; n++)
+        {
+            *out++ = zero;
+        }
+    }
+    else
+    {
+        for (int n = 0; n < left_nulls; n++)
+        {
+            *out++ = zero;
+        }
+        for (int n = 0; n < C_PS; n++)
+        {
+            if (data_carrier_map[n] == SCATTERED_CARRIER)
+            {
+                *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
+            {
+                *out++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == CONTINUAL_CARRIER)
+            {
+                *out++ = cp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == CONTINUAL_CARRIER_INVERTED)
+            {
+                *out++ = cp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
+            }
+            else if (data_carrier_map[n] == TRPAPR_CARRIER)
+            {
+                *out++ = zero;
+            }
+            else
+            {
+                *out++ = *in++;
+            }
+        }
+        for (int n = 0; n < right_nulls; n++)
+        {
+            *out++ = zero;
+        }
+    }
+    return in - first;
+}
+
     int
     pilotgenerator_cc_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
                        gr_vector_const_void_star &input_items,
                        gr_vector_void_star &output_items)
     {
-        const gr_complex *in = (const gr_complex *) input_items[0];
-        gr_complex *out = (gr_complex *) output_items[0];
-        gr_complex zero;
+        const gr_complex *in[2];
+        gr_complex *out[2];
         gr_complex *dst;
-        int L_FC = 0;
+        const uint64_t nread = nitems_read(0);
+        std::vector<tag_t> tags;
+        std::vector<tag_t> stream_tags[2];
+        unsigned int t = 0;
+        unsigned int f[2] = {0, 0};
+        int streams = output_items.size();
+        int available = ninput_items[0];
+        int produced = 0;
+        int consumed = 0;
+        int cells;
+        stats.begin();
 
-        zero.real() = 0.0;
-        zero.imag() = 0.0;
-        if (N_FC != 0)
+        for (int s = 0; s < streams; s++)
         {
-            L_FC = 1;
+            in[s] = (const gr_complex *) input_items[s];
+            out[s] = (gr_complex *) output_items[s];
+            if (ninput_items[s] < available)
+            {
+                available = ninput_items[s];
+            }
         }
-        for (int i = 0; i < noutput_items; i += num_symbols)
+        if (processing_mode == gr::dvbt2::PROCESSING_SYMBOL)
         {
-            for (int j = 0; j < num_symbols; j++)
+            get_tags_in_range(tags, 0, nread, nread + available, symbol_key);
+            std::sort(tags.begin(), tags.end(), tag_t::offset_compare);
+        }
+        for (int s = 0; s < streams; s++)
+        {
+            get_tags_in_range(stream_tags[s], s, nitems_read(s), nitems_read(s) + available);
+            std::sort(stream_tags[s].begin(), stream_tags[s].end(), tag_t::offset_compare);
+        }
+        while (produced < noutput_items)
+        {
+            while (t < tags.size() && tags[t].offset < nread + consumed)
             {
-                init_pilots(j);
-                if (j < N_P2)
-                {
-                    for (int n = 0; n < left_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
-                    for (int n = 0; n < C_PS; n++)
-                    {
-                        if (p2_carrier_map[n] == P2PILOT_CARRIER)
-                        {
-                            *out++ = p2_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (p2_carrier_map[n] == P2PILOT_CARRIER_INVERTED)
-                        {
-                            *out++ = p2_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (p2_carrier_map[n] == P2PAPR_CARRIER)
-                        {
-                            *out++ = zero;
-                        }
-                        else
-                        {
-                            *out++ = *in++;
-                        }
-                    }
-                    for (int n = 0; n < right_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
-                }
-                else if (j == (num_symbols - L_FC))
-                {
-                    for (int n = 0; n < left_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
-                    for (int n = 0; n < C_PS; n++)
-                    {
-                        if (fc_carrier_map[n] == SCATTERED_CARRIER)
-                        {
-                            *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (fc_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
-                        {
-                            *out++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (fc_carrier_map[n] == TRPAPR_CARRIER)
-                        {
-                            *out++ = zero;
-                        }
-                        else
-                        {
-                            *out++ = *in++;
-                        }
-                    }
-                    for (int n = 0; n < right_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
-                }
-                else
+                t++;
+            }
+            if (t < tags.size() && tags[t].offset == nread + consumed)
+            {
+                symbol_index = pmt::to_long(tags[t].value);
+            }
+            if (consumed + symbol_cells(symbol_index) > available)
+            {
+                break;
+            }
+            init_pilots(symbol_index);
+            if (miso_dual == TRUE)
+            {
+                cells = generate_dual(symbol_index, in[0], in[1], out[0], out[1]);
+            }
+            else
+            {
+                cells = generate_symbol(symbol_index, in[0], out[0]);
+            }
+            for (int s = 0; s < streams; s++)
+            {
+                /* cell tags of this symbol move to its output vector */
+                while (f[s] < stream_tags[s].size() && stream_tags[s][f[s]].offset < nitems_read(s) + consumed + cells)
                 {
-                    for (int n = 0; n < left_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
-                    for (int n = 0; n < C_PS; n++)
-                    {
-                        if (data_carrier_map[n] == SCATTERED_CARRIER)
-                        {
-                            *out++ = sp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (data_carrier_map[n] == SCATTERED_CARRIER_INVERTED)
-                        {
-                            *out++ = sp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (data_carrier_map[n] == CONTINUAL_CARRIER)
-                        {
-                            *out++ = cp_bpsk[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (data_carrier_map[n] == CONTINUAL_CARRIER_INVERTED)
-                        {
-                            *out++ = cp_bpsk_inverted[prbs[n + K_OFFSET] ^ pn_sequence[j]];
-                        }
-                        else if (data_carrier_map[n] == TRPAPR_CARRIER)
-                        {
-                            *out++ = zero;
-                        }
-                        else
-                        {
-                            *out++ = *in++;
-                        }
-                    }
-                    for (int n = 0; n < right_nulls; n++)
-                    {
-                        *out++ = zero;
-                    }
+                    add_item_tag(s, nitems_written(s) + produced, stream_tags[s][f[s]].key, stream_tags[s][f[s]].value, stream_tags[s][f[s]].srcid);
+                    f[s]++;
                 }
-                out -= ofdm_fft_size;
                 if (equalization_enable == gr::dvbt2::EQUALIZATION_ON)
                 {
-                    volk_32fc_x2_multiply_32fc(out, out, inverse_sinc, ofdm_fft_size);
+                    volk_32fc_x2_multiply_32fc(out[s], out[s], inverse_sinc, ofdm_fft_size);
                 }
                 dst = ofdm_fft->get_inbuf();
-                memcpy(&dst[ofdm_fft_size / 2], &out[0], sizeof(gr_complex) * ofdm_fft_size / 2);
-                memcpy(&dst[0], &out[ofdm_fft_size / 2], sizeof(gr_complex) * ofdm_fft_size / 2);
+                memcpy(&dst[ofdm_fft_size / 2], &out[s][0], sizeof(gr_complex) * ofdm_fft_size / 2);
+                memcpy(&dst[0], &out[s][ofdm_fft_size / 2], sizeof(gr_complex) * ofdm_fft_size / 2);
                 ofdm_fft->execute();
-                volk_32fc_s32fc_multiply_32fc(out, ofdm_fft->get_outbuf(), normalization, ofdm_fft_size);
-                out += ofdm_fft_size;
+                volk_32fc_s32fc_multiply_32fc(out[s], ofdm_fft->get_outbuf(), normalization, ofdm_fft_size);
+                in[s] += cells;
+                out[s] += ofdm_fft_size;
             }
+            consumed += cells;
+            produced++;
+            symbol_index = (symbol_index + 1) % num_symbols;
         }
 
         // Tell runtime system how many input items we consumed on
         // each input stream.
-        consume_each (active_items);
+        consume_each (consumed);
+
+        stats.end(produced);
 
         // Tell runtime system how many output items we produced.
-        return noutput_items;
+        return produced;
     }
 
     const unsigned char pilotgenerator_cc_impl::pn_sequence_table[CHIPS / 8] = 
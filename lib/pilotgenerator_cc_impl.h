@@ -22,6 +22,8 @@
 #define INCLUDED_DVBT2_PILOTGENERATOR_CC_IMPL_H
 
 #include <dvbt2/pilotgenerator_cc.h>
+#include "block_stats.h"
+#include "block_arena.h"
 #include <gnuradio/fft/fft.h>
 
 #define CHIPS 2624
@@ -61,9 +63,10 @@ namespace gr {
       gr_complex p2_bpsk_inverted[2];
       gr_complex sp_bpsk_inverted[2];
       gr_complex cp_bpsk_inverted[2];
-      gr_complex inverse_sinc[32768];
-      int prbs[MAX_CARRIERS];
-      int pn_sequence[CHIPS];
+      gr_complex *inverse_sinc;
+      block_arena arena;
+      const int *prbs;
+      const int *pn_sequence;
       int p2_carrier_map[MAX_CARRIERS];
       int data_carrier_map[MAX_CARRIERS];
       int fc_carrier_map[MAX_CARRIERS];
@@ -79,8 +82,15 @@ namespace gr {
       int dy;
       int miso;
       int miso_group;
+      int miso_dual;
+      int symbol_index;
+      int processing_mode;
+      pmt::pmt_t symbol_key;
       void init_prbs(void);
       void init_pilots(int);
+      int symbol_cells(int);
+      int generate_symbol(int, const gr_complex *, gr_complex *);
+      int generate_dual(int, const gr_complex *, const gr_complex *, gr_complex *, gr_complex *);
 
       fft::fft_complex *ofdm_fft;
       int ofdm_fft_size;
@@ -153,8 +163,9 @@ namespace gr {
       const static int pp7_32k[2];
       const static int pp8_32k[6];
 
+      block_stats stats;
      public:
-      pilotgenerator_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength);
+      pilotgenerator_cc_impl(dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_pilotpattern_t pilotpattern, dvbt2_guardinterval_t guardinterval, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_misogroup_t misogroup, dvbt2_equalization_t equalization, dvbt2_bandwidth_t bandwidth, int vlength, dvbt2_processing_t processing);
       ~pilotgenerator_cc_impl();
 
       // Where all the action really happens
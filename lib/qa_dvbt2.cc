@@ -26,11 +26,14 @@
  */
 
 #include "qa_dvbt2.h"
+#include "qa_golden_vectors.h"
 
 CppUnit::TestSuite *
 qa_dvbt2::suite()
 {
   CppUnit::TestSuite *s = new CppUnit::TestSuite("dvbt2");
 
+  s->addTest(qa_golden_vectors::suite());
+
   return s;
 }
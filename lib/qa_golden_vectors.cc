@@ -0,0 +1,402 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Golden vector regression test.
+ *
+ * Every reference configuration is run on a fixed TS.  For the bit and
+ * cell stages, bbheader_bb up to freqinterleaver_cc, a 64 bit FNV-1a
+ * digest is taken of the output covering the first two T2 frames,
+ * delimited by the fecframe_start or t2_frame_idx tags, so the digest
+ * does not depend on how much a block flushes at the end of the input.
+ * The lengths and digests are compared against lib/golden/vv_digests.txt
+ * and any change that is not bit exact, or any entry missing from the
+ * file, fails.
+ *
+ * The complete chain is then run as one flowgraph over the same two T2
+ * frames.  Its end_to_end entry in vv_digests.txt holds the number of IQ
+ * samples in the two frames, which fixes the P1, P2 and guard interval
+ * layout, and the digest of the cells the chain passes from
+ * freqinterleaver_cc to the OFDM stages.  The IQ itself goes through
+ * floating point FFTs whose last bits differ between machines and volk
+ * kernels, so it is compared against the samples in lib/golden/vv_iq.txt
+ * instead, spread over both frames, and fails when the error relative to
+ * the reference RMS exceeds DVBT2_GOLDEN_IQ_RMS (default 1e-3).
+ *
+ * Both files were recorded by this test built on the baseline commit with
+ * DVBT2_GOLDEN_BASELINE, as lib/golden/README describes.  The baseline
+ * has no frame tags, so there the two T2 frames are counted in output
+ * multiples of the blocks.  Run with DVBT2_GOLDEN_RECORD=1 to rewrite the
+ * files from the current build after an intended change of the output.
+ */
+
+#include "qa_golden_vectors.h"
+#include "vv_chain.h"
+#include <gnuradio/blocks/vector_source_b.h>
+#include <gnuradio/blocks/vector_sink_c.h>
+#include <cppunit/TestAssert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+
+using namespace gr::dvbt2;
+
+#ifndef DVBT2_GOLDEN_DIR
+#define DVBT2_GOLDEN_DIR "golden"
+#endif
+
+#define GOLDEN_FRAMES 2
+#define GOLDEN_IQ_SAMPLES 512
+
+#ifdef DVBT2_GOLDEN_BASELINE
+#define GOLDEN_SOURCE "the baseline tree, see README"
+#else
+#define GOLDEN_SOURCE "the current tree with DVBT2_GOLDEN_RECORD=1"
+#endif
+
+typedef std::map<std::string, std::string> golden_map;
+
+struct iq_sample {
+  unsigned long index;
+  gr_complex value;
+};
+
+typedef std::map<std::string, std::vector<iq_sample> > iq_map;
+
+static uint64_t
+fnv1a(const void *data, size_t length)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/*
+ * Items of a stage output up to the end of the second T2 frame, 0 when
+ * the output does not reach it.
+ */
+static size_t
+golden_items(const vv_config &c, int stage, const capture &out)
+{
+  size_t items = out.cells.size() ? out.cells.size() : out.bytes.size();
+#ifdef DVBT2_GOLDEN_BASELINE
+  /* one FEC block per output multiple up to modulator_bc, one T2 frame after it */
+  size_t frames = (size_t)out.multiple * GOLDEN_FRAMES * (stage < STAGE_CELLINTERLEAVER ? c.fecblocks : 1);
+
+  return items >= frames ? frames : 0;
+#else
+  const char *key = stage <= STAGE_CELLINTERLEAVER ? "fecframe_start" : "t2_frame_idx";
+  unsigned int starts = stage <= STAGE_CELLINTERLEAVER ? GOLDEN_FRAMES * c.fecblocks : GOLDEN_FRAMES;
+  std::vector<uint64_t> offsets;
+
+  for (unsigned int i = 0; i < out.tags.size(); i++) {
+    if (pmt::symbol_to_string(out.tags[i].key) == key) {
+      offsets.push_back(out.tags[i].offset);
+    }
+  }
+  std::sort(offsets.begin(), offsets.end());
+  if (offsets.size() < starts) {
+    return 0;
+  }
+  return offsets.size() > starts ? offsets[starts] : items;
+#endif
+}
+
+/* "items fnv1a-64" of the first items of out, counted as length */
+static std::string
+digest(const capture &out, size_t items, size_t length)
+{
+  char text[48];
+  uint64_t hash;
+
+  if (out.cells.size()) {
+    hash = fnv1a(&out.cells[0], items * sizeof(gr_complex));
+  }
+  else {
+    hash = fnv1a(out.bytes.size() ? &out.bytes[0] : NULL, items);
+  }
+  snprintf(text, sizeof(text), "%lu %016llx", (unsigned long)length, (unsigned long long)hash);
+  return std::string(text);
+}
+
+static std::string
+env_string(const char *name, const char *fallback)
+{
+  const char *value = getenv(name);
+  return value != NULL ? std::string(value) : std::string(fallback);
+}
+
+static std::string
+golden_path(const char *name)
+{
+  return env_string("DVBT2_GOLDEN_DIR", DVBT2_GOLDEN_DIR) + "/" + name;
+}
+
+/* "config block value..." per line, '#' starts a comment */
+static golden_map
+read_digests(const std::string &path)
+{
+  golden_map map;
+  std::ifstream file(path.c_str());
+  std::string line;
+
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string config, block, value;
+    if (fields >> config >> block && std::getline(fields >> std::ws, value)) {
+      map[config + " " + block] = value;
+    }
+  }
+  return map;
+}
+
+static void
+write_digests(const std::string &path, const golden_map &map)
+{
+  std::ofstream file(path.c_str());
+
+  file << "# config block items fnv1a-64 over the first two T2 frames, recorded by test-dvbt2 from " GOLDEN_SOURCE "\n";
+  file << "# config end_to_end IQ samples in the two T2 frames, fnv1a-64 of the cells freqinterleaver_cc passes to the OFDM stages\n";
+  for (golden_map::const_iterator it = map.begin(); it != map.end(); ++it) {
+    file << it->first << " " << it->second << "\n";
+  }
+}
+
+/* "config sample real imag" per line */
+static iq_map
+read_iq(const std::string &path)
+{
+  iq_map map;
+  std::ifstream file(path.c_str());
+  std::string line;
+
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string config;
+    iq_sample s;
+    float real, imag;
+    if (fields >> config >> s.index >> real >> imag) {
+      s.value = gr_complex(real, imag);
+      map[config].push_back(s);
+    }
+  }
+  return map;
+}
+
+static void
+write_iq(const std::string &path, const iq_map &map)
+{
+  FILE *file = fopen(path.c_str(), "w");
+
+  if (file == NULL) {
+    perror(path.c_str());
+    return;
+  }
+  fprintf(file, "# config sample real imag, %d samples spread over the first two T2 frames, recorded by test-dvbt2 from " GOLDEN_SOURCE "\n", GOLDEN_IQ_SAMPLES);
+  for (iq_map::const_iterator it = map.begin(); it != map.end(); ++it) {
+    for (unsigned int i = 0; i < it->second.size(); i++) {
+      const iq_sample &s = it->second[i];
+      fprintf(file, "%s %lu %.8e %.8e\n", it->first.c_str(), s.index, s.value.real(), s.value.imag());
+    }
+  }
+  fclose(file);
+}
+
+/* run the complete chain, tapping the cells that enter the OFDM stages */
+static void
+run_chain(const vv_config &c, const std::vector<int> &stages, const std::vector<unsigned char> &ts, capture &cells, capture &iq)
+{
+  gr::top_block_sptr tb = gr::make_top_block("qa_golden_vectors");
+  gr::basic_block_sptr prev = gr::blocks::vector_source_b::make(ts, false, 1);
+  gr::blocks::vector_sink_c::sptr tap = gr::blocks::vector_sink_c::make(1);
+  gr::blocks::vector_sink_c::sptr sink = gr::blocks::vector_sink_c::make(1);
+  gr::basic_block_sptr freqinterleaver;
+
+  for (unsigned int i = 0; i < stages.size(); i++) {
+    prev = connect_stage(tb, prev, c, stages[i]);
+    if (stages[i] == STAGE_FREQINTERLEAVER) {
+      tb->connect(prev, 0, tap, 0);
+      freqinterleaver = prev;
+    }
+  }
+  tb->connect(prev, 0, sink, 0);
+  tb->run();
+  cells.cells = tap->data();
+  cells.tags = tap->tags();
+  cells.multiple = output_multiple(freqinterleaver);
+  iq.cells = sink->data();
+  iq.tags = sink->tags();
+  iq.multiple = output_multiple(prev);
+}
+
+/* rewrite the entries of actual in the digest file, keeping the others */
+static void
+record_digests(const std::string &path, const golden_map &actual)
+{
+  golden_map map = read_digests(path);
+
+  for (golden_map::const_iterator it = actual.begin(); it != actual.end(); ++it) {
+    map[it->first] = it->second;
+  }
+  write_digests(path, map);
+  fprintf(stderr, "qa_golden_vectors: recorded %d digests in %s\n", (int)actual.size(), path.c_str());
+}
+
+/* compare actual against golden, entries missing from golden fail */
+static int
+compare_digests(const std::string &path, const golden_map &golden, const golden_map &actual)
+{
+  int mismatches = 0;
+
+  for (golden_map::const_iterator it = actual.begin(); it != actual.end(); ++it) {
+    golden_map::const_iterator ref = golden.find(it->first);
+    if (ref == golden.end()) {
+      fprintf(stderr, "qa_golden_vectors: %s not in %s\n", it->first.c_str(), path.c_str());
+      mismatches++;
+    }
+    else if (ref->second != it->second) {
+      fprintf(stderr, "qa_golden_vectors: %s items and digest %s, expected %s\n", it->first.c_str(), it->second.c_str(), ref->second.c_str());
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+void
+qa_golden_vectors::t1_bit_exact()
+{
+  std::string path = golden_path("vv_digests.txt");
+  golden_map golden = read_digests(path);
+  golden_map actual;
+  int mismatches = 0;
+
+  for (int n = 0; n < num_vv_configs; n++) {
+    const vv_config &c = vv_configs[n];
+    std::vector<int> all = chain_stages(c);
+    std::vector<int> stages(all.begin(), std::find(all.begin(), all.end(), (int)STAGE_PILOTGENERATOR));
+    std::vector<unsigned char> ts = make_transport_stream(c, GOLDEN_FRAMES);
+    std::vector<capture> outputs;
+
+    capture_stages(c, stages, ts, outputs);
+    for (unsigned int i = 0; i < stages.size(); i++) {
+      size_t items = golden_items(c, stages[i], outputs[i]);
+      std::string key = std::string(c.name) + " " + stage_infos[stages[i]].name;
+      if (items == 0) {
+        fprintf(stderr, "qa_golden_vectors: %s output ends before T2 frame %d\n", key.c_str(), GOLDEN_FRAMES);
+        mismatches++;
+      }
+      actual[key] = digest(outputs[i], items, items);
+    }
+  }
+
+  if (getenv("DVBT2_GOLDEN_RECORD") != NULL) {
+    record_digests(path, actual);
+    return;
+  }
+  mismatches += compare_digests(path, golden, actual);
+  CPPUNIT_ASSERT_EQUAL(0, mismatches);
+}
+
+void
+qa_golden_vectors::t2_end_to_end()
+{
+  std::string digest_path = golden_path("vv_digests.txt");
+  std::string path = golden_path("vv_iq.txt");
+  double threshold = atof(env_string("DVBT2_GOLDEN_IQ_RMS", "1e-3").c_str());
+  bool record = getenv("DVBT2_GOLDEN_RECORD") != NULL;
+  golden_map golden_digests = read_digests(digest_path);
+  golden_map actual_digests;
+  iq_map golden = read_iq(path);
+  iq_map actual;
+  int failures = 0;
+
+  for (int n = 0; n < num_vv_configs; n++) {
+    const vv_config &c = vv_configs[n];
+    std::vector<unsigned char> ts = make_transport_stream(c, GOLDEN_FRAMES);
+    capture cells, iq;
+
+    run_chain(c, chain_stages(c), ts, cells, iq);
+    size_t cell_items = golden_items(c, STAGE_FREQINTERLEAVER, cells);
+    size_t length = golden_items(c, STAGE_P1INSERTION, iq);
+    if (cell_items == 0 || length == 0) {
+      fprintf(stderr, "qa_golden_vectors: %s chain output ends before T2 frame %d\n", c.name, GOLDEN_FRAMES);
+      failures++;
+      continue;
+    }
+    actual_digests[std::string(c.name) + " end_to_end"] = digest(cells, cell_items, length);
+
+    if (record) {
+      size_t stride = length / GOLDEN_IQ_SAMPLES;
+      for (int i = 0; stride > 0 && i < GOLDEN_IQ_SAMPLES; i++) {
+        iq_sample s;
+        s.index = i * stride + stride / 2;
+        s.value = iq.cells[s.index];
+        actual[c.name].push_back(s);
+      }
+      continue;
+    }
+
+    iq_map::const_iterator ref = golden.find(c.name);
+    if (ref == golden.end() || ref->second.empty()) {
+      fprintf(stderr, "qa_golden_vectors: %s IQ not in %s\n", c.name, path.c_str());
+      failures++;
+      continue;
+    }
+    double error = 0.0;
+    double power = 0.0;
+    for (unsigned int i = 0; i < ref->second.size(); i++) {
+      const iq_sample &s = ref->second[i];
+      gr_complex value = s.index < length ? iq.cells[s.index] : gr_complex(0.0, 0.0);
+      error += std::norm(value - s.value);
+      power += std::norm(s.value);
+    }
+    double rms = power > 0.0 ? sqrt(error / power) : sqrt(error);
+    if (!(rms <= threshold)) {
+      fprintf(stderr, "qa_golden_vectors: %s IQ relative RMS error %.3g, limit %.3g\n", c.name, rms, threshold);
+      failures++;
+    }
+  }
+
+  if (record) {
+    record_digests(digest_path, actual_digests);
+    write_iq(path, actual);
+    fprintf(stderr, "qa_golden_vectors: recorded IQ of %d configurations in %s\n", (int)actual.size(), path.c_str());
+    return;
+  }
+  failures += compare_digests(digest_path, golden_digests, actual_digests);
+  CPPUNIT_ASSERT_EQUAL(0, failures);
+}
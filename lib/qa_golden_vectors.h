@@ -0,0 +1,39 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _QA_GOLDEN_VECTORS_H_
+#define _QA_GOLDEN_VECTORS_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+class qa_golden_vectors : public CppUnit::TestCase
+{
+  CPPUNIT_TEST_SUITE(qa_golden_vectors);
+  CPPUNIT_TEST(t1_bit_exact);
+  CPPUNIT_TEST(t2_end_to_end);
+  CPPUNIT_TEST_SUITE_END();
+
+ private:
+  void t1_bit_exact();
+  void t2_end_to_end();
+};
+
+#endif /* _QA_GOLDEN_VECTORS_H_ */
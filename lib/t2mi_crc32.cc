@@ -0,0 +1,70 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "t2mi_crc32.h"
+
+#define CRC_POLY 0x04C11DB7
+
+namespace gr {
+  namespace dvbt2 {
+
+// Fixed by the standard, one copy serves the gateway and the parser.
+struct crc32_table
+{
+    unsigned int crc[256];
+
+    crc32_table()
+    {
+        unsigned int c;
+
+        for (int i = 0; i < 256; i++)
+        {
+            c = i << 24;
+            for (int j = 0; j < 8; j++)
+            {
+                if (c & 0x80000000)
+                    c = (c << 1) ^ CRC_POLY;
+                else
+                    c <<= 1;
+            }
+            crc[i] = c;
+        }
+    }
+};
+
+unsigned int
+t2mi_crc32(const unsigned char *in, int length)
+{
+    static const crc32_table table;
+    unsigned int crc = 0xffffffff;
+
+    for (int i = 0; i < length; i++)
+    {
+        crc = (crc << 8) ^ table.crc[((crc >> 24) ^ in[i]) & 0xff];
+    }
+    return crc;
+}
+
+  } // namespace dvbt2
+} // namespace gr
@@ -0,0 +1,37 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_T2MI_CRC32_H
+#define INCLUDED_DVBT2_T2MI_CRC32_H
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*
+     * CRC-32 of a T2-MI packet (ETSI TS 102 773, annex A), MSB first,
+     * preset to all ones and not inverted.  Run over a packet with its
+     * CRC appended, the result is 0.
+     */
+    unsigned int t2mi_crc32(const unsigned char *in, int length);
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_T2MI_CRC32_H */
@@ -0,0 +1,571 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "t2mi_gateway_bb_impl.h"
+#include "t2mi_crc32.h"
+#include <boost/bind.hpp>
+#include <stdio.h>
+
+namespace gr {
+  namespace dvbt2 {
+
+    t2mi_gateway_bb::sptr
+    t2mi_gateway_bb::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype)
+    {
+      return gnuradio::get_initial_sptr
+        (new t2mi_gateway_bb_impl(framesize, rate, constellation, rotation, fecblocks, tiblocks, carriermode, fftsize, guardinterval, l1constellation, pilotpattern, t2frames, numdatasyms, paprmode, version, preamble, inputmode, reservedbiasbits, l1scrambled, inband, bandwidth, payloadtype));
+    }
+
+    /*
+     * The private constructor
+     */
+    t2mi_gateway_bb_impl::t2mi_gateway_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype)
+      : gr::block("t2mi_gateway_bb",
+              gr::io_signature::make(1, 1, sizeof(unsigned char)),
+              gr::io_signature::make(1, 1, sizeof(unsigned char)))
+    {
+        int fft_size, guard_interval, N_P2;
+        frame_size = framesize == gr::dvbt2::FECFRAME_NORMAL ? FRAME_SIZE_NORMAL : FRAME_SIZE_SHORT;
+        switch (fftsize)
+        {
+            case gr::dvbt2::FFTSIZE_1K:
+                fft_size = 1024;
+                N_P2 = 16;
+                break;
+            case gr::dvbt2::FFTSIZE_2K:
+                fft_size = 2048;
+                N_P2 = 8;
+                break;
+            case gr::dvbt2::FFTSIZE_4K:
+                fft_size = 4096;
+                N_P2 = 4;
+                break;
+            case gr::dvbt2::FFTSIZE_8K:
+            case gr::dvbt2::FFTSIZE_8K_T2GI:
+                fft_size = 8192;
+                N_P2 = 2;
+                break;
+            case gr::dvbt2::FFTSIZE_16K:
+            case gr::dvbt2::FFTSIZE_16K_T2GI:
+                fft_size = 16384;
+                N_P2 = 1;
+                break;
+            case gr::dvbt2::FFTSIZE_32K:
+            case gr::dvbt2::FFTSIZE_32K_T2GI:
+                fft_size = 32768;
+                N_P2 = 1;
+                break;
+        }
+        switch (guardinterval)
+        {
+            case gr::dvbt2::GI_1_32:
+                guard_interval = fft_size / 32;
+                break;
+            case gr::dvbt2::GI_1_16:
+                guard_interval = fft_size / 16;
+                break;
+            case gr::dvbt2::GI_1_8:
+                guard_interval = fft_size / 8;
+                break;
+            case gr::dvbt2::GI_1_4:
+                guard_interval = fft_size / 4;
+                break;
+            case gr::dvbt2::GI_1_128:
+                guard_interval = fft_size / 128;
+                break;
+            case gr::dvbt2::GI_19_128:
+                guard_interval = (fft_size * 19) / 128;
+                break;
+            case gr::dvbt2::GI_19_256:
+                guard_interval = (fft_size * 19) / 256;
+                break;
+        }
+        signalling.init(framesize, rate, constellation, rotation, fecblocks, tiblocks, carriermode, fftsize, guardinterval, l1constellation, pilotpattern, t2frames, numdatasyms, paprmode, version, preamble, inputmode, reservedbiasbits, l1scrambled, inband, payloadtype);
+        fec_blocks = fecblocks;
+        t2_frames = t2frames;
+        t2_frame_num = 0;
+        superframe_idx = 0;
+        packet_count = 0;
+        bandwidth_code = bandwidth;
+        frame_period = 2048 + ((numdatasyms + N_P2) * (fft_size + guard_interval));
+        period_count = 0;
+        timestamp_packet_items = T2MI_HEADER_LENGTH + 11 + T2MI_CRC_LENGTH;
+        l1_packet_items = T2MI_HEADER_LENGTH + 2 + (add_l1data(l1_bits, 0) / 8) + T2MI_CRC_LENGTH;
+        set_tag_propagation_policy(TPP_DONT);
+        /* 5/6 has the longest BBFRAME, sizes the buffers for any code rate, see start() */
+        set_rate(gr::dvbt2::C5_6);
+        set_output_multiple(t2mi_items);
+        set_rate(rate);
+        modcod_key = pmt::string_to_symbol("modcod");
+        modcod_announce_key = pmt::string_to_symbol("modcod_announce");
+        modcod_announce = pmt::PMT_NIL;
+        modcod_switch = FALSE;
+        modcod_expected = FALSE;
+        message_port_register_in(pmt::mp("l1"));
+        set_msg_handler(pmt::mp("l1"), boost::bind(&t2mi_gateway_bb_impl::handle_l1, this, _1));
+        message_port_register_in(pmt::mp("l1update"));
+        set_msg_handler(pmt::mp("l1update"), boost::bind(&t2mi_gateway_bb_impl::handle_l1_update, this, _1));
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    t2mi_gateway_bb_impl::~t2mi_gateway_bb_impl()
+    {
+    }
+
+    /* buffers are allocated by now, run with the current code rate */
+    bool
+    t2mi_gateway_bb_impl::start()
+    {
+        set_output_multiple(t2mi_items);
+        return true;
+    }
+
+    void
+    t2mi_gateway_bb_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
+    {
+        ninput_items_required[0] = kbch * fec_blocks * (noutput_items / t2mi_items);
+    }
+
+void t2mi_gateway_bb_impl::set_rate(int rate)
+{
+    if (frame_size == FRAME_SIZE_NORMAL)
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+            case gr::dvbt2::C2_5:
+            case gr::dvbt2::C1_2:
+                kbch = 32208;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 38688;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 43040;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 48408;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 51648;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 53840;
+                break;
+        }
+    }
+    else
+    {
+        switch (rate)
+        {
+            case gr::dvbt2::C1_3:
+                kbch = 5232;
+                break;
+            case gr::dvbt2::C2_5:
+                kbch = 6312;
+                break;
+            case gr::dvbt2::C1_2:
+                kbch = 7032;
+                break;
+            case gr::dvbt2::C3_5:
+                kbch = 9552;
+                break;
+            case gr::dvbt2::C2_3:
+                kbch = 10632;
+                break;
+            case gr::dvbt2::C3_4:
+                kbch = 11712;
+                break;
+            case gr::dvbt2::C4_5:
+                kbch = 12432;
+                break;
+            case gr::dvbt2::C5_6:
+                kbch = 13152;
+                break;
+        }
+    }
+    bbframe_packet_items = T2MI_HEADER_LENGTH + 3 + (kbch / 8) + T2MI_CRC_LENGTH;
+    t2mi_items = timestamp_packet_items + (fec_blocks * bbframe_packet_items) + l1_packet_items;
+}
+
+int t2mi_gateway_bb_impl::add_crc32(unsigned char *out, int length)
+{
+    unsigned int crc = t2mi_crc32(out, length);
+
+    out[length++] = (crc >> 24) & 0xff;
+    out[length++] = (crc >> 16) & 0xff;
+    out[length++] = (crc >> 8) & 0xff;
+    out[length++] = crc & 0xff;
+    return T2MI_CRC_LENGTH;
+}
+
+int t2mi_gateway_bb_impl::add_field(unsigned char *out, int offset_bits, int value, int bits)
+{
+    for (int n = bits - 1; n >= 0; n--)
+    {
+        out[offset_bits++] = value & (1 << n) ? 1 : 0;
+    }
+    return offset_bits;
+}
+
+int t2mi_gateway_bb_impl::pack_bits(unsigned char *out, const unsigned char *in, int bits)
+{
+    unsigned char b;
+
+    for (int i = 0; i < bits / 8; i++)
+    {
+        b = 0;
+        for (int n = 7; n >= 0; n--)
+        {
+            b |= *in++ << n;
+        }
+        out[i] = b;
+    }
+    return bits / 8;
+}
+
+int t2mi_gateway_bb_impl::add_l1pre(unsigned char *l1pre)
+{
+    int offset_bits = 0;
+    L1Pre *l1preinit = &signalling.current.l1pre_data;
+
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->type, 8);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->bwt_ext, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->s1, 3);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->s2, 3);
+    offset_bits = add_field(l1pre, offset_bits, signalling.fef_present, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_repetition_flag, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->guard_interval, 3);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->papr, 4);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_mod, 4);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_cod, 2);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_fec_type, 2);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_post_size, 18);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_post_info_size, 18);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->pilot_pattern, 4);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->tx_id_availability, 8);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->cell_id, 16);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->network_id, 16);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->t2_system_id, 16);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->num_t2_frames, 8);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->num_data_symbols, 12);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->regen_flag, 3);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_post_extension, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->num_rf, 3);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->current_rf_index, 3);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->t2_version, 4);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->l1_post_scrambled, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->t2_base_lite, 1);
+    offset_bits = add_field(l1pre, offset_bits, l1preinit->reserved, 4);
+    return offset_bits;
+}
+
+int t2mi_gateway_bb_impl::add_l1conf(unsigned char *l1post)
+{
+    int offset_bits = 0;
+    L1Post *l1postinit = &signalling.current.l1post_data;
+
+    offset_bits = add_field(l1post, offset_bits, l1postinit->sub_slices_per_frame, 15);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->num_plp, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->num_aux, 4);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->aux_config_rfu, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->rf_idx, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->frequency, 32);
+    if (signalling.fef_present == TRUE)
+    {
+        offset_bits = add_field(l1post, offset_bits, 0, 4);
+        offset_bits = add_field(l1post, offset_bits, signalling.fef_length, 22);
+        offset_bits = add_field(l1post, offset_bits, signalling.fef_interval, 8);
+    }
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_id, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_type, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_payload_type, 5);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->ff_flag, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->first_rf_idx, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->first_frame_idx, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_group_id, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_cod, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_mod, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_rotation, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_fec_type, 2);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_num_blocks_max, 10);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->frame_interval, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->time_il_length, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->time_il_type, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->in_band_a_flag, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->in_band_b_flag, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->reserved_1, 11);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_mode, 2);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->static_flag, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->static_padding_flag, 1);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->fef_length_msb, 2);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->reserved_2, 30);
+    return offset_bits;
+}
+
+int t2mi_gateway_bb_impl::add_l1dyn(unsigned char *l1post, int frame)
+{
+    int offset_bits = 0;
+    L1Post *l1postinit = &signalling.current.l1post_data;
+
+    offset_bits = add_field(l1post, offset_bits, frame, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->sub_slice_interval, 22);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->type_2_start, 22);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->l1_change_counter, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->start_rf_idx, 3);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->reserved_3, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_id_dynamic, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_start, 22);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->plp_num_blocks, 10);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->reserved_4, 8);
+    offset_bits = add_field(l1post, offset_bits, l1postinit->reserved_5, 8);
+    return offset_bits;
+}
+
+int t2mi_gateway_bb_impl::add_l1data(unsigned char *l1, int frame)
+{
+    int offset_bits, length;
+
+    /* L1PRE without CRC, then length prefixed and byte padded */
+    /* L1CONF, L1DYN_CURR and an empty L1EXT                  */
+    memset(l1, 0, sizeof(l1_bits));
+    offset_bits = add_l1pre(l1);
+    length = add_l1conf(&l1[offset_bits + 16]);
+    offset_bits = add_field(l1, offset_bits, length, 16);
+    offset_bits += (length + 7) & ~7;
+    length = add_l1dyn(&l1[offset_bits + 16], frame);
+    offset_bits = add_field(l1, offset_bits, length, 16);
+    offset_bits += (length + 7) & ~7;
+    offset_bits = add_field(l1, offset_bits, 0, 16);
+    return offset_bits;
+}
+
+int t2mi_gateway_bb_impl::add_t2mi_header(unsigned char *out, int type, int payload_bits)
+{
+    out[0] = type;
+    out[1] = packet_count++;
+    out[2] = (superframe_idx & 0xf) << 4;
+    out[3] = 0;
+    out[4] = (payload_bits >> 8) & 0xff;
+    out[5] = payload_bits & 0xff;
+    return T2MI_HEADER_LENGTH;
+}
+
+int t2mi_gateway_bb_impl::add_bbframe_packet(unsigned char *out, const unsigned char *in, int frame_start)
+{
+    int length;
+
+    length = add_t2mi_header(out, T2MI_TYPE_BBFRAME, 24 + kbch);
+    out[length++] = t2_frame_num;
+    out[length++] = 0;    /* plp_id */
+    out[length++] = frame_start ? 0x80 : 0x00;
+    length += pack_bits(&out[length], in, kbch);
+    length += add_crc32(out, length);
+    return length;
+}
+
+int t2mi_gateway_bb_impl::add_l1_packet(unsigned char *out)
+{
+    int length, bits;
+
+    bits = add_l1data(l1_bits, t2_frame_num);
+    length = add_t2mi_header(out, T2MI_TYPE_L1_CURRENT, 16 + bits);
+    out[length++] = t2_frame_num;
+    out[length++] = 0;
+    length += pack_bits(&out[length], l1_bits, bits);
+    length += add_crc32(out, length);
+    return length;
+}
+
+int t2mi_gateway_bb_impl::add_timestamp_packet(unsigned char *out)
+{
+    int length;
+    uint64_t ticks, second, subseconds;
+
+    /* relative timestamp, seconds_since_2000 and utco are zero */
+    ticks = period_count * elementary_period[bandwidth_code][0];
+    second = (uint64_t)1000000 * elementary_period[bandwidth_code][1];
+    subseconds = (ticks % second) / elementary_period[bandwidth_code][0];
+    length = add_t2mi_header(out, T2MI_TYPE_TIMESTAMP, 88);
+    out[length++] = bandwidth_code & 0xf;
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = (subseconds >> 19) & 0xff;
+    out[length++] = (subseconds >> 11) & 0xff;
+    out[length++] = (subseconds >> 3) & 0xff;
+    out[length++] = (subseconds << 5) & 0xe0;
+    out[length++] = 0;
+    length += add_crc32(out, length);
+    return length;
+}
+
+void t2mi_gateway_bb_impl::handle_l1(pmt::pmt_t msg)
+{
+    signalling.set(msg);
+}
+
+void t2mi_gateway_bb_impl::handle_l1_update(pmt::pmt_t msg)
+{
+    signalling.update(msg);
+}
+
+/*
+ * "modcod_announce" and "modcod" tags from bbheader_bb, checked as in
+ * framemapper_cc.  The BB frame size follows the code rate at once,
+ * the L1 signalling changes with the superframe.
+ */
+int t2mi_gateway_bb_impl::apply_modcod(uint64_t offset, int available)
+{
+    std::vector<tag_t> tags;
+    pmt::pmt_t rate_key = pmt::intern("rate");
+
+    if (available == 0)
+    {
+        return TRUE;
+    }
+    modcod_switch = FALSE;
+    modcod_announce = pmt::PMT_NIL;
+    get_tags_in_range(tags, 0, offset, offset + 1, modcod_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (t2_frame_num != 0 || modcod_expected == FALSE)
+        {
+            return FALSE;
+        }
+        if (pmt::dict_has_key(tags[t].value, rate_key))
+        {
+            set_rate(pmt::to_long(pmt::dict_ref(tags[t].value, rate_key, pmt::PMT_NIL)));
+            set_output_multiple(t2mi_items);
+        }
+        modcod_switch = TRUE;
+    }
+    if (t2_frame_num == 0 && modcod_expected == TRUE && modcod_switch == FALSE)
+    {
+        return FALSE;
+    }
+    get_tags_in_range(tags, 0, offset, offset + 1, modcod_announce_key);
+    for (unsigned int t = 0; t < tags.size(); t++)
+    {
+        if (t2_frame_num != 0)
+        {
+            return FALSE;
+        }
+        modcod_announce = tags[t].value;
+    }
+    if (available > kbch * fec_blocks)
+    {
+        available = kbch * fec_blocks;
+    }
+    get_tags_in_range(tags, 0, offset + 1, offset + available, modcod_key);
+    if (tags.size() != 0)
+    {
+        return FALSE;
+    }
+    get_tags_in_range(tags, 0, offset + 1, offset + available, modcod_announce_key);
+    if (tags.size() != 0)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+    int
+    t2mi_gateway_bb_impl::general_work (int noutput_items,
+                       gr_vector_int &ninput_items,
+                       gr_vector_const_void_star &input_items,
+                       gr_vector_void_star &output_items)
+    {
+        const unsigned char *in = (const unsigned char *) input_items[0];
+        unsigned char *out = (unsigned char *) output_items[0];
+        int consumed = 0;
+        int offset = 0;
+
+        for (;;)
+        {
+            if (apply_modcod(nitems_read(0) + consumed, ninput_items[0] - consumed) == FALSE)
+            {
+                fprintf(stderr, "Modcod change not aligned to a superframe, check fecblocks and t2frames of bbheader_bb.\n");
+                return WORK_DONE;
+            }
+            if (offset + t2mi_items > noutput_items || consumed + (kbch * fec_blocks) > ninput_items[0])
+            {
+                break;
+            }
+            if (t2_frame_num == 0)
+            {
+                signalling.superframe_start();
+                if (modcod_switch == TRUE)
+                {
+                    modcod_expected = FALSE;
+                }
+                if (pmt::is_dict(modcod_announce))
+                {
+                    signalling.announce(modcod_announce);
+                    modcod_expected = TRUE;
+                }
+            }
+            offset += add_timestamp_packet(&out[offset]);
+            for (int n = 0; n < fec_blocks; n++)
+            {
+                offset += add_bbframe_packet(&out[offset], in, n == 0);
+                in += kbch;
+                consumed += kbch;
+            }
+            offset += add_l1_packet(&out[offset]);
+            period_count += frame_period;
+            t2_frame_num = (t2_frame_num + 1) % t2_frames;
+            if (t2_frame_num == 0)
+            {
+                superframe_idx = (superframe_idx + 1) & 0xf;
+            }
+        }
+
+        // Tell runtime system how many input items we consumed on
+        // each input stream.
+        consume_each (consumed);
+
+        // Tell runtime system how many output items we produced.
+        return offset;
+    }
+
+    /* elementary period T in microseconds, as numerator and denominator */
+    const int t2mi_gateway_bb_impl::elementary_period[6][2] =
+    {
+        {71, 131},
+        {7, 40},
+        {7, 48},
+        {1, 8},
+        {7, 64},
+        {7, 80}
+    };
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
+
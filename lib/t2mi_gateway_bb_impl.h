@@ -0,0 +1,97 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_T2MI_GATEWAY_BB_IMPL_H
+#define INCLUDED_DVBT2_T2MI_GATEWAY_BB_IMPL_H
+
+#include <dvbt2/t2mi_gateway_bb.h>
+#include "l1_signalling.h"
+
+#define T2MI_HEADER_LENGTH 6
+#define T2MI_CRC_LENGTH 4
+
+#define T2MI_TYPE_BBFRAME 0x00
+#define T2MI_TYPE_L1_CURRENT 0x10
+#define T2MI_TYPE_TIMESTAMP 0x20
+
+namespace gr {
+  namespace dvbt2 {
+
+    class t2mi_gateway_bb_impl : public t2mi_gateway_bb
+    {
+     private:
+      int frame_size;
+      int kbch;
+      int fec_blocks;
+      int t2_frames;
+      int t2_frame_num;
+      int superframe_idx;
+      int bandwidth_code;
+      int frame_period;
+      uint64_t period_count;
+      unsigned char packet_count;
+      int bbframe_packet_items;
+      int l1_packet_items;
+      int timestamp_packet_items;
+      int t2mi_items;
+      l1_signalling signalling;
+      pmt::pmt_t modcod_key;
+      pmt::pmt_t modcod_announce_key;
+      pmt::pmt_t modcod_announce;
+      int modcod_switch;
+      int modcod_expected;
+      unsigned char l1_bits[KSIG_PRE + KBCH_1_2];
+      void set_rate(int);
+      void handle_l1(pmt::pmt_t);
+      void handle_l1_update(pmt::pmt_t);
+      int apply_modcod(uint64_t, int);
+      int add_crc32(unsigned char *, int);
+      int add_field(unsigned char *, int, int, int);
+      int add_l1pre(unsigned char *);
+      int add_l1conf(unsigned char *);
+      int add_l1dyn(unsigned char *, int);
+      int add_l1data(unsigned char *, int);
+      int pack_bits(unsigned char *, const unsigned char *, int);
+      int add_t2mi_header(unsigned char *, int, int);
+      int add_bbframe_packet(unsigned char *, const unsigned char *, int);
+      int add_l1_packet(unsigned char *);
+      int add_timestamp_packet(unsigned char *);
+
+      const static int elementary_period[6][2];
+
+     public:
+      t2mi_gateway_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate, dvbt2_constellation_t constellation, dvbt2_rotation_t rotation, int fecblocks, int tiblocks, dvbt2_extended_carrier_t carriermode, dvbt2_fftsize_t fftsize, dvbt2_guardinterval_t guardinterval, dvbt2_l1constellation_t l1constellation, dvbt2_pilotpattern_t pilotpattern, int t2frames, int numdatasyms, dvbt2_papr_t paprmode, dvbt2_version_t version, dvbt2_preamble_t preamble, dvbt2_inputmode_t inputmode, dvbt2_reservedbiasbits_t reservedbiasbits, dvbt2_l1scrambled_t l1scrambled, dvbt2_inband_t inband, dvbt2_bandwidth_t bandwidth, dvbt2_payloadtype_t payloadtype);
+      ~t2mi_gateway_bb_impl();
+      bool start();
+
+      // Where all the action really happens
+      void forecast (int noutput_items, gr_vector_int &ninput_items_required);
+
+      int general_work(int noutput_items,
+		       gr_vector_int &ninput_items,
+		       gr_vector_const_void_star &input_items,
+		       gr_vector_void_star &output_items);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_T2MI_GATEWAY_BB_IMPL_H */
+
@@ -0,0 +1,387 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "t2mi_parser_bb_impl.h"
+#include "t2mi_crc32.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace gr {
+  namespace dvbt2 {
+
+    t2mi_parser_bb::sptr
+    t2mi_parser_bb::make(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate)
+    {
+      return gnuradio::get_initial_sptr
+        (new t2mi_parser_bb_impl(framesize, rate));
+    }
+
+    /*
+     * The private constructor
+     */
+    t2mi_parser_bb_impl::t2mi_parser_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate)
+      : gr::block("t2mi_parser_bb",
+              gr::io_signature::make(1, 1, sizeof(unsigned char)),
+              gr::io_signature::make(1, 1, sizeof(unsigned char)))
+    {
+        if (framesize == gr::dvbt2::FECFRAME_NORMAL)
+        {
+            switch (rate)
+            {
+                case gr::dvbt2::C1_3:
+                case gr::dvbt2::C2_5:
+                case gr::dvbt2::C1_2:
+                    kbch = 32208;
+                    break;
+                case gr::dvbt2::C3_5:
+                    kbch = 38688;
+                    break;
+                case gr::dvbt2::C2_3:
+                    kbch = 43040;
+                    break;
+                case gr::dvbt2::C3_4:
+                    kbch = 48408;
+                    break;
+                case gr::dvbt2::C4_5:
+                    kbch = 51648;
+                    break;
+                case gr::dvbt2::C5_6:
+                    kbch = 53840;
+                    break;
+            }
+        }
+        else
+        {
+            switch (rate)
+            {
+                case gr::dvbt2::C1_3:
+                    kbch = 5232;
+                    break;
+                case gr::dvbt2::C2_5:
+                    kbch = 6312;
+                    break;
+                case gr::dvbt2::C1_2:
+                    kbch = 7032;
+                    break;
+                case gr::dvbt2::C3_5:
+                    kbch = 9552;
+                    break;
+                case gr::dvbt2::C2_3:
+                    kbch = 10632;
+                    break;
+                case gr::dvbt2::C3_4:
+                    kbch = 11712;
+                    break;
+                case gr::dvbt2::C4_5:
+                    kbch = 12432;
+                    break;
+                case gr::dvbt2::C5_6:
+                    kbch = 13152;
+                    break;
+            }
+        }
+        synced = TRUE;
+        fec_blocks = 0;
+        t2_frames = 0;
+        frame_idx = -1;
+        frame_blocks = 0;
+        frame_clean = FALSE;
+        missing_blocks = 0;
+        fecframe_count = 0;
+        fecframe_key = pmt::string_to_symbol("fecframe_start");
+        l1_port = pmt::mp("l1");
+        l1_current = pmt::PMT_NIL;
+        message_port_register_out(l1_port);
+        set_tag_propagation_policy(TPP_DONT);
+        set_output_multiple(kbch);
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    t2mi_parser_bb_impl::~t2mi_parser_bb_impl()
+    {
+    }
+
+    void
+    t2mi_parser_bb_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
+    {
+        ninput_items_required[0] = (noutput_items / kbch) * (T2MI_HEADER_LENGTH + 3 + (kbch / 8) + T2MI_CRC_LENGTH);
+    }
+
+unsigned int t2mi_parser_bb_impl::get_field(const unsigned char *in, int offset_bits, int bits)
+{
+    unsigned int value = 0;
+
+    for (int n = 0; n < bits; n++)
+    {
+        value <<= 1;
+        value |= (in[offset_bits >> 3] >> (7 - (offset_bits & 0x7))) & 0x1;
+        offset_bits++;
+    }
+    return value;
+}
+
+int t2mi_parser_bb_impl::add_fields(pmt::pmt_t *dict, const L1Field *fields, int count, const unsigned char *in, int offset_bits)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (fields[i].name != NULL)
+        {
+            *dict = pmt::dict_add(*dict, pmt::intern(fields[i].name), pmt::from_long(get_field(in, offset_bits, fields[i].bits)));
+        }
+        offset_bits += fields[i].bits;
+    }
+    return offset_bits;
+}
+
+void t2mi_parser_bb_impl::parse_l1(const unsigned char *l1, int bits)
+{
+    pmt::pmt_t dict = pmt::make_dict();
+    int offset_bits, length, fef, num_plp;
+
+    /* L1PRE, then length prefixed and byte padded L1CONF and L1DYN_CURR */
+    offset_bits = add_fields(&dict, l1pre_fields, 28, l1, 0);
+    t2_frames = pmt::to_long(pmt::dict_ref(dict, pmt::intern("num_t2_frames"), pmt::PMT_NIL));
+    fef = get_field(l1, 15, 1);
+    length = get_field(l1, offset_bits, 16);
+    offset_bits += 16;
+    if (offset_bits + length > bits)
+    {
+        return;
+    }
+    num_plp = get_field(l1, offset_bits + 15, 8);
+    if (num_plp != 1)
+    {
+        printf("T2-MI L1 with %d PLPs not supported!\n", num_plp);
+        return;
+    }
+    add_fields(&dict, l1conf_fields, 6, l1, offset_bits);
+    if (fef == TRUE)
+    {
+        add_fields(&dict, l1fef_fields, 3, l1, offset_bits + 70);
+        add_fields(&dict, l1plp_fields, 23, l1, offset_bits + 104);
+    }
+    else
+    {
+        add_fields(&dict, l1plp_fields, 23, l1, offset_bits + 70);
+    }
+    offset_bits += (length + 7) & ~7;
+    length = get_field(l1, offset_bits, 16);
+    offset_bits += 16;
+    if (offset_bits + length > bits)
+    {
+        return;
+    }
+    add_fields(&dict, l1dyn_fields, 11, l1, offset_bits);
+    if (!pmt::equal(dict, l1_current))
+    {
+        l1_current = dict;
+        message_port_pub(l1_port, dict);
+    }
+}
+
+/*
+ * The frame mapper takes a fixed number of BBFRAMEs per T2 frame, so
+ * one lost to a CRC error would shift every frame after it.  The
+ * number is learnt from the first T2 frame received without errors.
+ * When the next frame starts (a new frame_idx, or intl_frame_start),
+ * a short frame is made up with dummy BBFRAMEs, and so are frames
+ * missing entirely.  Returns the number of dummy BBFRAMEs to send
+ * before this BB frame packet.
+ */
+int t2mi_parser_bb_impl::frame_start(const unsigned char *packet)
+{
+    int idx = packet[T2MI_HEADER_LENGTH];
+    int intl_frame_start = packet[T2MI_HEADER_LENGTH + 2] & 0x80;
+    int missing = 0;
+
+    if (idx == frame_idx && !(intl_frame_start && frame_blocks != 0))
+    {
+        return 0;
+    }
+    if (frame_idx >= 0 && fec_blocks != 0)
+    {
+        if (frame_blocks < fec_blocks)
+        {
+            missing = fec_blocks - frame_blocks;
+        }
+        if (t2_frames > 0 && idx < t2_frames)
+        {
+            missing += ((idx - frame_idx - 1 + t2_frames) % t2_frames) * fec_blocks;
+        }
+    }
+    if (frame_idx >= 0 && fec_blocks == 0 && frame_clean == TRUE)
+    {
+        fec_blocks = frame_blocks;
+    }
+    frame_idx = idx;
+    frame_blocks = 0;
+    frame_clean = intl_frame_start ? TRUE : FALSE;
+    return missing;
+}
+
+    int
+    t2mi_parser_bb_impl::general_work (int noutput_items,
+                       gr_vector_int &ninput_items,
+                       gr_vector_const_void_star &input_items,
+                       gr_vector_void_star &output_items)
+    {
+        const unsigned char *in = (const unsigned char *) input_items[0];
+        unsigned char *out = (unsigned char *) output_items[0];
+        const unsigned char *packet;
+        int available = ninput_items[0];
+        int consumed = 0;
+        int produced = 0;
+        int payload_bits, length;
+
+        while (produced + kbch <= noutput_items)
+        {
+            if (missing_blocks > 0)
+            {
+                /* an all-zero BBHEADER has a valid CRC-8 and DFL 0 */
+                add_item_tag(0, nitems_written(0) + produced, fecframe_key, pmt::from_uint64(fecframe_count++));
+                memset(&out[produced], 0, kbch);
+                produced += kbch;
+                missing_blocks--;
+                continue;
+            }
+            if (available - consumed < T2MI_HEADER_LENGTH)
+            {
+                break;
+            }
+            packet = &in[consumed];
+            payload_bits = (packet[4] << 8) | packet[5];
+            length = T2MI_HEADER_LENGTH + ((payload_bits + 7) / 8) + T2MI_CRC_LENGTH;
+            if (available - consumed < length)
+            {
+                break;
+            }
+            if (t2mi_crc32(packet, length) != 0)
+            {
+                if (synced == TRUE)
+                {
+                    printf("T2-MI CRC error!\n");
+                    synced = FALSE;
+                }
+                frame_clean = FALSE;
+                consumed++;
+                continue;
+            }
+            synced = TRUE;
+            switch (packet[0])
+            {
+                case T2MI_TYPE_BBFRAME:
+                    if (payload_bits - 24 == kbch)
+                    {
+                        missing_blocks = frame_start(packet);
+                        if (missing_blocks > 0)
+                        {
+                            /* the packet is parsed again after the dummy frames */
+                            continue;
+                        }
+                        frame_blocks++;
+                        /* unpack the BBFRAME straight out of the input buffer */
+                        add_item_tag(0, nitems_written(0) + produced, fecframe_key, pmt::from_uint64(fecframe_count++));
+                        packet += T2MI_HEADER_LENGTH + 3;
+                        for (int j = 0; j < kbch / 8; j++)
+                        {
+                            for (int n = 7; n >= 0; n--)
+                            {
+                                out[produced++] = packet[j] & (1 << n) ? 1 : 0;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        printf("T2-MI BB frame size mismatch!\n");
+                    }
+                    break;
+                case T2MI_TYPE_L1_CURRENT:
+                    parse_l1(&packet[T2MI_HEADER_LENGTH + 2], payload_bits - 16);
+                    break;
+                default:
+                    break;
+            }
+            consumed += length;
+        }
+
+        // Tell runtime system how many input items we consumed on
+        // each input stream.
+        consume_each (consumed);
+
+        // Tell runtime system how many output items we produced.
+        return produced;
+    }
+
+    const L1Field t2mi_parser_bb_impl::l1pre_fields[28] =
+    {
+        {"type", 8}, {"bwt_ext", 1}, {"s1", 3}, {"s2", 3}, {NULL, 1},
+        {"l1_repetition_flag", 1}, {"guard_interval", 3}, {"papr", 4},
+        {"l1_mod", 4}, {"l1_cod", 2}, {"l1_fec_type", 2},
+        {"l1_post_size", 18}, {"l1_post_info_size", 18},
+        {"pilot_pattern", 4}, {"tx_id_availability", 8}, {"cell_id", 16},
+        {"network_id", 16}, {"t2_system_id", 16}, {"num_t2_frames", 8},
+        {"num_data_symbols", 12}, {"regen_flag", 3},
+        {"l1_post_extension", 1}, {"num_rf", 3}, {"current_rf_index", 3},
+        {"t2_version", 4}, {"l1_post_scrambled", 1}, {"t2_base_lite", 1},
+        {"reserved", 4}
+    };
+
+    const L1Field t2mi_parser_bb_impl::l1conf_fields[6] =
+    {
+        {"sub_slices_per_frame", 15}, {"num_plp", 8}, {"num_aux", 4},
+        {"aux_config_rfu", 8}, {"rf_idx", 3}, {"frequency", 32}
+    };
+
+    const L1Field t2mi_parser_bb_impl::l1fef_fields[3] =
+    {
+        {"fef_type", 4}, {"fef_length", 22}, {"fef_interval", 8}
+    };
+
+    const L1Field t2mi_parser_bb_impl::l1plp_fields[23] =
+    {
+        {"plp_id", 8}, {"plp_type", 3}, {"plp_payload_type", 5},
+        {"ff_flag", 1}, {"first_rf_idx", 3}, {"first_frame_idx", 8},
+        {"plp_group_id", 8}, {"plp_cod", 3}, {"plp_mod", 3},
+        {"plp_rotation", 1}, {"plp_fec_type", 2},
+        {"plp_num_blocks_max", 10}, {"frame_interval", 8},
+        {"time_il_length", 8}, {"time_il_type", 1}, {"in_band_a_flag", 1},
+        {"in_band_b_flag", 1}, {"reserved_1", 11}, {"plp_mode", 2},
+        {"static_flag", 1}, {"static_padding_flag", 1},
+        {"fef_length_msb", 2}, {"reserved_2", 30}
+    };
+
+    const L1Field t2mi_parser_bb_impl::l1dyn_fields[11] =
+    {
+        {NULL, 8}, {"sub_slice_interval", 22}, {"type_2_start", 22},
+        {"l1_change_counter", 8}, {"start_rf_idx", 3}, {"reserved_3", 8},
+        {"plp_id_dynamic", 8}, {"plp_start", 22}, {"plp_num_blocks", 10},
+        {"reserved_4", 8}, {"reserved_5", 8}
+    };
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
+
@@ -0,0 +1,83 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 Ron Economos.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_T2MI_PARSER_BB_IMPL_H
+#define INCLUDED_DVBT2_T2MI_PARSER_BB_IMPL_H
+
+#include <dvbt2/t2mi_parser_bb.h>
+
+#define T2MI_HEADER_LENGTH 6
+#define T2MI_CRC_LENGTH 4
+
+#define T2MI_TYPE_BBFRAME 0x00
+#define T2MI_TYPE_L1_CURRENT 0x10
+
+typedef struct{
+    const char *name;
+    int bits;
+}L1Field;
+
+namespace gr {
+  namespace dvbt2 {
+
+    class t2mi_parser_bb_impl : public t2mi_parser_bb
+    {
+     private:
+      int kbch;
+      int synced;
+      int fec_blocks;
+      int t2_frames;
+      int frame_idx;
+      int frame_blocks;
+      int frame_clean;
+      int missing_blocks;
+      uint64_t fecframe_count;
+      pmt::pmt_t fecframe_key;
+      pmt::pmt_t l1_port;
+      pmt::pmt_t l1_current;
+      unsigned int get_field(const unsigned char *, int, int);
+      int add_fields(pmt::pmt_t *, const L1Field *, int, const unsigned char *, int);
+      void parse_l1(const unsigned char *, int);
+      int frame_start(const unsigned char *);
+
+      const static L1Field l1pre_fields[28];
+      const static L1Field l1conf_fields[6];
+      const static L1Field l1fef_fields[3];
+      const static L1Field l1plp_fields[23];
+      const static L1Field l1dyn_fields[11];
+
+     public:
+      t2mi_parser_bb_impl(dvbt2_framesize_t framesize, dvbt2_code_rate_t rate);
+      ~t2mi_parser_bb_impl();
+
+      // Where all the action really happens
+      void forecast (int noutput_items, gr_vector_int &ninput_items_required);
+
+      int general_work(int noutput_items,
+		       gr_vector_int &ninput_items,
+		       gr_vector_const_void_star &input_items,
+		       gr_vector_void_star &output_items);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_T2MI_PARSER_BB_IMPL_H */
+
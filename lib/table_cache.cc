@@ -0,0 +1,214 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "table_cache.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* bump when a cached table changes layout or contents */
+#define TABLE_CACHE_MAGIC "gr-dvbt2 tables 3"
+
+namespace gr {
+  namespace dvbt2 {
+
+static std::string
+cache_directory(void)
+{
+    const char *dir = getenv("GR_DVBT2_CACHE");
+
+    if (dir == NULL)
+    {
+        return "";
+    }
+    return dir;
+}
+
+/* FNV-1a over the file after the magic, stored as the last 8 bytes */
+static uint64_t
+fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#define FNV1A_INIT 0xcbf29ce484222325ULL
+
+    table_cache::table_cache(const char *format, ...)
+      : map(NULL), map_size(0), map_offset(0), fp(NULL), checksum(FNV1A_INIT)
+    {
+        std::string dir = cache_directory();
+        char name[128];
+        char pid[32];
+        va_list args;
+
+        if (dir.empty())
+        {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(name, sizeof(name), format, args);
+        va_end(args);
+        snprintf(pid, sizeof(pid), ".%d", (int)getpid());
+        path = dir + "/" + name;
+        temp_path = path + pid;
+    }
+
+    table_cache::~table_cache()
+    {
+        if (map != NULL)
+        {
+            munmap((void *)map, map_size + sizeof(uint64_t));
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+            unlink(temp_path.c_str());
+        }
+    }
+
+    bool
+    table_cache::load(void)
+    {
+        struct stat st;
+        void *addr;
+        uint64_t stored;
+        int fd;
+
+        if (path.empty())
+        {
+            return false;
+        }
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(TABLE_CACHE_MAGIC) + sizeof(uint64_t)))
+        {
+            close(fd);
+            return false;
+        }
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+        map = (const unsigned char *)addr;
+        map_size = st.st_size - sizeof(uint64_t);
+        if (memcmp(map, TABLE_CACHE_MAGIC, sizeof(TABLE_CACHE_MAGIC)) != 0)
+        {
+            return false;
+        }
+        memcpy(&stored, map + map_size, sizeof(uint64_t));
+        if (fnv1a(FNV1A_INIT, map + sizeof(TABLE_CACHE_MAGIC), map_size - sizeof(TABLE_CACHE_MAGIC)) != stored)
+        {
+            return false;
+        }
+        map_offset = sizeof(TABLE_CACHE_MAGIC);
+        return true;
+    }
+
+    bool
+    table_cache::get(void *table, size_t size)
+    {
+        uint64_t stored;
+
+        if (map == NULL || sizeof(uint64_t) > map_size - map_offset)
+        {
+            return false;
+        }
+        memcpy(&stored, map + map_offset, sizeof(uint64_t));
+        if (stored != size || size > map_size - map_offset - sizeof(uint64_t))
+        {
+            return false;
+        }
+        map_offset += sizeof(uint64_t);
+        memcpy(table, map + map_offset, size);
+        map_offset += size;
+        return true;
+    }
+
+    void
+    table_cache::write(const void *data, size_t size)
+    {
+        fwrite(data, 1, size, fp);
+        checksum = fnv1a(checksum, data, size);
+    }
+
+    void
+    table_cache::put(const void *table, size_t size)
+    {
+        uint64_t stored = size;
+
+        if (path.empty())
+        {
+            return;
+        }
+        if (fp == NULL)
+        {
+            fp = fopen(temp_path.c_str(), "wb");
+            if (fp == NULL)
+            {
+                path.clear();
+                return;
+            }
+            fwrite(TABLE_CACHE_MAGIC, 1, sizeof(TABLE_CACHE_MAGIC), fp);
+        }
+        write(&stored, sizeof(uint64_t));
+        write(table, size);
+    }
+
+    void
+    table_cache::store(void)
+    {
+        int error;
+
+        if (fp == NULL)
+        {
+            return;
+        }
+        fwrite(&checksum, 1, sizeof(uint64_t), fp);
+        error = ferror(fp);
+        error |= fclose(fp);
+        fp = NULL;
+        if (error != 0 || rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            unlink(temp_path.c_str());
+        }
+    }
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
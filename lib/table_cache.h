@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DVBT2_TABLE_CACHE_H
+#define INCLUDED_DVBT2_TABLE_CACHE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+namespace gr {
+  namespace dvbt2 {
+
+    /*
+     * On-disk cache for tables derived in a constructor.
+     *
+     * Off unless GR_DVBT2_CACHE names a directory.  Each entry is one
+     * file there, named after the block and the configuration the
+     * tables depend on.
+     *
+     * load() maps the file and checks its checksum, and get() copies
+     * the tables out in the order they were written with put(), each
+     * only if its stored size matches.  Any failure (missing, short,
+     * damaged or foreign file) makes the caller build the tables and
+     * store() a fresh entry, which is written under a temporary name
+     * and renamed so a reader never sees a partial file.  Callers
+     * still range check loaded indices before using them.
+     */
+    class table_cache
+    {
+     private:
+      std::string path;
+      std::string temp_path;
+      const unsigned char *map;
+      size_t map_size;
+      size_t map_offset;
+      FILE *fp;
+      uint64_t checksum;
+      void write(const void *, size_t);
+
+     public:
+      table_cache(const char *format, ...);
+      ~table_cache();
+      bool load(void);
+      bool get(void *table, size_t size);
+      void put(const void *table, size_t size);
+      void store(void);
+    };
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_TABLE_CACHE_H */
@@ -0,0 +1,356 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vv_chain.h"
+#include <gnuradio/blocks/vector_source_b.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <gnuradio/blocks/vector_sink_b.h>
+#include <gnuradio/blocks/vector_sink_c.h>
+#include <dvbt2/bbheader_bb.h>
+#include <dvbt2/bbscrambler_bb.h>
+#include <dvbt2/bch_bb.h>
+#include <dvbt2/ldpc_bb.h>
+#include <dvbt2/interleaver_bb.h>
+#include <dvbt2/modulator_bc.h>
+#include <dvbt2/cellinterleaver_cc.h>
+#include <dvbt2/framemapper_cc.h>
+#include <dvbt2/freqinterleaver_cc.h>
+#include <dvbt2/pilotgenerator_cc.h>
+#include <dvbt2/paprtr_cc.h>
+#include <dvbt2/p1insertion_cc.h>
+#include <sys/time.h>
+#include <string.h>
+
+namespace gr {
+  namespace dvbt2 {
+
+    /* parameters as used by the flowgraphs in apps/, MISO only runs TX1 */
+    const vv_config vv_configs[] = {
+      {"vv001_cr35", FECFRAME_NORMAL, C3_5, MOD_256QAM, ROTATION_ON, 202, 3, CARRIERS_EXTENDED, FFTSIZE_32K_T2GI, GI_1_128, L1_MOD_64QAM, PILOT_PP7, 59, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv003_cr23", FECFRAME_NORMAL, C2_3, MOD_256QAM, ROTATION_ON, 202, 3, CARRIERS_EXTENDED, FFTSIZE_32K_T2GI, GI_1_128, L1_MOD_64QAM, PILOT_PP7, 59, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_ON, BANDWIDTH_8_0_MHZ, 64000000.0 / 7.0},
+      {"vv004_8kfft", FECFRAME_NORMAL, C3_4, MOD_64QAM, ROTATION_ON, 50, 1, CARRIERS_EXTENDED, FFTSIZE_8K_T2GI, GI_19_256, L1_MOD_64QAM, PILOT_PP5, 81, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv005_8kfft", FECFRAME_NORMAL, C3_5, MOD_256QAM, ROTATION_ON, 50, 3, CARRIERS_EXTENDED, FFTSIZE_8K, GI_1_16, L1_MOD_64QAM, PILOT_PP8, 59, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv007_16kfft", FECFRAME_NORMAL, C2_3, MOD_16QAM, ROTATION_ON, 50, 3, CARRIERS_EXTENDED, FFTSIZE_16K, GI_19_128, L1_MOD_64QAM, PILOT_PP8, 59, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv008_16kfft", FECFRAME_NORMAL, C4_5, MOD_256QAM, ROTATION_ON, 168, 3, CARRIERS_EXTENDED, FFTSIZE_16K, GI_1_32, L1_MOD_64QAM, PILOT_PP6, 100, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_NORMAL, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv009_4kfft", FECFRAME_NORMAL, C2_3, MOD_64QAM, ROTATION_ON, 31, 3, CARRIERS_NORMAL, FFTSIZE_4K, GI_1_32, L1_MOD_16QAM, PILOT_PP7, 100, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_NORMAL, EQUALIZATION_ON, BANDWIDTH_8_0_MHZ, 64000000.0 / 7.0},
+      {"vv010_2kfft", FECFRAME_NORMAL, C3_5, MOD_16QAM, ROTATION_ON, 93, 3, CARRIERS_NORMAL, FFTSIZE_2K, GI_1_8, L1_MOD_QPSK, PILOT_PP2, 983, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_NORMAL, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv011_1kfft", FECFRAME_NORMAL, C1_2, MOD_QPSK, ROTATION_ON, 48, 3, CARRIERS_NORMAL, FFTSIZE_1K, GI_1_8, L1_MOD_BPSK, PILOT_PP3, 1966, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_NORMAL, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv012_64qam45", FECFRAME_NORMAL, C4_5, MOD_64QAM, ROTATION_ON, 151, 3, CARRIERS_EXTENDED, FFTSIZE_8K, GI_1_32, L1_MOD_64QAM, PILOT_PP7, 242, PAPR_TR, 2.57, 50, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv014_64qam34", FECFRAME_NORMAL, C3_4, MOD_64QAM, ROTATION_ON, 151, 3, CARRIERS_EXTENDED, FFTSIZE_8K, GI_1_32, L1_MOD_64QAM, PILOT_PP7, 242, PAPR_TR, 2.83, 9, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv015_8kfft", FECFRAME_NORMAL, C3_5, MOD_256QAM, ROTATION_ON, 200, 3, CARRIERS_EXTENDED, FFTSIZE_8K, GI_1_32, L1_MOD_64QAM, PILOT_PP7, 238, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv016_256qam34", FECFRAME_NORMAL, C3_4, MOD_256QAM, ROTATION_ON, 200, 3, CARRIERS_EXTENDED, FFTSIZE_32K_T2GI, GI_1_128, L1_MOD_64QAM, PILOT_PP7, 59, PAPR_TR, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv018_miso", FECFRAME_NORMAL, C5_6, MOD_256QAM, ROTATION_ON, 61, 1, CARRIERS_EXTENDED, FFTSIZE_32K, GI_1_16, L1_MOD_64QAM, PILOT_PP2, 19, PAPR_OFF, 3.3, 3, PREAMBLE_T2_MISO, INPUTMODE_HIEFF, EQUALIZATION_ON, BANDWIDTH_8_0_MHZ, 64000000.0 / 7.0},
+      {"vv019_norot", FECFRAME_NORMAL, C3_5, MOD_256QAM, ROTATION_OFF, 202, 3, CARRIERS_EXTENDED, FFTSIZE_32K_T2GI, GI_1_128, L1_MOD_64QAM, PILOT_PP7, 59, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+      {"vv034_dtg016", FECFRAME_SHORT, C4_5, MOD_QPSK, ROTATION_ON, 204, 0, CARRIERS_NORMAL, FFTSIZE_4K, GI_1_16, L1_MOD_QPSK, PILOT_PP5, 500, PAPR_OFF, 3.3, 3, PREAMBLE_T2_SISO, INPUTMODE_HIEFF, EQUALIZATION_OFF, BANDWIDTH_1_7_MHZ, 8000000.0},
+    };
+
+    const int num_vv_configs = sizeof(vv_configs) / sizeof(vv_configs[0]);
+
+    /* units: TS payload bits, FEC bits, cells or baseband samples */
+    const stage_info stage_infos[NUM_STAGES] = {
+      {"bbheader_bb", "bit", false, false, false},
+      {"bbscrambler_bb", "bit", false, false, false},
+      {"bch_bb", "bit", false, false, false},
+      {"ldpc_bb", "bit", false, false, false},
+      {"interleaver_bb", "bit", false, false, false},
+      {"modulator_bc", "cell", false, true, false},
+      {"cellinterleaver_cc", "cell", true, true, false},
+      {"framemapper_cc", "cell", true, true, false},
+      {"freqinterleaver_cc", "cell", true, true, false},
+      {"pilotgenerator_cc", "sample", true, true, true},
+      {"paprtr_cc", "sample", true, true, true},
+      {"p1insertion_cc", "sample", true, true, true},
+    };
+
+    int
+    fft_length(dvbt2_fftsize_t fftsize)
+    {
+      switch (fftsize) {
+        case FFTSIZE_1K:
+          return 1024;
+        case FFTSIZE_2K:
+          return 2048;
+        case FFTSIZE_4K:
+          return 4096;
+        case FFTSIZE_8K:
+        case FFTSIZE_8K_T2GI:
+          return 8192;
+        case FFTSIZE_16K:
+        case FFTSIZE_16K_T2GI:
+          return 16384;
+        default:
+          return 32768;
+      }
+    }
+
+    /* vector length of the stage input and output streams */
+    int
+    stage_vlen_in(const vv_config &c, int stage)
+    {
+      return (stage >= STAGE_PAPRTR) ? fft_length(c.fftsize) : 1;
+    }
+
+    int
+    stage_vlen_out(const vv_config &c, int stage)
+    {
+      return (stage == STAGE_PILOTGENERATOR || stage == STAGE_PAPRTR) ? fft_length(c.fftsize) : 1;
+    }
+
+    gr::basic_block_sptr
+    make_stage(const vv_config &c, int stage)
+    {
+      int fftsize = fft_length(c.fftsize);
+
+      switch (stage) {
+        case STAGE_BBHEADER:
+          return bbheader_bb::make(c.framesize, c.rate, c.inputmode, INBAND_OFF, c.fecblocks, 4000000);
+        case STAGE_BBSCRAMBLER:
+          return bbscrambler_bb::make(c.framesize, c.rate);
+        case STAGE_BCH:
+          return bch_bb::make(c.framesize, c.rate);
+        case STAGE_LDPC:
+          return ldpc_bb::make(c.framesize, c.rate);
+        case STAGE_INTERLEAVER:
+          return interleaver_bb::make(c.framesize, c.rate, c.constellation);
+        case STAGE_MODULATOR:
+          return modulator_bc::make(c.framesize, c.constellation, c.rotation);
+        case STAGE_CELLINTERLEAVER:
+          return cellinterleaver_cc::make(c.framesize, c.constellation, c.fecblocks, c.tiblocks);
+        case STAGE_FRAMEMAPPER:
+          return framemapper_cc::make(c.framesize, c.rate, c.constellation, c.rotation, c.fecblocks, c.tiblocks, c.carriermode, c.fftsize, c.guardinterval, c.l1constellation, c.pilotpattern, 2, c.numdatasyms, c.paprmode, VERSION_111, c.preamble, INPUTMODE_NORMAL, RESERVED_OFF, L1_SCRAMBLED_OFF, INBAND_OFF);
+        case STAGE_FREQINTERLEAVER:
+          return freqinterleaver_cc::make(c.carriermode, c.fftsize, c.pilotpattern, c.guardinterval, c.numdatasyms, c.paprmode, VERSION_111, c.preamble);
+        case STAGE_PILOTGENERATOR:
+          return pilotgenerator_cc::make(c.carriermode, c.fftsize, c.pilotpattern, c.guardinterval, c.numdatasyms, c.paprmode, VERSION_111, c.preamble, MISO_TX1, c.equalization, c.bandwidth, fftsize);
+        case STAGE_PAPRTR:
+          return paprtr_cc::make(c.carriermode, c.fftsize, c.pilotpattern, c.guardinterval, c.numdatasyms, c.paprmode, VERSION_111, c.vclip, c.iterations, fftsize);
+        default:
+#ifdef DVBT2_GOLDEN_BASELINE
+          return p1insertion_cc::make(c.carriermode, c.fftsize, c.guardinterval, c.numdatasyms, c.preamble, SHOWLEVELS_OFF, 3.3);
+#else
+          return p1insertion_cc::make(c.carriermode, c.fftsize, c.guardinterval, c.numdatasyms, c.preamble, SHOWLEVELS_OFF, 3.3, CYCLICPREFIX_INTERNAL);
+#endif
+      }
+    }
+
+#ifdef DVBT2_GOLDEN_BASELINE
+    static int
+    guard_length(const vv_config &c)
+    {
+      int fftsize = fft_length(c.fftsize);
+
+      switch (c.guardinterval) {
+        case GI_1_32:
+          return fftsize / 32;
+        case GI_1_16:
+          return fftsize / 16;
+        case GI_1_8:
+          return fftsize / 8;
+        case GI_1_4:
+          return fftsize / 4;
+        case GI_1_128:
+          return fftsize / 128;
+        case GI_19_128:
+          return (fftsize * 19) / 128;
+        default:
+          return (fftsize * 19) / 256;
+      }
+    }
+
+    /*
+     * The baseline p1insertion_cc expects the guard intervals in its
+     * input, added by digital.ofdm_cyclic_prefixer in the apps/vv*
+     * flowgraphs.  This does the same without a dependency on gr-digital.
+     */
+    class cyclic_prefixer : public gr::block
+    {
+    public:
+      cyclic_prefixer(int fftsize, int guard)
+        : gr::block("cyclic_prefixer",
+                    gr::io_signature::make(1, 1, sizeof(gr_complex) * fftsize),
+                    gr::io_signature::make(1, 1, sizeof(gr_complex))),
+          fft_size(fftsize), guard_interval(guard)
+      {
+        set_output_multiple(fftsize + guard);
+      }
+
+      void
+      forecast(int noutput_items, gr_vector_int &ninput_items_required)
+      {
+        ninput_items_required[0] = noutput_items / (fft_size + guard_interval);
+      }
+
+      int
+      general_work(int noutput_items, gr_vector_int &ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
+      {
+        const gr_complex *in = (const gr_complex *)input_items[0];
+        gr_complex *out = (gr_complex *)output_items[0];
+        int symbols = noutput_items / (fft_size + guard_interval);
+
+        for (int i = 0; i < symbols; i++) {
+          memcpy(out, &in[fft_size - guard_interval], sizeof(gr_complex) * guard_interval);
+          memcpy(&out[guard_interval], in, sizeof(gr_complex) * fft_size);
+          in += fft_size;
+          out += fft_size + guard_interval;
+        }
+        consume_each(symbols);
+        return symbols * (fft_size + guard_interval);
+      }
+
+    private:
+      int fft_size;
+      int guard_interval;
+    };
+#endif
+
+    /*
+     * Make a stage and connect it after prev.  Built for the baseline tree
+     * with DVBT2_GOLDEN_BASELINE, the guard intervals are added in front of
+     * p1insertion_cc, and every block from framemapper_cc on runs one T2
+     * frame per call: the baseline framemapper_cc, pilotgenerator_cc and
+     * p1insertion_cc build all the T2 frames that fit in noutput_items but
+     * consume the input of only the first, so the frames after it repeat
+     * stale input whenever the scheduler asks for more than one.
+     */
+    gr::basic_block_sptr
+    connect_stage(gr::top_block_sptr tb, gr::basic_block_sptr prev, const vv_config &c, int stage)
+    {
+      gr::basic_block_sptr block = make_stage(c, stage);
+
+#ifdef DVBT2_GOLDEN_BASELINE
+      if (stage == STAGE_P1INSERTION) {
+        gr::basic_block_sptr prefixer = gnuradio::get_initial_sptr(new cyclic_prefixer(fft_length(c.fftsize), guard_length(c)));
+        tb->connect(prev, 0, prefixer, 0);
+        prev = prefixer;
+      }
+      if (stage >= STAGE_FRAMEMAPPER) {
+        gr::block_sptr frame_block = boost::dynamic_pointer_cast<gr::block>(block);
+        frame_block->set_max_noutput_items(frame_block->output_multiple());
+      }
+#endif
+      tb->connect(prev, 0, block, 0);
+      return block;
+    }
+
+    int
+    output_multiple(gr::basic_block_sptr block)
+    {
+      gr::block_sptr b = boost::dynamic_pointer_cast<gr::block>(block);
+      return b ? b->output_multiple() : 0;
+    }
+
+    /* the vv flowgraphs only include paprtr_cc when PAPR is enabled */
+    std::vector<int>
+    chain_stages(const vv_config &c)
+    {
+      std::vector<int> stages;
+      for (int i = 0; i < NUM_STAGES; i++) {
+        if (i == STAGE_PAPRTR && c.paprmode == PAPR_OFF) {
+          continue;
+        }
+        stages.push_back(i);
+      }
+      return stages;
+    }
+
+    std::vector<unsigned char>
+    make_transport_stream(const vv_config &c, int frames)
+    {
+      int bytes_per_block = (c.framesize == FECFRAME_NORMAL) ? FRAME_SIZE_NORMAL / 8 : FRAME_SIZE_SHORT / 8;
+      int packets = (frames * c.fecblocks * bytes_per_block) / 188 + 1;
+      std::vector<unsigned char> ts(packets * 188);
+
+      /* fixed LCG rather than rand() so the stream is identical on every platform */
+      unsigned int seed = 1;
+      for (int i = 0; i < packets; i++) {
+        ts[i * 188] = 0x47;
+        for (int j = 1; j < 188; j++) {
+          seed = seed * 1103515245 + 12345;
+          ts[i * 188 + j] = (seed >> 16) & 0xff;
+        }
+      }
+      return ts;
+    }
+
+    double
+    now(void)
+    {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      return tv.tv_sec + (tv.tv_usec / 1e6);
+    }
+
+    gr::basic_block_sptr
+    make_source(const capture &in, bool complex_in, int vlen)
+    {
+      if (complex_in) {
+        return gr::blocks::vector_source_c::make(in.cells, false, vlen, in.tags);
+      }
+      return gr::blocks::vector_source_b::make(in.bytes, false, vlen, in.tags);
+    }
+
+    /* run the chain once and record the output of every stage */
+    void
+    capture_stages(const vv_config &c, const std::vector<int> &stages, const std::vector<unsigned char> &ts, std::vector<capture> &outputs)
+    {
+      gr::top_block_sptr tb = gr::make_top_block("dvbt2_vv_capture");
+      std::vector<gr::basic_block_sptr> blocks;
+      std::vector<gr::basic_block_sptr> sinks;
+      gr::basic_block_sptr prev = gr::blocks::vector_source_b::make(ts, false, 1);
+
+      for (unsigned int i = 0; i < stages.size(); i++) {
+        int stage = stages[i];
+        gr::basic_block_sptr block = connect_stage(tb, prev, c, stage);
+        gr::basic_block_sptr sink;
+        if (stage_infos[stage].complex_out) {
+          sink = gr::blocks::vector_sink_c::make(stage_vlen_out(c, stage));
+        }
+        else {
+          sink = gr::blocks::vector_sink_b::make(stage_vlen_out(c, stage));
+        }
+        tb->connect(block, 0, sink, 0);
+        blocks.push_back(block);
+        sinks.push_back(sink);
+        prev = block;
+      }
+      tb->run();
+
+      outputs.assign(stages.size(), capture());
+      for (unsigned int i = 0; i < sinks.size(); i++) {
+        outputs[i].multiple = output_multiple(blocks[i]);
+        if (stage_infos[stages[i]].complex_out) {
+          gr::blocks::vector_sink_c::sptr sink = boost::dynamic_pointer_cast<gr::blocks::vector_sink_c>(sinks[i]);
+          outputs[i].cells = sink->data();
+          outputs[i].tags = sink->tags();
+        }
+        else {
+          gr::blocks::vector_sink_b::sptr sink = boost::dynamic_pointer_cast<gr::blocks::vector_sink_b>(sinks[i]);
+          outputs[i].bytes = sink->data();
+          outputs[i].tags = sink->tags();
+        }
+      }
+    }
+
+  } /* namespace dvbt2 */
+} /* namespace gr */
@@ -0,0 +1,112 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2014 Ron Economos.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Reference configurations from apps/vv* and helpers to build and run
+ * them, shared by bench_dvbt2 and the golden vector regression test.
+ */
+
+#ifndef INCLUDED_DVBT2_VV_CHAIN_H
+#define INCLUDED_DVBT2_VV_CHAIN_H
+
+#include <gnuradio/top_block.h>
+#include <dvbt2/dvbt2_config.h>
+#include <vector>
+
+namespace gr {
+  namespace dvbt2 {
+
+    struct vv_config {
+      const char *name;
+      dvbt2_framesize_t framesize;
+      dvbt2_code_rate_t rate;
+      dvbt2_constellation_t constellation;
+      dvbt2_rotation_t rotation;
+      int fecblocks;
+      int tiblocks;
+      dvbt2_extended_carrier_t carriermode;
+      dvbt2_fftsize_t fftsize;
+      dvbt2_guardinterval_t guardinterval;
+      dvbt2_l1constellation_t l1constellation;
+      dvbt2_pilotpattern_t pilotpattern;
+      int numdatasyms;
+      dvbt2_papr_t paprmode;
+      float vclip;
+      int iterations;
+      dvbt2_preamble_t preamble;
+      dvbt2_inputmode_t inputmode;
+      dvbt2_equalization_t equalization;
+      dvbt2_bandwidth_t bandwidth;
+      double samp_rate;
+    };
+
+    extern const vv_config vv_configs[];
+    extern const int num_vv_configs;
+
+    enum vv_stage_t {
+      STAGE_BBHEADER = 0,
+      STAGE_BBSCRAMBLER,
+      STAGE_BCH,
+      STAGE_LDPC,
+      STAGE_INTERLEAVER,
+      STAGE_MODULATOR,
+      STAGE_CELLINTERLEAVER,
+      STAGE_FRAMEMAPPER,
+      STAGE_FREQINTERLEAVER,
+      STAGE_PILOTGENERATOR,
+      STAGE_PAPRTR,
+      STAGE_P1INSERTION,
+      NUM_STAGES,
+    };
+
+    struct stage_info {
+      const char *name;
+      const char *unit;
+      bool complex_in;
+      bool complex_out;
+      bool per_output;
+    };
+
+    extern const stage_info stage_infos[NUM_STAGES];
+
+    struct capture {
+      std::vector<unsigned char> bytes;
+      std::vector<gr_complex> cells;
+      std::vector<gr::tag_t> tags;
+      int multiple;     /* output multiple of the stage block after the run */
+      capture() : multiple(0) {}
+    };
+
+    int fft_length(dvbt2_fftsize_t fftsize);
+    int stage_vlen_in(const vv_config &c, int stage);
+    int stage_vlen_out(const vv_config &c, int stage);
+    gr::basic_block_sptr make_stage(const vv_config &c, int stage);
+    gr::basic_block_sptr connect_stage(gr::top_block_sptr tb, gr::basic_block_sptr prev, const vv_config &c, int stage);
+    int output_multiple(gr::basic_block_sptr block);
+    std::vector<int> chain_stages(const vv_config &c);
+    std::vector<unsigned char> make_transport_stream(const vv_config &c, int frames);
+    gr::basic_block_sptr make_source(const capture &in, bool complex_in, int vlen);
+    void capture_stages(const vv_config &c, const std::vector<int> &stages, const std::vector<unsigned char> &ts, std::vector<capture> &outputs);
+    double now(void);
+
+  } // namespace dvbt2
+} // namespace gr
+
+#endif /* INCLUDED_DVBT2_VV_CHAIN_H */
@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# 
+# Copyright 2014 Ron Economos.
+# 
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+# 
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this software; see the file COPYING.  If not, write to
+# the Free Software Foundation, Inc., 51 Franklin Street,
+# Boston, MA 02110-1301, USA.
+# 
+
+from gnuradio import gr, gr_unittest
+from gnuradio import blocks
+import dvbt2_swig as dvbt2
+
+def crc32 (data):
+    crc = 0xffffffff
+    for byte in data:
+        crc ^= byte << 24
+        for i in range(8):
+            if crc & 0x80000000:
+                crc = ((crc << 1) ^ 0x04c11db7) & 0xffffffff
+            else:
+                crc = (crc << 1) & 0xffffffff
+    return crc
+
+def pack_bits (bits):
+    data = []
+    for i in range(0, len(bits), 8):
+        byte = 0
+        for bit in bits[i:i + 8]:
+            byte = (byte << 1) | bit
+        data.append(byte)
+    return data
+
+class qa_t2mi_gateway_bb (gr_unittest.TestCase):
+
+    KBCH = 7032    # short FECFRAME, code rate 1/2
+    FECBLOCKS = 2
+    T2FRAMES = 2
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+
+    def tearDown (self):
+        self.tb = None
+
+    def run_gateway (self, bits, payloadtype):
+        src = blocks.vector_source_b(bits)
+        gateway = dvbt2.t2mi_gateway_bb(dvbt2.FECFRAME_SHORT, dvbt2.C1_2, dvbt2.MOD_QPSK, dvbt2.ROTATION_OFF, self.FECBLOCKS, 1, dvbt2.CARRIERS_NORMAL, dvbt2.FFTSIZE_2K, dvbt2.GI_1_32, dvbt2.L1_MOD_16QAM, dvbt2.PILOT_PP7, self.T2FRAMES, 100, dvbt2.PAPR_OFF, dvbt2.VERSION_111, dvbt2.PREAMBLE_T2_SISO, dvbt2.INPUTMODE_NORMAL, dvbt2.RESERVED_OFF, dvbt2.L1_SCRAMBLED_OFF, dvbt2.INBAND_OFF, dvbt2.BANDWIDTH_8_0_MHZ, payloadtype)
+        dst = blocks.vector_sink_b()
+        self.tb.connect(src, gateway, dst)
+        self.tb.run ()
+        return list(dst.data())
+
+    def split_packets (self, data):
+        packets = []
+        i = 0
+        while i < len(data):
+            payload_bits = (data[i + 4] << 8) | data[i + 5]
+            length = 6 + (payload_bits + 7) // 8 + 4
+            packets.append(data[i:i + length])
+            i += length
+        self.assertEqual(i, len(data))
+        return packets
+
+    def test_001_layout (self):
+        frames = self.T2FRAMES * 2
+        bits = [(n * 7 + n // 13) & 1 for n in range(self.KBCH * self.FECBLOCKS * frames)]
+        packets = self.split_packets(self.run_gateway(bits, dvbt2.PAYLOAD_TS))
+        # timestamp, one BB frame per FEC block and L1-current for each T2 frame
+        types = ([0x20] + [0x00] * self.FECBLOCKS + [0x10]) * frames
+        self.assertEqual([p[0] for p in packets], types)
+        for n in range(len(packets)):
+            p = packets[n]
+            self.assertEqual(p[1], n & 0xff)
+            crc = crc32(p[:-4])
+            self.assertEqual(p[-4:], [(crc >> 24) & 0xff, (crc >> 16) & 0xff, (crc >> 8) & 0xff, crc & 0xff])
+        # an intact packet always has a zero CRC-32 remainder
+        self.assertEqual(crc32(packets[0]), 0)
+        stride = self.FECBLOCKS + 2
+        for frame in range(frames):
+            superframe_idx = frame // self.T2FRAMES
+            for p in packets[frame * stride:(frame + 1) * stride]:
+                self.assertEqual(p[2] >> 4, superframe_idx)
+            for n in range(self.FECBLOCKS):
+                p = packets[frame * stride + 1 + n]
+                self.assertEqual((p[4] << 8) | p[5], 24 + self.KBCH)
+                self.assertEqual(p[6], frame % self.T2FRAMES)
+                self.assertEqual(p[8], 0x80 if n == 0 else 0x00)
+                start = (frame * self.FECBLOCKS + n) * self.KBCH
+                self.assertEqual(p[9:-4], pack_bits(bits[start:start + self.KBCH]))
+            p = packets[(frame + 1) * stride - 1]
+            self.assertEqual(p[6], frame % self.T2FRAMES)
+
+    def test_002_l1_streamtype (self):
+        bits = [0] * (self.KBCH * self.FECBLOCKS)
+        packets = self.split_packets(self.run_gateway(bits, dvbt2.PAYLOAD_GSE))
+        # L1-pre TYPE follows frame_idx and rfu, GSE is signalled as GS
+        self.assertEqual(packets[-1][0], 0x10)
+        self.assertEqual(packets[-1][8], dvbt2.STREAMTYPE_GS)
+
+
+if __name__ == '__main__':
+    gr_unittest.run(qa_t2mi_gateway_bb, "qa_t2mi_gateway_bb.xml")
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# 
+# Copyright 2014 Ron Economos.
+# 
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+# 
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this software; see the file COPYING.  If not, write to
+# the Free Software Foundation, Inc., 51 Franklin Street,
+# Boston, MA 02110-1301, USA.
+# 
+
+from gnuradio import gr, gr_unittest
+from gnuradio import blocks
+import dvbt2_swig as dvbt2
+
+class qa_t2mi_parser_bb (gr_unittest.TestCase):
+
+    KBCH = 7032    # short FECFRAME, code rate 1/2
+    FECBLOCKS = 2
+    T2FRAMES = 2
+    FRAMES = 8     # room after the error for the byte-wise resync
+
+    def setUp (self):
+        self.tb = gr.top_block ()
+
+    def tearDown (self):
+        self.tb = None
+
+    def make_stream (self):
+        bits = [(n * 7 + n // 13) & 1 for n in range(self.KBCH * self.FECBLOCKS * self.FRAMES)]
+        src = blocks.vector_source_b(bits)
+        gateway = dvbt2.t2mi_gateway_bb(dvbt2.FECFRAME_SHORT, dvbt2.C1_2, dvbt2.MOD_QPSK, dvbt2.ROTATION_OFF, self.FECBLOCKS, 1, dvbt2.CARRIERS_NORMAL, dvbt2.FFTSIZE_2K, dvbt2.GI_1_32, dvbt2.L1_MOD_16QAM, dvbt2.PILOT_PP7, self.T2FRAMES, 100, dvbt2.PAPR_OFF, dvbt2.VERSION_111, dvbt2.PREAMBLE_T2_SISO, dvbt2.INPUTMODE_NORMAL, dvbt2.RESERVED_OFF, dvbt2.L1_SCRAMBLED_OFF, dvbt2.INBAND_OFF, dvbt2.BANDWIDTH_8_0_MHZ)
+        dst = blocks.vector_sink_b()
+        self.tb.connect(src, gateway, dst)
+        self.tb.run ()
+        return bits, list(dst.data())
+
+    def packet_offsets (self, data):
+        offsets = []
+        i = 0
+        while i < len(data):
+            offsets.append(i)
+            payload_bits = (data[i + 4] << 8) | data[i + 5]
+            i += 6 + (payload_bits + 7) // 8 + 4
+        return offsets
+
+    def parse (self, data):
+        tb = gr.top_block ()
+        src = blocks.vector_source_b(data)
+        parser = dvbt2.t2mi_parser_bb(dvbt2.FECFRAME_SHORT, dvbt2.C1_2)
+        dst = blocks.vector_sink_b()
+        tb.connect(src, parser, dst)
+        tb.run ()
+        return list(dst.data())
+
+    def corrupt_bbframe (self, data, frame, block):
+        # timestamp, BB frame packets, L1-current for each T2 frame
+        offsets = self.packet_offsets(data)
+        packet = offsets[frame * (self.FECBLOCKS + 2) + 1 + block]
+        data[packet + 20] ^= 0x01
+
+    def bbframe (self, bits, frame, block):
+        start = (frame * self.FECBLOCKS + block) * self.KBCH
+        return bits[start:start + self.KBCH]
+
+    def test_001_round_trip (self):
+        bits, data = self.make_stream()
+        self.assertEqual(self.parse(data), bits)
+
+    def test_002_lost_bbframe (self):
+        bits, data = self.make_stream()
+        self.corrupt_bbframe(data, 2, 1)
+        out = self.parse(data)
+        # the lost BBFRAME is replaced, later frames stay in place
+        self.assertEqual(len(out), len(bits))
+        self.assertEqual(out[:5 * self.KBCH], bits[:5 * self.KBCH])
+        self.assertEqual(out[5 * self.KBCH:6 * self.KBCH], [0] * self.KBCH)
+        self.assertEqual(out[6 * self.KBCH:], bits[6 * self.KBCH:])
+
+    def test_003_lost_frame_start (self):
+        bits, data = self.make_stream()
+        self.corrupt_bbframe(data, 2, 0)
+        out = self.parse(data)
+        # the rest of the T2 frame moves up, the dummy BBFRAME closes it
+        self.assertEqual(len(out), len(bits))
+        self.assertEqual(out[:4 * self.KBCH], bits[:4 * self.KBCH])
+        self.assertEqual(out[4 * self.KBCH:5 * self.KBCH], self.bbframe(bits, 2, 1))
+        self.assertEqual(out[5 * self.KBCH:6 * self.KBCH], [0] * self.KBCH)
+        self.assertEqual(out[6 * self.KBCH:], bits[6 * self.KBCH:])
+
+
+if __name__ == '__main__':
+    gr_unittest.run(qa_t2mi_parser_bb, "qa_t2mi_parser_bb.xml")
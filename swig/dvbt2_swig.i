@@ -22,6 +22,8 @@
 #include "dvbt2/p1insertion_cc.h"
 #include "dvbt2/paprtr_cc.h"
 #include "dvbt2/miso_cc.h"
+#include "dvbt2/t2mi_gateway_bb.h"
+#include "dvbt2/t2mi_parser_bb.h"
 %}
 
 
@@ -53,3 +55,7 @@ GR_SWIG_BLOCK_MAGIC2(dvbt2, p1insertion_cc);
 GR_SWIG_BLOCK_MAGIC2(dvbt2, paprtr_cc);
 %include "dvbt2/miso_cc.h"
 GR_SWIG_BLOCK_MAGIC2(dvbt2, miso_cc);
+%include "dvbt2/t2mi_gateway_bb.h"
+GR_SWIG_BLOCK_MAGIC2(dvbt2, t2mi_gateway_bb);
+%include "dvbt2/t2mi_parser_bb.h"
+GR_SWIG_BLOCK_MAGIC2(dvbt2, t2mi_parser_bb);